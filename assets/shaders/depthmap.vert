@@ -9,8 +9,6 @@ layout(push_constant) uniform constants{
 invariant gl_Position;
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inUV;
 
 void main() {
     vec4 world_pos = push_constants.model_to_world_transform*vec4(inPosition,1.0f);    
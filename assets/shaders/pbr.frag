@@ -98,8 +98,11 @@ void main() {
     vec3 currentColor = vec3(0.0f);
 
     vec3 n = N;
-    if(material.normal_texture_id>-1)
-        n = mat3(T,B,N)*texture(textures[material.normal_texture_id],texCoords).rgb;
+    if(material.normal_texture_id>-1){
+        // Normal maps store x and y only, z follows from the unit length
+        vec2 xy = texture(textures[material.normal_texture_id],texCoords).rg*2.0f-1.0f;
+        n = normalize(mat3(T,B,N)*vec3(xy,sqrt(max(1.0f-dot(xy,xy),0.0f))));
+    }
     vec3 albedo = material.color.rgb;
     if(material.albedo_texture_id>-1)
         albedo = texture(textures[material.albedo_texture_id],texCoords).rgb;
@@ -114,7 +117,7 @@ void main() {
     vec2 screen_pos = (clipPos.xy/clipPos.w+1.0f)/2.0f;
     vec3 ssao_sample = vec3(1.0f);
     if(material.ao_texture_id>-1)
-        ssao_sample = texture(textures[material.ao_texture_id],texCoords).rgb;
+        ssao_sample = vec3(texture(textures[material.ao_texture_id],texCoords).r);
     else if(settings_uniform.ssao_enabled>0)
         ssao_sample = texture_gaussian(ssao_map,screen_pos).rgb;
     float roughness_mip = (roughness*MAX_MIP_LEVEL);
@@ -7,9 +7,12 @@ layout(push_constant) uniform constants{
     uint material_id;
 }push_constants;
 
+// Set for PackedVertex input, see GetVertexInputState
+layout(constant_id = 0) const bool kPackedVertices = false;
+
 invariant gl_Position;
 
-layout(location = 0) in vec3 inPosition;
+layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUV;
 layout(location = 3) in vec3 inTangent;
@@ -25,16 +28,33 @@ layout(location = 6) out vec3 worldCamera;
 layout(location = 7) out vec2 texCoord;
 layout(location = 8) out uint materialId;
 
+vec3 DecodeOctahedral(vec2 encoded) {
+    vec3 v = vec3(encoded, 1.0f-abs(encoded.x)-abs(encoded.y));
+    if (v.z < 0.0f) {
+        vec2 signs = vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+        v.xy = (1.0f-abs(v.yx))*signs;
+    }
+    return normalize(v);
+}
+
 void main() {
+    vec3 normal = inNormal;
+    vec3 tangent = inTangent;
+    vec3 bitangent = inBiTangent;
+    if (kPackedVertices) {
+        normal = DecodeOctahedral(inNormal.xy);
+        tangent = DecodeOctahedral(inTangent.xy);
+        bitangent = cross(normal, tangent)*inPosition.w;
+    }
     mat3 model_to_world_vec_transform = mat3(transpose(inverse(push_constants.model_to_world_transform)));
     mat3 world_to_view_vec_transform = mat3(transpose(inverse(push_constants.world_to_view_transform)));
-    worldPos = push_constants.model_to_world_transform*vec4(inPosition,1.0f);
+    worldPos = push_constants.model_to_world_transform*vec4(inPosition.xyz,1.0f);
     viewPos = push_constants.world_to_view_transform*worldPos;
     vec3 viewCamera = normalize(-viewPos.xyz/viewPos.w);
     worldCamera = normalize(inverse(world_to_view_vec_transform)*viewCamera);
-    worldNormal = model_to_world_vec_transform*inNormal;
-    worldTangent = model_to_world_vec_transform*inTangent;
-    worldBiTangent = model_to_world_vec_transform*inBiTangent;
+    worldNormal = model_to_world_vec_transform*normal;
+    worldTangent = model_to_world_vec_transform*tangent;
+    worldBiTangent = model_to_world_vec_transform*bitangent;
     texCoord = inUV;
     materialId = push_constants.material_id;
     clipPos = push_constants.view_to_clip_transform*viewPos;
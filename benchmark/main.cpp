@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <catalyst/application/application.h>
+#include <catalyst/filesystem/meshoptimizer.h>
+#include <catalyst/scene/sceneobject.h>
+#include <catalyst/window/headless/headlesswindow.h>
+
+// Renders a fixed scene into offscreen images and reports frame times, so
+// throughput can be measured without a display or compositor.
+// Usage: benchmark [frames] [width] [height]
+int main(int argc, char** argv) {
+  // Every average below divides by the frame count, and the offscreen images
+  // need a non-zero extent
+  for (int arg_i = 1; arg_i < std::min(argc, 4); arg_i++) {
+    if (std::atoi(argv[arg_i]) <= 0) {
+      std::cerr << "Usage: benchmark [frames] [width] [height], all must be "
+                   "positive numbers"
+                << std::endl;
+      return 1;
+    }
+  }
+  uint32_t frame_count = argc > 1 ? std::atoi(argv[1]) : 1000;
+  uint32_t width = argc > 2 ? std::atoi(argv[2]) : 1280;
+  uint32_t height = argc > 3 ? std::atoi(argv[3]) : 720;
+  uint32_t warmup_count = 10;
+
+  catalyst::Scene scene;
+  catalyst::Application app;
+  catalyst::HeadlessWindow window(width, height,
+                                  warmup_count + frame_count);
+  app.AssignWindow(&window);
+  app.StartUp(argc, argv);
+
+  catalyst::CameraObject* camera =
+      scene.AddCamera(scene.root_, catalyst::CameraType::kPerspective);
+  camera->transform_.SetTranslation(glm::vec3(0.0f, -1.0f, 0.0f));
+  scene.AddDirectionalLight(scene.root_);
+  catalyst::PrimitiveMeshType mesh_types[] = {
+      catalyst::PrimitiveMeshType::kCube, catalyst::PrimitiveMeshType::kTeapot,
+      catalyst::PrimitiveMeshType::kBunny};
+  for (uint32_t mesh_i = 0; mesh_i < 3; mesh_i++) {
+    catalyst::MeshObject* mesh =
+        scene.AddPrimitiveMesh(scene.root_, mesh_types[mesh_i]);
+    mesh->transform_.SetTranslation(
+        glm::vec3(2.0f * mesh_i - 2.0f, 4.0f, 0.0f));
+  }
+  app.LoadScene(&scene);
+
+  // Let resource uploads and pipeline warmup settle before measuring
+  while (window.GetUpdateCount() < warmup_count) app.Update();
+
+  float cpu_wait_ms = 0.0f;
+  float gpu_idle_ms = 0.0f;
+  auto start = std::chrono::high_resolution_clock::now();
+  while (window.IsOpen()) {
+    app.Update();
+    catalyst::Application::FrameTimings timings = app.GetFrameTimings();
+    cpu_wait_ms += timings.cpu_wait_ms;
+    gpu_idle_ms += timings.gpu_idle_ms;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  float total_ms =
+      std::chrono::duration<float, std::chrono::milliseconds::period>(end -
+                                                                      start)
+          .count();
+  catalyst::Application::MemoryStatistics memory = app.GetMemoryStatistics();
+  app.ShutDown();
+
+  std::cout << "Frames: " << frame_count << " at " << width << "x" << height
+            << std::endl;
+  std::cout << "Average frame time: " << total_ms / frame_count << " ms ("
+            << 1000.0f * frame_count / total_ms << " fps)" << std::endl;
+  std::cout << "Average CPU wait: " << cpu_wait_ms / frame_count << " ms"
+            << std::endl;
+  std::cout << "Average GPU idle: " << gpu_idle_ms / frame_count << " ms"
+            << std::endl;
+  std::cout << "Device memory: " << memory.used_bytes / (1024 * 1024)
+            << " MiB used in " << memory.allocation_count
+            << " allocations, " << memory.block_bytes / (1024 * 1024)
+            << " MiB in " << memory.block_count << " blocks ("
+            << 100.0f * memory.fragmentation << "% fragmented)" << std::endl;
+  std::cout << "Heap usage: " << memory.usage_bytes / (1024 * 1024) << " of "
+            << memory.budget_bytes / (1024 * 1024) << " MiB budget (peak "
+            << memory.peak_usage_bytes / (1024 * 1024) << " MiB)" << std::endl;
+  const char* category_names[] = {"Render targets", "Textures", "Cubemaps",
+                                  "Shadow maps",    "Geometry", "Uniforms",
+                                  "Staging"};
+  for (uint32_t category_i = 0;
+       category_i < catalyst::Application::kMemoryCategoryCount;
+       category_i++) {
+    std::cout << "  " << category_names[category_i] << ": "
+              << memory.category_bytes[category_i] / (1024 * 1024)
+              << " MiB (peak "
+              << memory.category_peak_bytes[category_i] / (1024 * 1024)
+              << " MiB)" << std::endl;
+  }
+  // Vertices shaded per triangle in each pass the meshes are drawn in
+  std::cout << "Mesh ACMR:";
+  for (const catalyst::Mesh* mesh : scene.meshes_) {
+    if (mesh->indices.empty()) continue;
+    std::cout << " " << mesh->name_ << " "
+              << catalyst::ComputeAcmr(mesh->indices, mesh->vertices.size());
+  }
+  std::cout << std::endl;
+  return 0;
+}
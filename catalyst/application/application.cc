@@ -49,5 +49,11 @@ void Application::Update() {
     script_->Update(*main_window,*scene_);
   renderer->Update();
 }
+Application::FrameTimings Application::GetFrameTimings() const {
+  return renderer->GetFrameTimings();
+}
+Application::MemoryStatistics Application::GetMemoryStatistics() const {
+  return renderer->GetMemoryStatistics();
+}
 Application::Application() : main_window(nullptr), scene_(nullptr),script_(nullptr) {}
 }  // namespace catalyst
\ No newline at end of file
@@ -12,6 +12,43 @@ class Application {
  class Renderer;
 
  public:
+  struct FrameTimings {
+    // Time the CPU spent blocked waiting for a frame slot to be released
+    float cpu_wait_ms;
+    // Time the GPU sat idle between consecutive frames
+    float gpu_idle_ms;
+  };
+  // Kinds of resources device memory is accounted to
+  enum class MemoryCategory : uint32_t {
+    kRenderTargets = 0,
+    kTextures = 1,
+    kCubemaps = 2,
+    kShadowmaps = 3,
+    kGeometry = 4,
+    // Uniform and storage buffers
+    kUniforms = 5,
+    kStaging = 6,
+  };
+  static const uint32_t kMemoryCategoryCount = 7;
+  struct MemoryStatistics {
+    // Device allocations and the resources sub-allocated from them
+    uint32_t block_count;
+    uint32_t allocation_count;
+    uint64_t block_bytes;
+    uint64_t used_bytes;
+    // Share of free bytes outside of the largest free range of their block
+    float fragmentation;
+    // Bytes of live resources by MemoryCategory and their highest value
+    uint64_t category_bytes[kMemoryCategoryCount];
+    uint64_t category_peak_bytes[kMemoryCategoryCount];
+    // Device local heaps as reported by VK_EXT_memory_budget, which includes
+    // other processes. Without it the budget is the heap size and the usage
+    // only counts this renderer's blocks.
+    uint64_t budget_bytes;
+    uint64_t usage_bytes;
+    uint64_t peak_usage_bytes;
+  };
+
   Scene* scene_;
   Script* script_;
   Application();
@@ -22,6 +59,8 @@ class Application {
   void LoadScene(Scene* scene);
   void LoadScript(Script* script);
   void Update();
+  FrameTimings GetFrameTimings() const;
+  MemoryStatistics GetMemoryStatistics() const;
 
   // Uncopyable
   Application(const Application& a) = delete;
@@ -0,0 +1,200 @@
+#include <catalyst/filesystem/blockcompression.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace catalyst {
+// Interpolation weights of the 4 bit BC7 indices, out of 64
+static const int32_t kBc7Weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                        34, 38, 43, 47, 51, 55, 60, 64};
+
+static void WriteBits(uint8_t* block, uint32_t& bit, uint32_t value,
+                      uint32_t count) {
+  for (uint32_t bit_i = 0; bit_i < count; bit_i++, bit++)
+    block[bit >> 3] |= ((value >> bit_i) & 1) << (bit & 7);
+}
+// Rounds an endpoint to 7 bits per channel and a shared p-bit, keeping the
+// p-bit that lands closer. The results are the expanded 8 bit values.
+static void QuantizeBc7Endpoint(const float* endpoint, int32_t* quantized) {
+  float best_error = FLT_MAX;
+  for (int32_t p_bit = 0; p_bit < 2; p_bit++) {
+    int32_t candidate[4];
+    float error = 0.0f;
+    for (uint32_t c = 0; c < 4; c++) {
+      float value = std::round((endpoint[c] - p_bit) / 2.0f);
+      candidate[c] = (static_cast<int32_t>(std::clamp(value, 0.0f, 127.0f))
+                      << 1) |
+                     p_bit;
+      float diff = candidate[c] - endpoint[c];
+      error += diff * diff;
+    }
+    if (error < best_error) {
+      best_error = error;
+      memcpy(quantized, candidate, sizeof(candidate));
+    }
+  }
+}
+// Picks the closest interpolated color for every texel, returns the summed
+// squared error of the block
+static uint32_t FindBc7Indices(const uint8_t* rgba, const int32_t* endpoints,
+                               uint8_t* indices) {
+  int32_t palette[16][4];
+  for (uint32_t index_i = 0; index_i < 16; index_i++) {
+    int32_t weight = kBc7Weights[index_i];
+    for (uint32_t c = 0; c < 4; c++)
+      palette[index_i][c] =
+          ((64 - weight) * endpoints[c] + weight * endpoints[4 + c] + 32) >> 6;
+  }
+  uint32_t total_error = 0;
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+    uint32_t best_error = UINT32_MAX;
+    for (uint32_t index_i = 0; index_i < 16; index_i++) {
+      uint32_t error = 0;
+      for (uint32_t c = 0; c < 4; c++) {
+        int32_t diff = palette[index_i][c] - rgba[texel_i * 4 + c];
+        error += diff * diff;
+      }
+      if (error < best_error) {
+        best_error = error;
+        indices[texel_i] = index_i;
+      }
+    }
+    total_error += best_error;
+  }
+  return total_error;
+}
+// Quantizes a pair of float endpoints and returns the resulting block error
+static uint32_t FitBc7Endpoints(const uint8_t* rgba, const float* endpoints,
+                                int32_t* quantized, uint8_t* indices) {
+  QuantizeBc7Endpoint(endpoints, quantized);
+  QuantizeBc7Endpoint(endpoints + 4, quantized + 4);
+  return FindBc7Indices(rgba, quantized, indices);
+}
+void EncodeBc4Block(const uint8_t* rgba, uint32_t channel, uint8_t* block) {
+  uint8_t values[16];
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++)
+    values[texel_i] = rgba[texel_i * 4 + channel];
+  uint8_t min_value = *std::min_element(values, values + 16);
+  uint8_t max_value = *std::max_element(values, values + 16);
+  // Eight level mode, the first endpoint is the larger one. Equal endpoints
+  // select the six level mode, where index 0 still decodes to the endpoint.
+  block[0] = max_value;
+  block[1] = min_value;
+  uint64_t indices = 0;
+  int32_t range = max_value - min_value;
+  if (range > 0) {
+    for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+      // Nearest step on the ramp from the maximum (0) to the minimum (7)
+      uint32_t step =
+          ((max_value - values[texel_i]) * 14 + range) / (2 * range);
+      uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+      indices |= index << (3 * texel_i);
+    }
+  }
+  for (uint32_t byte_i = 0; byte_i < 6; byte_i++)
+    block[2 + byte_i] = static_cast<uint8_t>(indices >> (8 * byte_i));
+}
+void EncodeBc5Block(const uint8_t* rgba, uint8_t* block) {
+  EncodeBc4Block(rgba, 0, block);
+  EncodeBc4Block(rgba, 1, block + 8);
+}
+void EncodeBc7Block(const uint8_t* rgba, uint8_t* block) {
+  // Endpoints along the principal axis of the texel colors
+  float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++)
+    for (uint32_t c = 0; c < 4; c++) mean[c] += rgba[texel_i * 4 + c];
+  for (uint32_t c = 0; c < 4; c++) mean[c] /= 16.0f;
+  float covariance[4][4] = {};
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+    float diff[4];
+    for (uint32_t c = 0; c < 4; c++) diff[c] = rgba[texel_i * 4 + c] - mean[c];
+    for (uint32_t row = 0; row < 4; row++)
+      for (uint32_t col = 0; col < 4; col++)
+        covariance[row][col] += diff[row] * diff[col];
+  }
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (uint32_t iteration_i = 0; iteration_i < 8; iteration_i++) {
+    float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (uint32_t row = 0; row < 4; row++)
+      for (uint32_t col = 0; col < 4; col++)
+        next[row] += covariance[row][col] * axis[col];
+    float length = std::sqrt(next[0] * next[0] + next[1] * next[1] +
+                             next[2] * next[2] + next[3] * next[3]);
+    // Flat blocks have no axis, both endpoints collapse onto the mean
+    float scale = length > FLT_EPSILON ? 1.0f / length : 0.0f;
+    for (uint32_t c = 0; c < 4; c++) axis[c] = next[c] * scale;
+  }
+  float min_t = FLT_MAX;
+  float max_t = -FLT_MAX;
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+    float t = 0.0f;
+    for (uint32_t c = 0; c < 4; c++)
+      t += (rgba[texel_i * 4 + c] - mean[c]) * axis[c];
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  float endpoints[8];
+  for (uint32_t c = 0; c < 4; c++) {
+    endpoints[c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+    endpoints[4 + c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+  }
+  int32_t quantized[8];
+  uint8_t indices[16];
+  uint32_t error = FitBc7Endpoints(rgba, endpoints, quantized, indices);
+
+  // One least squares pass over the chosen indices, kept if it helps
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float ax[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  float bx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+    float b = kBc7Weights[indices[texel_i]] / 64.0f;
+    float a = 1.0f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (uint32_t c = 0; c < 4; c++) {
+      ax[c] += a * rgba[texel_i * 4 + c];
+      bx[c] += b * rgba[texel_i * 4 + c];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) > FLT_EPSILON) {
+    float refined[8];
+    for (uint32_t c = 0; c < 4; c++) {
+      refined[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f,
+                              255.0f);
+      refined[4 + c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant,
+                                  0.0f, 255.0f);
+    }
+    int32_t refined_quantized[8];
+    uint8_t refined_indices[16];
+    uint32_t refined_error =
+        FitBc7Endpoints(rgba, refined, refined_quantized, refined_indices);
+    if (refined_error < error) {
+      memcpy(quantized, refined_quantized, sizeof(quantized));
+      memcpy(indices, refined_indices, sizeof(indices));
+    }
+  }
+
+  // The anchor index is stored without its top bit, so it must be below 8
+  if (indices[0] & 8) {
+    for (uint32_t c = 0; c < 4; c++) std::swap(quantized[c], quantized[4 + c]);
+    for (uint32_t texel_i = 0; texel_i < 16; texel_i++)
+      indices[texel_i] = 15 - indices[texel_i];
+  }
+  memset(block, 0, 16);
+  uint32_t bit = 0;
+  WriteBits(block, bit, 1 << 6, 7);
+  for (uint32_t c = 0; c < 4; c++) {
+    WriteBits(block, bit, quantized[c] >> 1, 7);
+    WriteBits(block, bit, quantized[4 + c] >> 1, 7);
+  }
+  WriteBits(block, bit, quantized[0] & 1, 1);
+  WriteBits(block, bit, quantized[4] & 1, 1);
+  WriteBits(block, bit, indices[0], 3);
+  for (uint32_t texel_i = 1; texel_i < 16; texel_i++)
+    WriteBits(block, bit, indices[texel_i], 4);
+}
+}  // namespace catalyst
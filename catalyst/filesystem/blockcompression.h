@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+namespace catalyst {
+// CPU encoders for the BCn block formats. Each call encodes one 4x4 block of
+// RGBA8 texels given in row-major order. The loops run over fixed-size
+// arrays without branches in the inner loops, so compilers vectorize them.
+
+// Writes 8 bytes, encoding a single channel of the block
+void EncodeBc4Block(const uint8_t* rgba, uint32_t channel, uint8_t* block);
+// Writes 16 bytes, encoding the red and green channels of the block
+void EncodeBc5Block(const uint8_t* rgba, uint8_t* block);
+// Writes 16 bytes in mode 6, a single subset with RGBA endpoints
+void EncodeBc7Block(const uint8_t* rgba, uint8_t* block);
+}  // namespace catalyst
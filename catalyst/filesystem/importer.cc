@@ -1,7 +1,19 @@
 #include <catalyst/filesystem/importer.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <catalyst/external/stb_image.h>
@@ -10,6 +22,9 @@
 #include <assimp/scene.h>
 
 #include <catalyst/dev/dev.h>
+#include <catalyst/filesystem/blockcompression.h>
+#include <catalyst/filesystem/meshoptimizer.h>
+#include <catalyst/thread/threadpool.h>
 
 namespace catalyst {
 FileType Importer::InferFiletype(const std::filesystem::path& filepath) {
@@ -23,56 +38,205 @@ FileType Importer::InferFiletype(const std::filesystem::path& filepath) {
   if (extension == ".obj") return FileType::kModel;
   return FileType::kUnknown;
 }
-void Importer::AddResources(Scene& scene, const std::filesystem::path& path) {
-  FileType type = InferFiletype(path);
-  ASSERT(type != FileType::kUnknown, "Unknown file type!");
-  std::string path_string = path.string();
-  std::string stem_string = path.stem().string();
-  switch (type) { 
-    case FileType::kImage: {
-      Texture* tex = scene.AddTexture(stem_string);
-      tex->path_ = path_string;
-      break;
+void Importer::AddResources(Scene& scene, const std::filesystem::path& path,
+                            VertexFormat vertex_format) {
+  AddResources(scene, std::vector<std::filesystem::path>{path},
+               vertex_format);
+}
+// A file of an import batch, its resources are handed to the scene once the
+// whole batch is done
+struct FileImport {
+  std::filesystem::path path;
+  FileType type;
+  Assimp::Importer* importer;
+  const aiScene* ai_scene;
+  bool success;
+  std::vector<Mesh*> meshes;
+};
+static const uint32_t kModelImportFlags =
+    aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// Vertices or faces converted per task
+static const uint32_t kImportChunkSize = 16 * 1024;
+static void ReadModel(Scene& scene, FileImport& file) {
+  std::string stem_string = file.path.stem().string();
+  MeshCache mesh_cache("../cache/meshes");
+  if (mesh_cache.Open(file.path, kModelImportFlags)) {
+    for (uint32_t mesh_i = 0; mesh_i < mesh_cache.GetMeshCount(); mesh_i++) {
+      Mesh* mesh = new Mesh(&scene, stem_string);
+      mesh_cache.ReadMesh(mesh_i, *mesh);
+      file.meshes.push_back(mesh);
     }
-    case FileType::kModel: {
-      AddModelResources(scene,path);
-      break;
+    file.success = true;
+    return;
+  }
+  // Assimp importers can't be shared between threads
+  file.importer = new Assimp::Importer();
+  file.ai_scene =
+      file.importer->ReadFile(file.path.string(), kModelImportFlags);
+  file.success = file.ai_scene != nullptr;
+  if (!file.success) delete file.importer;
+}
+static void ConvertVertices(const aiMesh* ai_mesh, uint32_t begin,
+                            uint32_t end, Vertex* vertices) {
+  for (uint32_t vertex_i = begin; vertex_i < end; vertex_i++) {
+    Vertex& vertex = vertices[vertex_i];
+    const aiVector3D& position = ai_mesh->mVertices[vertex_i];
+    vertex.position = {position.x, position.y, position.z};
+    vertex.normal = glm::vec3(0.0f);
+    vertex.uv = glm::vec2(0.0f);
+    vertex.tangent = glm::vec3(0.0f);
+    vertex.bitangent = glm::vec3(0.0f);
+    if (ai_mesh->HasNormals()) {
+      const aiVector3D& normal = ai_mesh->mNormals[vertex_i];
+      vertex.normal = {normal.x, normal.y, normal.z};
     }
-    default: {
-      ASSERT(false, "Unhandled file type!");
+    if (ai_mesh->HasTextureCoords(0)) {
+      const aiVector3D& uv = ai_mesh->mTextureCoords[0][vertex_i];
+      vertex.uv = {uv.x, uv.y};
+    }
+    if (ai_mesh->HasTangentsAndBitangents()) {
+      const aiVector3D& tangent = ai_mesh->mTangents[vertex_i];
+      const aiVector3D& bitangent = ai_mesh->mBitangents[vertex_i];
+      vertex.tangent = {tangent.x, tangent.y, tangent.z};
+      vertex.bitangent = {bitangent.x, bitangent.y, bitangent.z};
     }
   }
 }
-void Importer::AddModelResources(Scene& scene,
-                                 const std::filesystem::path& path) {
-  Assimp::Importer* importer = new Assimp::Importer();
-  const aiScene* ai_scene = importer->ReadFile(
-      path.string(),
-      aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-  std::string stem_string = path.stem().string();
-  ASSERT(ai_scene != nullptr, "Failed to load scene!");
-  for (uint32_t mesh_i = 0; mesh_i<ai_scene->mNumMeshes; mesh_i++){
-    const aiMesh* ai_mesh = ai_scene->mMeshes[mesh_i];
-    Mesh* mesh = scene.AddMesh(stem_string);
-    mesh->material_id = 0;
-    for (uint32_t vi = 0; vi < ai_mesh->mNumVertices; vi++) {
-      const aiVector3D& vert = ai_mesh->mVertices[vi];
-      const aiVector3D& norm = ai_mesh->mNormals[vi];
-      const aiVector3D& tex = ai_mesh->mTextureCoords[0][vi];
-      const aiVector3D& tan = ai_mesh->mTangents[vi];
-      const aiVector3D& bitan = ai_mesh->mBitangents[vi];
-      Vertex v = {
-          {vert.x, vert.y, vert.z}, {norm.x, norm.y, norm.z}, {tex.x, tex.y}};
-      mesh->vertices.push_back(v);
+static void ConvertFaces(const aiMesh* ai_mesh, uint32_t begin, uint32_t end,
+                         uint32_t* indices) {
+  for (uint32_t face_i = begin; face_i < end; face_i++) {
+    const aiFace& face = ai_mesh->mFaces[face_i];
+    // Points and lines left over by triangulation become degenerate
+    for (uint32_t corner_i = 0; corner_i < 3; corner_i++) {
+      uint32_t index_i = std::min(corner_i, face.mNumIndices - 1);
+      indices[face_i * 3 + corner_i] = face.mIndices[index_i];
     }
-    for (uint32_t fi = 0; fi < ai_mesh->mNumFaces; fi++) {
-      const aiFace& face = ai_mesh->mFaces[fi];
-      for (uint32_t idx = 0; idx < face.mNumIndices; idx++) {
-        mesh->indices.push_back(face.mIndices[idx]);
+  }
+}
+static void AddDirectoryFiles(const std::filesystem::path& path,
+                              std::vector<FileImport>& files) {
+  std::vector<std::filesystem::path> entries;
+  for (const auto& entry : std::filesystem::directory_iterator(path)) {
+    if (!entry.is_regular_file()) continue;
+    if (Importer::InferFiletype(entry.path()) == FileType::kUnknown) continue;
+    entries.push_back(entry.path());
+  }
+  // Directory order is unspecified, keep resource names stable
+  std::sort(entries.begin(), entries.end());
+  for (const std::filesystem::path& entry : entries) {
+    files.push_back({entry, Importer::InferFiletype(entry)});
+  }
+}
+void Importer::AddResources(Scene& scene,
+                            const std::vector<std::filesystem::path>& paths,
+                            VertexFormat vertex_format) {
+  std::vector<FileImport> files;
+  for (const std::filesystem::path& path : paths) {
+    if (std::filesystem::is_directory(path)) {
+      AddDirectoryFiles(path, files);
+      continue;
+    }
+    FileType type = InferFiletype(path);
+    ASSERT(type != FileType::kUnknown, "Unknown file type!");
+    files.push_back({path, type});
+  }
+  // A file given twice, eg. directly and through its directory, is imported
+  // once, so no two workers write the same cache file
+  std::set<std::filesystem::path> seen_paths;
+  std::vector<FileImport> unique_files;
+  for (FileImport& file : files) {
+    std::error_code error;
+    std::filesystem::path canonical_path =
+        std::filesystem::weakly_canonical(file.path, error);
+    if (error) canonical_path = file.path;
+    if (seen_paths.insert(canonical_path).second)
+      unique_files.push_back(std::move(file));
+  }
+  files = std::move(unique_files);
+
+  ThreadPool thread_pool(std::max(1u, std::thread::hardware_concurrency()));
+  // Read every model from the mesh cache or parse it
+  for (FileImport& file : files) {
+    if (file.type != FileType::kModel) continue;
+    thread_pool.Submit(
+        [&scene, &file](uint32_t thread_i) { ReadModel(scene, file); });
+  }
+  thread_pool.Wait();
+
+  // Convert the parsed meshes in chunks into preallocated arrays
+  for (FileImport& file : files) {
+    if (file.ai_scene == nullptr) continue;
+    std::string stem_string = file.path.stem().string();
+    for (uint32_t mesh_i = 0; mesh_i < file.ai_scene->mNumMeshes; mesh_i++) {
+      const aiMesh* ai_mesh = file.ai_scene->mMeshes[mesh_i];
+      Mesh* mesh = new Mesh(&scene, stem_string);
+      mesh->vertices.resize(ai_mesh->mNumVertices);
+      mesh->indices.resize(ai_mesh->mNumFaces * 3);
+      file.meshes.push_back(mesh);
+      for (uint32_t begin = 0; begin < ai_mesh->mNumVertices;
+           begin += kImportChunkSize) {
+        uint32_t end = std::min(begin + kImportChunkSize,
+                                ai_mesh->mNumVertices);
+        thread_pool.Submit([ai_mesh, mesh, begin, end](uint32_t thread_i) {
+          ConvertVertices(ai_mesh, begin, end, mesh->vertices.data());
+        });
+      }
+      for (uint32_t begin = 0; begin < ai_mesh->mNumFaces;
+           begin += kImportChunkSize) {
+        uint32_t end = std::min(begin + kImportChunkSize, ai_mesh->mNumFaces);
+        thread_pool.Submit([ai_mesh, mesh, begin, end](uint32_t thread_i) {
+          ConvertFaces(ai_mesh, begin, end, mesh->indices.data());
+        });
+      }
+    }
+  }
+  thread_pool.Wait();
+
+  // Cached meshes were optimized before they were written
+  for (FileImport& file : files) {
+    bool parsed = file.ai_scene != nullptr;
+    for (Mesh* mesh : file.meshes) {
+      thread_pool.Submit([mesh, parsed, vertex_format](uint32_t thread_i) {
+        if (parsed) {
+          OptimizeMesh(*mesh);
+          mesh->UpdateBounds();
+        }
+        if (vertex_format == VertexFormat::kPacked) mesh->PackVertices();
+      });
+    }
+  }
+  thread_pool.Wait();
+
+  for (FileImport& file : files) {
+    if (file.ai_scene == nullptr) continue;
+    thread_pool.Submit([&file](uint32_t thread_i) {
+      delete file.importer;
+      MeshCache mesh_cache("../cache/meshes");
+      mesh_cache.Write(file.path, kModelImportFlags,
+                       std::vector<const Mesh*>(file.meshes.begin(),
+                                                file.meshes.end()));
+    });
+  }
+  thread_pool.Wait();
+
+  // The scene is only touched here, in the order the files were given
+  for (FileImport& file : files) {
+    switch (file.type) {
+      case FileType::kImage: {
+        Texture* tex = scene.AddTexture(file.path.stem().string());
+        tex->path_ = file.path.string();
+        break;
+      }
+      case FileType::kModel: {
+        ASSERT(file.success, "Failed to load scene!");
+        for (Mesh* mesh : file.meshes) scene.AddMesh(mesh);
+        break;
+      }
+      default: {
+        ASSERT(false, "Unhandled file type!");
       }
     }
   }
-  delete importer;
 }
 TextureImporter::TextureImporter() : data(nullptr) {}
 TextureImporter::~TextureImporter() { DestroyData(); }
@@ -105,4 +269,435 @@ TextureData::~TextureData() {
   height = 0;
   channels = 0;
 }
+// FNV-1a, continuing from a previous hash
+static uint64_t HashBytes(const void* data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t byte_i = 0; byte_i < size; byte_i++) {
+    hash ^= bytes[byte_i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+// Cache files are written under a name unique to the writer and renamed into
+// place, so concurrent writers never interleave and readers never see a
+// partly written file
+static std::filesystem::path GetCacheTempFile(
+    const std::filesystem::path& cache_file) {
+  static const uint32_t process_key = std::random_device()();
+  static std::atomic<uint32_t> temp_count(0);
+  char temp_name[32];
+  snprintf(temp_name, sizeof(temp_name), ".%08x.%u.tmp", process_key,
+           temp_count.fetch_add(1));
+  std::filesystem::path temp_file = cache_file;
+  temp_file += temp_name;
+  return temp_file;
+}
+static void CommitCacheFile(const std::filesystem::path& temp_file,
+                            const std::filesystem::path& cache_file,
+                            bool written) {
+  std::error_code error;
+  if (written) std::filesystem::rename(temp_file, cache_file, error);
+  if (!written || error) std::filesystem::remove(temp_file, error);
+}
+// Bump when the encoders change so stale cache files are cooked again
+static const uint32_t kCookedTextureVersion = 1;
+static const uint32_t kCookedTextureMagic = 0x58455443;  // "CTEX"
+struct CookedTextureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  uint32_t compression;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_count;
+};
+// Box filters a level to half its size with the footprint of the GPU mip
+// path, in linear space for color and renormalized for normal maps
+static std::vector<uint8_t> DownsampleTextureLevel(
+    const std::vector<uint8_t>& src, uint32_t src_width, uint32_t src_height,
+    TextureCompression compression) {
+  static const std::array<float, 256> srgb_to_linear = [] {
+    std::array<float, 256> table;
+    for (uint32_t value = 0; value < 256; value++) {
+      float srgb = value / 255.0f;
+      table[value] = srgb <= 0.04045f
+                         ? srgb / 12.92f
+                         : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+  }();
+  uint32_t dst_width = std::max(src_width / 2, 1u);
+  uint32_t dst_height = std::max(src_height / 2, 1u);
+  std::vector<uint8_t> dst(dst_width * dst_height * 4);
+  for (uint32_t y = 0; y < dst_height; y++) {
+    uint32_t begin_y = std::min(2 * y, src_height - 1);
+    uint32_t end_y =
+        y == dst_height - 1 ? src_height : std::min(begin_y + 2, src_height);
+    for (uint32_t x = 0; x < dst_width; x++) {
+      uint32_t begin_x = std::min(2 * x, src_width - 1);
+      uint32_t end_x =
+          x == dst_width - 1 ? src_width : std::min(begin_x + 2, src_width);
+      float color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      for (uint32_t sy = begin_y; sy < end_y; sy++) {
+        for (uint32_t sx = begin_x; sx < end_x; sx++) {
+          const uint8_t* texel = &src[(sy * src_width + sx) * 4];
+          for (uint32_t c = 0; c < 4; c++)
+            color[c] += compression == TextureCompression::kBc7 && c < 3
+                            ? srgb_to_linear[texel[c]]
+                            : texel[c] / 255.0f;
+        }
+      }
+      float texel_count = static_cast<float>((end_x - begin_x) *
+                                             (end_y - begin_y));
+      for (uint32_t c = 0; c < 4; c++) color[c] /= texel_count;
+      if (compression == TextureCompression::kBc7) {
+        for (uint32_t c = 0; c < 3; c++)
+          color[c] = color[c] <= 0.0031308f
+                         ? color[c] * 12.92f
+                         : 1.055f * std::pow(color[c], 1.0f / 2.4f) - 0.055f;
+      } else if (compression == TextureCompression::kBc5) {
+        float normal[3];
+        for (uint32_t c = 0; c < 3; c++) normal[c] = color[c] * 2.0f - 1.0f;
+        float length = std::sqrt(normal[0] * normal[0] +
+                                 normal[1] * normal[1] +
+                                 normal[2] * normal[2]);
+        if (length > 0.0f) {
+          for (uint32_t c = 0; c < 3; c++)
+            color[c] = normal[c] / length * 0.5f + 0.5f;
+        }
+      }
+      uint8_t* texel = &dst[(y * dst_width + x) * 4];
+      for (uint32_t c = 0; c < 4; c++)
+        texel[c] = static_cast<uint8_t>(
+            std::round(std::clamp(color[c], 0.0f, 1.0f) * 255.0f));
+    }
+  }
+  return dst;
+}
+TextureCooker::TextureCooker(const std::filesystem::path& cache_path)
+    : cache_path_(cache_path) {
+  uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_pool_ = new ThreadPool(thread_count);
+}
+TextureCooker::~TextureCooker() { delete thread_pool_; }
+uint32_t TextureCooker::GetBlockSize(TextureCompression compression) {
+  return compression == TextureCompression::kBc4 ? 8 : 16;
+}
+bool TextureCooker::Cook(const std::filesystem::path& path,
+                         TextureCompression compression,
+                         CookedTextureData& cooked) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::vector<uint8_t> source((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+  // Keyed by the file contents and the encoding settings
+  uint32_t settings[2] = {kCookedTextureVersion,
+                          static_cast<uint32_t>(compression)};
+  uint64_t hash = HashBytes(source.data(), source.size());
+  hash = HashBytes(settings, sizeof(settings), hash);
+  char hash_name[17];
+  snprintf(hash_name, sizeof(hash_name), "%016llx",
+           static_cast<unsigned long long>(hash));
+  std::filesystem::path cache_file =
+      cache_path_ / (std::string(hash_name) + ".ctex");
+  if (ReadCache(cache_file, hash, cooked)) return true;
+
+  int x, y, n;
+  unsigned char* pixels =
+      stbi_load_from_memory(source.data(), static_cast<int>(source.size()),
+                            &x, &y, &n, 4);
+  if (pixels == nullptr) return false;
+  std::vector<std::vector<uint8_t>> levels(1);
+  levels[0].assign(pixels, pixels + x * y * 4);
+  stbi_image_free(pixels);
+  cooked.compression = compression;
+  cooked.width = x;
+  cooked.height = y;
+  uint32_t width = cooked.width;
+  uint32_t height = cooked.height;
+  while (width > 1 || height > 1) {
+    levels.push_back(
+        DownsampleTextureLevel(levels.back(), width, height, compression));
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+  Encode(levels, cooked);
+  WriteCache(cache_file, hash, cooked);
+  return true;
+}
+bool TextureCooker::ReadCache(const std::filesystem::path& cache_file,
+                              uint64_t hash, CookedTextureData& cooked) {
+  std::ifstream file(cache_file, std::ios::binary);
+  if (!file) return false;
+  CookedTextureHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != kCookedTextureMagic ||
+      header.version != kCookedTextureVersion || header.source_hash != hash ||
+      header.compression > static_cast<uint32_t>(TextureCompression::kBc4) ||
+      header.width == 0 || header.height == 0)
+    return false;
+  // The mips must be the full chain the header's size and encoding produce
+  TextureCompression compression =
+      static_cast<TextureCompression>(header.compression);
+  uint32_t mip_count = 1;
+  while ((std::max(header.width, header.height) >> mip_count) > 0)
+    mip_count++;
+  if (header.mip_count != mip_count) return false;
+  std::vector<uint64_t> mip_sizes(header.mip_count);
+  file.read(reinterpret_cast<char*>(mip_sizes.data()),
+            mip_sizes.size() * sizeof(uint64_t));
+  if (!file) return false;
+  for (uint32_t mip_i = 0; mip_i < header.mip_count; mip_i++) {
+    uint64_t blocks_x = (std::max(header.width >> mip_i, 1u) + 3) / 4;
+    uint64_t blocks_y = (std::max(header.height >> mip_i, 1u) + 3) / 4;
+    if (mip_sizes[mip_i] != blocks_x * blocks_y * GetBlockSize(compression))
+      return false;
+  }
+  cooked.compression = compression;
+  cooked.width = header.width;
+  cooked.height = header.height;
+  cooked.mips.resize(header.mip_count);
+  for (uint32_t mip_i = 0; mip_i < header.mip_count; mip_i++) {
+    cooked.mips[mip_i].resize(mip_sizes[mip_i]);
+    file.read(reinterpret_cast<char*>(cooked.mips[mip_i].data()),
+              mip_sizes[mip_i]);
+  }
+  return static_cast<bool>(file);
+}
+void TextureCooker::WriteCache(const std::filesystem::path& cache_file,
+                               uint64_t hash,
+                               const CookedTextureData& cooked) {
+  // The cache is best effort, the texture was cooked either way
+  std::error_code error;
+  std::filesystem::create_directories(cache_path_, error);
+  std::filesystem::path temp_file = GetCacheTempFile(cache_file);
+  std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+  if (!file) return;
+  CookedTextureHeader header{};
+  header.magic = kCookedTextureMagic;
+  header.version = kCookedTextureVersion;
+  header.source_hash = hash;
+  header.compression = static_cast<uint32_t>(cooked.compression);
+  header.width = cooked.width;
+  header.height = cooked.height;
+  header.mip_count = static_cast<uint32_t>(cooked.mips.size());
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const std::vector<uint8_t>& mip : cooked.mips) {
+    uint64_t mip_size = mip.size();
+    file.write(reinterpret_cast<const char*>(&mip_size), sizeof(mip_size));
+  }
+  for (const std::vector<uint8_t>& mip : cooked.mips)
+    file.write(reinterpret_cast<const char*>(mip.data()), mip.size());
+  file.close();
+  CommitCacheFile(temp_file, cache_file, static_cast<bool>(file));
+}
+void TextureCooker::Encode(const std::vector<std::vector<uint8_t>>& levels,
+                           CookedTextureData& cooked) {
+  uint32_t block_size = GetBlockSize(cooked.compression);
+  TextureCompression compression = cooked.compression;
+  cooked.mips.resize(levels.size());
+  // Other Cooks share the pool, so only this call's rows are waited on
+  std::mutex rows_mutex;
+  std::condition_variable rows_finished;
+  uint32_t rows_left = 0;
+  for (uint32_t level_i = 0; level_i < levels.size(); level_i++) {
+    uint32_t height = std::max(cooked.height >> level_i, 1u);
+    rows_left += (height + 3) / 4;
+  }
+  for (uint32_t level_i = 0; level_i < levels.size(); level_i++) {
+    uint32_t width = std::max(cooked.width >> level_i, 1u);
+    uint32_t height = std::max(cooked.height >> level_i, 1u);
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+    cooked.mips[level_i].resize(blocks_x * blocks_y * block_size);
+    const uint8_t* level = levels[level_i].data();
+    uint8_t* mip = cooked.mips[level_i].data();
+    // One task per row of blocks, edge blocks repeat the last texels
+    for (uint32_t block_y = 0; block_y < blocks_y; block_y++) {
+      thread_pool_->Submit([=, &rows_mutex, &rows_finished,
+                            &rows_left](uint32_t thread_i) {
+        uint8_t texels[64];
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+          for (uint32_t texel_i = 0; texel_i < 16; texel_i++) {
+            uint32_t x = std::min(block_x * 4 + texel_i % 4, width - 1);
+            uint32_t y = std::min(block_y * 4 + texel_i / 4, height - 1);
+            memcpy(&texels[texel_i * 4], &level[(y * width + x) * 4], 4);
+          }
+          uint8_t* block =
+              mip + (block_y * blocks_x + block_x) * block_size;
+          switch (compression) {
+            case TextureCompression::kBc7:
+              EncodeBc7Block(texels, block);
+              break;
+            case TextureCompression::kBc5:
+              EncodeBc5Block(texels, block);
+              break;
+            case TextureCompression::kBc4:
+              EncodeBc4Block(texels, 0, block);
+              break;
+          }
+        }
+        std::lock_guard<std::mutex> lock(rows_mutex);
+        if (--rows_left == 0) rows_finished.notify_all();
+      });
+    }
+  }
+  std::unique_lock<std::mutex> lock(rows_mutex);
+  rows_finished.wait(lock, [&rows_left]() { return rows_left == 0; });
+}
+static const uint32_t kMeshCacheVersion = 3;
+static const uint32_t kMeshCacheMagic = 0x48534D43;  // "CMSH"
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_key;
+  uint32_t vertex_size;
+  uint32_t mesh_count;
+};
+// Arrays start at 16 byte aligned offsets, so they can be read in place
+struct MeshCacheEntry {
+  uint64_t vertex_offset;
+  uint64_t vertex_count;
+  uint64_t index_offset;
+  uint64_t index_count;
+  float bounds_min[3];
+  float bounds_max[3];
+};
+MeshCache::MeshCache(const std::filesystem::path& cache_path)
+    : cache_path_(cache_path), header_(nullptr), entries_(nullptr) {}
+bool MeshCache::Open(const std::filesystem::path& path, uint32_t variant) {
+  file_.Close();
+  header_ = nullptr;
+  entries_ = nullptr;
+  uint64_t key;
+  if (!GetSourceKey(path, variant, key)) return false;
+  if (!file_.Open(GetCacheFile(key))) return false;
+  const uint8_t* data = file_.GetData();
+  size_t size = file_.GetSize();
+  const MeshCacheHeader* header =
+      reinterpret_cast<const MeshCacheHeader*>(data);
+  bool valid = size >= sizeof(MeshCacheHeader) &&
+               header->magic == kMeshCacheMagic &&
+               header->version == kMeshCacheVersion &&
+               header->source_key == key &&
+               header->vertex_size == sizeof(Vertex) &&
+               size >= sizeof(MeshCacheHeader) +
+                           header->mesh_count * sizeof(MeshCacheEntry);
+  const MeshCacheEntry* entries =
+      reinterpret_cast<const MeshCacheEntry*>(data + sizeof(MeshCacheHeader));
+  // A partially written file fails here and is imported again
+  for (uint32_t mesh_i = 0; valid && mesh_i < header->mesh_count; mesh_i++) {
+    const MeshCacheEntry& entry = entries[mesh_i];
+    valid = entry.vertex_offset + entry.vertex_count * sizeof(Vertex) <=
+                size &&
+            entry.index_offset + entry.index_count * sizeof(uint32_t) <= size;
+  }
+  if (!valid) {
+    file_.Close();
+    return false;
+  }
+  header_ = header;
+  entries_ = entries;
+  return true;
+}
+uint32_t MeshCache::GetMeshCount() const {
+  ASSERT(header_ != nullptr, "No mesh cache open!");
+  return header_->mesh_count;
+}
+void MeshCache::ReadMesh(uint32_t mesh_i, Mesh& mesh) const {
+  ASSERT(header_ != nullptr && mesh_i < header_->mesh_count,
+         "Mesh is not in the cache!");
+  const MeshCacheEntry& entry = entries_[mesh_i];
+  const Vertex* vertices =
+      reinterpret_cast<const Vertex*>(file_.GetData() + entry.vertex_offset);
+  const uint32_t* indices =
+      reinterpret_cast<const uint32_t*>(file_.GetData() + entry.index_offset);
+  mesh.vertices.assign(vertices, vertices + entry.vertex_count);
+  mesh.indices.assign(indices, indices + entry.index_count);
+  mesh.bounds_min = glm::vec3(entry.bounds_min[0], entry.bounds_min[1],
+                              entry.bounds_min[2]);
+  mesh.bounds_max = glm::vec3(entry.bounds_max[0], entry.bounds_max[1],
+                              entry.bounds_max[2]);
+}
+void MeshCache::Write(const std::filesystem::path& path, uint32_t variant,
+                      const std::vector<const Mesh*>& meshes) {
+  // The cache is best effort, the meshes were imported either way
+  uint64_t key;
+  if (!GetSourceKey(path, variant, key)) return;
+  std::error_code error;
+  std::filesystem::create_directories(cache_path_, error);
+  // Open caches map the file, so it is replaced and never truncated
+  std::filesystem::path cache_file = GetCacheFile(key);
+  std::filesystem::path temp_file = GetCacheTempFile(cache_file);
+  std::ofstream file(temp_file, std::ios::binary | std::ios::trunc);
+  if (!file) return;
+  auto align = [](uint64_t offset) { return (offset + 15) & ~15ull; };
+  MeshCacheHeader header{};
+  header.magic = kMeshCacheMagic;
+  header.version = kMeshCacheVersion;
+  header.source_key = key;
+  header.vertex_size = sizeof(Vertex);
+  header.mesh_count = static_cast<uint32_t>(meshes.size());
+  std::vector<MeshCacheEntry> entries(meshes.size());
+  uint64_t offset = align(sizeof(MeshCacheHeader) +
+                          entries.size() * sizeof(MeshCacheEntry));
+  for (uint32_t mesh_i = 0; mesh_i < meshes.size(); mesh_i++) {
+    const Mesh* mesh = meshes[mesh_i];
+    MeshCacheEntry& entry = entries[mesh_i];
+    entry.vertex_offset = offset;
+    entry.vertex_count = mesh->vertices.size();
+    offset = align(offset + entry.vertex_count * sizeof(Vertex));
+    entry.index_offset = offset;
+    entry.index_count = mesh->indices.size();
+    offset = align(offset + entry.index_count * sizeof(uint32_t));
+    for (uint32_t c = 0; c < 3; c++) {
+      entry.bounds_min[c] = mesh->bounds_min[c];
+      entry.bounds_max[c] = mesh->bounds_max[c];
+    }
+  }
+  uint64_t written = 0;
+  auto write = [&file, &written](uint64_t offset, const void* data,
+                                 uint64_t size) {
+    static const char padding[16] = {};
+    file.write(padding, offset - written);
+    file.write(static_cast<const char*>(data), size);
+    written = offset + size;
+  };
+  write(0, &header, sizeof(header));
+  write(sizeof(header), entries.data(),
+        entries.size() * sizeof(MeshCacheEntry));
+  for (uint32_t mesh_i = 0; mesh_i < meshes.size(); mesh_i++) {
+    const MeshCacheEntry& entry = entries[mesh_i];
+    write(entry.vertex_offset, meshes[mesh_i]->vertices.data(),
+          entry.vertex_count * sizeof(Vertex));
+    write(entry.index_offset, meshes[mesh_i]->indices.data(),
+          entry.index_count * sizeof(uint32_t));
+  }
+  file.close();
+  CommitCacheFile(temp_file, cache_file, static_cast<bool>(file));
+}
+bool MeshCache::GetSourceKey(const std::filesystem::path& path,
+                             uint32_t variant, uint64_t& key) const {
+  std::error_code error;
+  uint64_t size = std::filesystem::file_size(path, error);
+  if (error) return false;
+  int64_t write_time =
+      std::filesystem::last_write_time(path, error).time_since_epoch().count();
+  if (error) return false;
+  std::string path_string = std::filesystem::absolute(path, error).string();
+  if (error) return false;
+  uint32_t settings[2] = {kMeshCacheVersion, variant};
+  key = HashBytes(path_string.data(), path_string.size());
+  key = HashBytes(&size, sizeof(size), key);
+  key = HashBytes(&write_time, sizeof(write_time), key);
+  key = HashBytes(settings, sizeof(settings), key);
+  return true;
+}
+std::filesystem::path MeshCache::GetCacheFile(uint64_t key) const {
+  char key_name[17];
+  snprintf(key_name, sizeof(key_name), "%016llx",
+           static_cast<unsigned long long>(key));
+  return cache_path_ / (std::string(key_name) + ".cmesh");
+}
 }  // namespace catalyst
@@ -1,10 +1,13 @@
 #pragma once
 #include <filesystem>
 #include <cstdint>
+#include <vector>
 
 #include <catalyst/scene/scene.h>
+#include <catalyst/filesystem/mappedfile.h>
 
 namespace catalyst {
+class ThreadPool;
 enum class FileType {
   kUnknown = 0,
   kImage = 1,
@@ -13,9 +16,15 @@ enum class FileType {
 class Importer {
  public:
   static FileType InferFiletype(const std::filesystem::path& filepath);
-  static void AddResources(Scene& scene, const std::filesystem::path& path);
-  static void AddModelResources(Scene& scene,
-                                const std::filesystem::path& path);
+  // Models are uploaded in the given vertex format
+  static void AddResources(Scene& scene, const std::filesystem::path& path,
+                           VertexFormat vertex_format = VertexFormat::kFloat);
+  // Imports the files, and the supported files of directories, as one batch.
+  // Models are parsed and converted on a worker pool, and the resources are
+  // added to the scene together once every file is done.
+  static void AddResources(Scene& scene,
+                           const std::vector<std::filesystem::path>& paths,
+                           VertexFormat vertex_format = VertexFormat::kFloat);
  
 private:
 };
@@ -51,4 +60,72 @@ class TextureImporter {
   TextureImporter(const TextureImporter&) = delete;
   const TextureImporter& operator=(const TextureImporter&) = delete;
 };
+enum class TextureCompression : uint32_t {
+  kBc7 = 0,  // Color, sRGB encoded
+  kBc5 = 1,  // Two channels, eg. tangent space normals
+  kBc4 = 2,  // One channel, eg. roughness or metallic masks
+};
+class CookedTextureData {
+ public:
+  TextureCompression compression;
+  uint32_t width;
+  uint32_t height;
+  // Compressed blocks of every mip, base level first
+  std::vector<std::vector<uint8_t>> mips;
+};
+// Decodes textures, generates their mips and block compresses them on the
+// CPU. Results are cached on disk keyed by a hash of the source file, so
+// unchanged textures are only read back on later loads. Cook may be called
+// from several threads at once.
+class TextureCooker {
+ public:
+  TextureCooker(const std::filesystem::path& cache_path);
+  ~TextureCooker();
+  bool Cook(const std::filesystem::path& path, TextureCompression compression,
+            CookedTextureData& cooked);
+  static uint32_t GetBlockSize(TextureCompression compression);
+
+ private:
+  std::filesystem::path cache_path_;
+  ThreadPool* thread_pool_;
+  bool ReadCache(const std::filesystem::path& cache_file, uint64_t hash,
+                 CookedTextureData& cooked);
+  void WriteCache(const std::filesystem::path& cache_file, uint64_t hash,
+                  const CookedTextureData& cooked);
+  void Encode(const std::vector<std::vector<uint8_t>>& levels,
+              CookedTextureData& cooked);
+
+  // Uncopyable
+  TextureCooker(const TextureCooker&) = delete;
+  const TextureCooker& operator=(const TextureCooker&) = delete;
+};
+struct MeshCacheHeader;
+struct MeshCacheEntry;
+// Imported meshes in a compact binary file, keyed by the source path, size
+// and modification time. Cache files are memory-mapped on later loads, so
+// the arrays are copied out at disk speed instead of parsing the source.
+class MeshCache {
+ public:
+  MeshCache(const std::filesystem::path& cache_path);
+  // Maps the cache file of a source, false when it was never cached or has
+  // changed since. The variant tells apart different imports of a source.
+  bool Open(const std::filesystem::path& path, uint32_t variant);
+  uint32_t GetMeshCount() const;
+  void ReadMesh(uint32_t mesh_i, Mesh& mesh) const;
+  void Write(const std::filesystem::path& path, uint32_t variant,
+             const std::vector<const Mesh*>& meshes);
+
+ private:
+  std::filesystem::path cache_path_;
+  MappedFile file_;
+  const MeshCacheHeader* header_;
+  const MeshCacheEntry* entries_;
+  bool GetSourceKey(const std::filesystem::path& path, uint32_t variant,
+                    uint64_t& key) const;
+  std::filesystem::path GetCacheFile(uint64_t key) const;
+
+  // Uncopyable
+  MeshCache(const MeshCache&) = delete;
+  const MeshCache& operator=(const MeshCache&) = delete;
+};
 };  // namespace catalylst
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include <catalyst/filesystem/mappedfile.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+#ifdef _WIN32
+MappedFile::MappedFile()
+    : data_(nullptr), size_(0), file_(nullptr), mapping_(nullptr) {}
+#else
+MappedFile::MappedFile() : data_(nullptr), size_(0), file_(-1) {}
+#endif
+MappedFile::~MappedFile() { Close(); }
+bool MappedFile::Open(const std::filesystem::path& path) {
+  Close();
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+                            FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    Close();
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+  file_ = open(path.string().c_str(), O_RDONLY);
+  if (file_ < 0) return false;
+  struct stat file_stat;
+  if (fstat(file_, &file_stat) != 0 || file_stat.st_size == 0) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+  if (data == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  // The whole file is read front to back
+  madvise(data, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<const uint8_t*>(data);
+#endif
+  if (data_ == nullptr) {
+    Close();
+    return false;
+  }
+  return true;
+}
+void MappedFile::Close() {
+#ifdef _WIN32
+  if (data_ != nullptr) UnmapViewOfFile(data_);
+  if (mapping_ != nullptr) CloseHandle(mapping_);
+  if (file_ != nullptr) CloseHandle(file_);
+  mapping_ = nullptr;
+  file_ = nullptr;
+#else
+  if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+  if (file_ >= 0) close(file_);
+  file_ = -1;
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+const uint8_t* MappedFile::GetData() const { return data_; }
+size_t MappedFile::GetSize() const { return size_; }
+}  // namespace catalyst
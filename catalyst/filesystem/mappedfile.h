@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace catalyst {
+// Read-only view of a whole file mapped into the address space, so reads
+// are served from the page cache without an intermediate copy
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+  bool Open(const std::filesystem::path& path);
+  void Close();
+  const uint8_t* GetData() const;
+  size_t GetSize() const;
+
+  // Uncopyable
+  MappedFile(const MappedFile&) = delete;
+  const MappedFile& operator=(const MappedFile&) = delete;
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#else
+  int file_;
+#endif
+};
+}  // namespace catalyst
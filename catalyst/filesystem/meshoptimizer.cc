@@ -0,0 +1,269 @@
+#include <catalyst/filesystem/meshoptimizer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+namespace catalyst {
+// LRU size the Forsyth scores are tuned for
+static const uint32_t kForsythCacheSize = 32;
+
+static float GetForsythVertexScore(int32_t cache_position,
+                                   uint32_t live_triangles) {
+  if (live_triangles == 0) return -1.0f;
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    // The last triangle's vertices score the same, so its neighbors do not
+    // win only by sharing the newest vertex
+    if (cache_position < 3) {
+      score = 0.75f;
+    } else {
+      score = std::pow(1.0f - (cache_position - 3) /
+                                  static_cast<float>(kForsythCacheSize - 3),
+                       1.5f);
+    }
+  }
+  // Boost vertices with few triangles left, to finish them off
+  return score + 2.0f / std::sqrt(static_cast<float>(live_triangles));
+}
+void OptimizeMesh(Mesh& mesh) {
+  if (mesh.indices.empty()) return;
+  WeldVertices(mesh.vertices, mesh.indices);
+  OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+  OptimizeOverdraw(mesh.vertices, mesh.indices);
+  OptimizeVertexFetch(mesh.vertices, mesh.indices);
+}
+void WeldVertices(std::vector<Vertex>& vertices,
+                  std::vector<uint32_t>& indices) {
+  auto hash = [](const Vertex& vertex) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+    size_t hash = 14695981039346656037ull;
+    for (size_t byte_i = 0; byte_i < sizeof(Vertex); byte_i++)
+      hash = (hash ^ bytes[byte_i]) * 1099511628211ull;
+    return hash;
+  };
+  auto equal = [](const Vertex& a, const Vertex& b) {
+    return memcmp(&a, &b, sizeof(Vertex)) == 0;
+  };
+  std::unordered_map<Vertex, uint32_t, decltype(hash), decltype(equal)>
+      unique_vertices(vertices.size(), hash, equal);
+  std::vector<Vertex> welded;
+  welded.reserve(vertices.size());
+  std::vector<uint32_t> remap(vertices.size());
+  for (size_t vertex_i = 0; vertex_i < vertices.size(); vertex_i++) {
+    auto inserted =
+        unique_vertices.emplace(vertices[vertex_i], welded.size());
+    if (inserted.second) welded.push_back(vertices[vertex_i]);
+    remap[vertex_i] = inserted.first->second;
+  }
+  for (uint32_t& index : indices) index = remap[index];
+  vertices.swap(welded);
+}
+void OptimizeVertexCache(std::vector<uint32_t>& indices,
+                         uint32_t vertex_count) {
+  uint32_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) return;
+
+  // Triangles around each vertex, the live ones are kept at the front
+  std::vector<uint32_t> live_triangles(vertex_count, 0);
+  for (uint32_t index : indices) live_triangles[index]++;
+  std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+  std::partial_sum(live_triangles.begin(), live_triangles.end(),
+                   adjacency_offsets.begin() + 1);
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> adjacency_fill(adjacency_offsets.begin(),
+                                       adjacency_offsets.end() - 1);
+  for (uint32_t index_i = 0; index_i < indices.size(); index_i++)
+    adjacency[adjacency_fill[indices[index_i]]++] = index_i / 3;
+
+  std::vector<int32_t> cache_positions(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+  for (uint32_t vertex_i = 0; vertex_i < vertex_count; vertex_i++)
+    vertex_scores[vertex_i] =
+        GetForsythVertexScore(-1, live_triangles[vertex_i]);
+  std::vector<float> triangle_scores(triangle_count, 0.0f);
+  for (uint32_t index_i = 0; index_i < indices.size(); index_i++)
+    triangle_scores[index_i / 3] += vertex_scores[indices[index_i]];
+  uint32_t best_triangle =
+      std::max_element(triangle_scores.begin(), triangle_scores.end()) -
+      triangle_scores.begin();
+
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> cache, next_cache;
+  cache.reserve(kForsythCacheSize + 3);
+  next_cache.reserve(kForsythCacheSize + 3);
+  std::vector<uint32_t> optimized;
+  optimized.reserve(indices.size());
+  uint32_t scan_cursor = 0;
+  for (uint32_t emit_i = 0; emit_i < triangle_count; emit_i++) {
+    if (best_triangle == UINT32_MAX) {
+      // Dead end, nothing in the cache has triangles left. Continuing with
+      // the first remaining triangle keeps this linear.
+      while (emitted[scan_cursor]) scan_cursor++;
+      best_triangle = scan_cursor;
+    }
+    uint32_t triangle_i = best_triangle;
+    const uint32_t* triangle = &indices[triangle_i * 3];
+    emitted[triangle_i] = true;
+    next_cache.clear();
+    for (uint32_t corner_i = 0; corner_i < 3; corner_i++) {
+      uint32_t vertex_i = triangle[corner_i];
+      optimized.push_back(vertex_i);
+      if (std::find(next_cache.begin(), next_cache.end(), vertex_i) ==
+          next_cache.end())
+        next_cache.push_back(vertex_i);
+      uint32_t* live_begin = &adjacency[adjacency_offsets[vertex_i]];
+      uint32_t* live_end = live_begin + live_triangles[vertex_i];
+      std::iter_swap(std::find(live_begin, live_end, triangle_i),
+                     live_end - 1);
+      live_triangles[vertex_i]--;
+    }
+    for (uint32_t vertex_i : cache) {
+      if (vertex_i != triangle[0] && vertex_i != triangle[1] &&
+          vertex_i != triangle[2])
+        next_cache.push_back(vertex_i);
+    }
+
+    // Rescore every vertex that moved, was evicted or lost a triangle
+    for (uint32_t cache_i = 0; cache_i < next_cache.size(); cache_i++) {
+      uint32_t vertex_i = next_cache[cache_i];
+      cache_positions[vertex_i] =
+          cache_i < kForsythCacheSize ? static_cast<int32_t>(cache_i) : -1;
+      float score = GetForsythVertexScore(cache_positions[vertex_i],
+                                          live_triangles[vertex_i]);
+      float delta = score - vertex_scores[vertex_i];
+      vertex_scores[vertex_i] = score;
+      uint32_t live_begin = adjacency_offsets[vertex_i];
+      for (uint32_t live_i = 0; live_i < live_triangles[vertex_i]; live_i++)
+        triangle_scores[adjacency[live_begin + live_i]] += delta;
+    }
+    next_cache.resize(std::min<size_t>(next_cache.size(), kForsythCacheSize));
+    cache.swap(next_cache);
+
+    // Only triangles touching the cache are candidates for the next one
+    best_triangle = UINT32_MAX;
+    float best_score = -FLT_MAX;
+    for (uint32_t vertex_i : cache) {
+      uint32_t live_begin = adjacency_offsets[vertex_i];
+      for (uint32_t live_i = 0; live_i < live_triangles[vertex_i]; live_i++) {
+        uint32_t candidate = adjacency[live_begin + live_i];
+        if (triangle_scores[candidate] > best_score) {
+          best_score = triangle_scores[candidate];
+          best_triangle = candidate;
+        }
+      }
+    }
+  }
+  indices.swap(optimized);
+}
+void OptimizeOverdraw(const std::vector<Vertex>& vertices,
+                      std::vector<uint32_t>& indices) {
+  uint32_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) return;
+
+  // A cluster starts wherever the cache order jumps to unrelated triangles,
+  // seen as all three vertices missing the cache. Reordering whole clusters
+  // leaves the cache behavior as it was.
+  std::vector<uint32_t> cluster_starts;
+  std::vector<uint32_t> cache_timestamps(vertices.size(), 0);
+  uint32_t timestamp = kAcmrCacheSize + 1;
+  for (uint32_t triangle_i = 0; triangle_i < triangle_count; triangle_i++) {
+    uint32_t misses = 0;
+    for (uint32_t corner_i = 0; corner_i < 3; corner_i++) {
+      uint32_t vertex_i = indices[triangle_i * 3 + corner_i];
+      if (timestamp - cache_timestamps[vertex_i] > kAcmrCacheSize) {
+        cache_timestamps[vertex_i] = timestamp++;
+        misses++;
+      }
+    }
+    if (triangle_i == 0 || misses == 3) cluster_starts.push_back(triangle_i);
+  }
+  cluster_starts.push_back(triangle_count);
+  uint32_t cluster_count = cluster_starts.size() - 1;
+
+  // Area weighted centroids and normals of the mesh and of every cluster
+  std::vector<glm::vec3> cluster_centroids(cluster_count, glm::vec3(0.0f));
+  std::vector<glm::vec3> cluster_normals(cluster_count, glm::vec3(0.0f));
+  std::vector<float> cluster_areas(cluster_count, 0.0f);
+  glm::vec3 mesh_centroid(0.0f);
+  float mesh_area = 0.0f;
+  for (uint32_t cluster_i = 0; cluster_i < cluster_count; cluster_i++) {
+    for (uint32_t triangle_i = cluster_starts[cluster_i];
+         triangle_i < cluster_starts[cluster_i + 1]; triangle_i++) {
+      const glm::vec3& a = vertices[indices[triangle_i * 3 + 0]].position;
+      const glm::vec3& b = vertices[indices[triangle_i * 3 + 1]].position;
+      const glm::vec3& c = vertices[indices[triangle_i * 3 + 2]].position;
+      glm::vec3 normal = glm::cross(b - a, c - a);
+      float area = glm::length(normal);
+      cluster_centroids[cluster_i] += (a + b + c) * (area / 3.0f);
+      cluster_normals[cluster_i] += normal;
+      cluster_areas[cluster_i] += area;
+    }
+    mesh_centroid += cluster_centroids[cluster_i];
+    mesh_area += cluster_areas[cluster_i];
+  }
+  if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+  // Clusters far out along their own normal face away from the rest of the
+  // mesh, so they are likely occluders from most directions
+  std::vector<float> cluster_keys(cluster_count, 0.0f);
+  for (uint32_t cluster_i = 0; cluster_i < cluster_count; cluster_i++) {
+    float normal_length = glm::length(cluster_normals[cluster_i]);
+    if (cluster_areas[cluster_i] <= 0.0f || normal_length <= 0.0f) continue;
+    glm::vec3 centroid =
+        cluster_centroids[cluster_i] / cluster_areas[cluster_i];
+    cluster_keys[cluster_i] = glm::dot(
+        centroid - mesh_centroid, cluster_normals[cluster_i] / normal_length);
+  }
+  std::vector<uint32_t> cluster_order(cluster_count);
+  std::iota(cluster_order.begin(), cluster_order.end(), 0);
+  std::stable_sort(cluster_order.begin(), cluster_order.end(),
+                   [&cluster_keys](uint32_t a, uint32_t b) {
+                     return cluster_keys[a] > cluster_keys[b];
+                   });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(indices.size());
+  for (uint32_t cluster_i : cluster_order) {
+    sorted.insert(sorted.end(),
+                  indices.begin() + cluster_starts[cluster_i] * 3,
+                  indices.begin() + cluster_starts[cluster_i + 1] * 3);
+  }
+  indices.swap(sorted);
+}
+void OptimizeVertexFetch(std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices) {
+  std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+  std::vector<Vertex> ordered;
+  ordered.reserve(vertices.size());
+  for (uint32_t& index : indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = ordered.size();
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(ordered);
+}
+float ComputeAcmr(const std::vector<uint32_t>& indices,
+                  uint32_t vertex_count) {
+  uint32_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) return 0.0f;
+  // Timestamps of when each vertex entered the FIFO
+  std::vector<uint32_t> cache_timestamps(vertex_count, 0);
+  uint32_t timestamp = kAcmrCacheSize + 1;
+  uint32_t misses = 0;
+  for (uint32_t index : indices) {
+    if (timestamp - cache_timestamps[index] > kAcmrCacheSize) {
+      cache_timestamps[index] = timestamp++;
+      misses++;
+    }
+  }
+  return static_cast<float>(misses) / triangle_count;
+}
+}  // namespace catalyst
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <catalyst/scene/resource.h>
+
+namespace catalyst {
+// Import-time reordering of indexed triangle lists, so fewer vertices are
+// shaded and fetched per triangle. The rendered result is unchanged.
+
+// FIFO size ACMR is reported for, close to what current GPUs reuse
+const uint32_t kAcmrCacheSize = 16;
+
+// Runs every pass below in order
+void OptimizeMesh(Mesh& mesh);
+// Merges bitwise identical vertices and rewrites the indices to match
+void WeldVertices(std::vector<Vertex>& vertices,
+                  std::vector<uint32_t>& indices);
+// Reorders triangles for post-transform cache hits, after Forsyth's
+// linear-speed vertex cache optimization
+void OptimizeVertexCache(std::vector<uint32_t>& indices,
+                         uint32_t vertex_count);
+// Splits a cache optimized list where the cache order restarts and draws
+// outward facing clusters first, which tend to occlude the rest
+void OptimizeOverdraw(const std::vector<Vertex>& vertices,
+                      std::vector<uint32_t>& indices);
+// Reorders vertices by first use and drops unreferenced ones
+void OptimizeVertexFetch(std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices);
+// Average cache miss ratio, the vertices shaded per triangle by a FIFO
+// cache of kAcmrCacheSize entries
+float ComputeAcmr(const std::vector<uint32_t>& indices, uint32_t vertex_count);
+}  // namespace catalyst
@@ -9,19 +9,29 @@
 #include <catalyst/dev/dev.h>
 
 namespace catalyst {
-Application::Renderer::Renderer(Application* app) {
+Application::Renderer::Renderer(Application* app, uint32_t frame_count) {
+  ASSERT(frame_count > 0, "Renderer requires at least one frame in flight!");
   app_ = app;
   scene_ = nullptr;
+  frame_count_ = frame_count;
+  current_frame_ = 0;
+  recording_thread_pool_ = nullptr;
+  headless_ = false;
+  swapchain_ = VK_NULL_HANDLE;
+  frame_timings_.cpu_wait_ms = 0.0f;
+  frame_timings_.gpu_idle_ms = 0.0f;
 }
 void Application::Renderer::StartUp() {
+  window_ = app_->main_window;
+  headless_ = window_->IsHeadless();
   CreateInstance();
 
   // Window interaction
-  window_ = app_->main_window;
   window_->SetVkInstance(instance_);
   surface_ = window_->GetVkSurface();
 
   CreateDevice();
+  CreateMemoryPools();
   CheckComputeDetails();
 
   // Resizeable resources
@@ -32,7 +42,11 @@ void Application::Renderer::StartUp() {
 
   CreateCommandPool();
   CreateCommandBuffers();
+  CreateRecordingResources();
+  CreateIlluminanceCommandBuffers();
+  CreateUploadResources();
   CreateSyncObjects();
+  CreateTimestampQueryPool();
 
   CreateSsaoResources();
   CreateSsrResources();
@@ -46,18 +60,18 @@ void Application::Renderer::StartUp() {
 
   CreateRenderPasses();
   CreatePipelines();
+  CreateMipmapResources();
+  CreateDecodeResources();
 
   // Fixed-Size Resources
   CreateVertexBuffer();
   CreateIndexBuffer();
   CreateDebugDrawResources();
-  CreateDirectionalLightUniformBuffer();
+  CreateUniformRings();
   CreateDirectionalShadowmapResources();
-  CreateMaterialUniformBuffer();
   CreateTextureResources();
   CreateCubemapResources();
   CreateSkyboxResources();
-  CreateRendererSettingsResources();
   if (debug_enabled_) {
     CreateBillboardResources();
   }
@@ -66,8 +80,14 @@ void Application::Renderer::StartUp() {
   WriteResizeableDescriptorSets();
 
   CreateFramebuffers();
+  // Frames are submitted to the same queue, so nothing waits on the setup
+  // commands here
+  SubmitSetupCommands();
 }
 void Application::Renderer::Update() { DrawFrame(); }
+Application::FrameTimings Application::Renderer::GetFrameTimings() const {
+  return frame_timings_;
+}
 void Application::Renderer::EarlyShutDown() {
   vkDeviceWaitIdle(device_);
   UnloadScene();
@@ -78,51 +98,42 @@ void Application::Renderer::LateShutDown() {
   // Destroy Sync Objects
   for (VkSemaphore sem : image_acquired_semaphores_)
     vkDestroySemaphore(device_, sem, nullptr);
-  for (VkSemaphore sem : image_presented_semaphores_)
-    vkDestroySemaphore(device_, sem, nullptr);
-  for (VkFence fence : in_flight_fences_)
-    vkDestroyFence(device_, fence, nullptr);
+  vkDestroySemaphore(device_, frame_timeline_semaphore_, nullptr);
+  vkDestroySemaphore(device_, compute_timeline_semaphore_, nullptr);
+  if (timestamps_supported_)
+    vkDestroyQueryPool(device_, timestamp_query_pool_, nullptr);
   
   // Destroy Fixed size resources
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     vkDestroyBuffer(device_, debugdraw_buffer_[frame_i], nullptr);
-    vkFreeMemory(device_, debugdraw_memory_[frame_i], nullptr);
+    FreeMemory(debugdraw_memory_[frame_i]);
   }
   debugdraw_buffer_.clear();
   debugdraw_memory_.clear();
 
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    for (uint32_t shadowmap_i = 0; shadowmap_i < Scene::kMaxDirectionalLights;
-         shadowmap_i++) {
-      vkDestroyFramebuffer(
-          device_, shadowmap_framebuffers_[frame_i][shadowmap_i], nullptr);
-      vkDestroyImageView(device_, shadowmap_image_views_[frame_i][shadowmap_i],
-                         nullptr);
-      vkFreeMemory(device_, shadowmap_memory_[frame_i][shadowmap_i], nullptr);
-      vkDestroyImage(device_, shadowmap_images_[frame_i][shadowmap_i], nullptr);
-    }
-    shadowmap_framebuffers_[frame_i].clear();
-    shadowmap_image_views_[frame_i].clear();
-    shadowmap_memory_[frame_i].clear();
-    shadowmap_images_[frame_i].clear();
-  }
-  shadowmap_framebuffers_.clear();
-  shadowmap_image_views_.clear();
-  shadowmap_memory_.clear();
-  shadowmap_images_.clear();
+  for (Shadowmap& shadowmap : shadowmaps_) DestroyShadowmap(shadowmap);
+  for (auto& released : released_shadowmaps_) DestroyShadowmap(released.second);
+  shadowmaps_.clear();
+  released_shadowmaps_.clear();
+  vkDestroyImageView(device_, default_shadowmap_image_view_, nullptr);
+  FreeMemory(default_shadowmap_memory_);
+  vkDestroyImage(device_, default_shadowmap_image_, nullptr);
 
   for (uint32_t texture_i = 0; texture_i < Scene::kMaxTextures; texture_i++) {
     vkDestroyImageView(device_, texture_image_views_[texture_i], nullptr);
-    vkFreeMemory(device_, texture_memory_[texture_i], nullptr);
+    FreeMemory(texture_memory_[texture_i]);
     vkDestroyImage(device_, texture_images_[texture_i], nullptr);
   }
   texture_image_views_.clear();
   texture_images_.clear();
   texture_memory_.clear();
+  vkDestroyImageView(device_, default_texture_image_view_, nullptr);
+  FreeMemory(default_texture_memory_);
+  vkDestroyImage(device_, default_texture_image_, nullptr);
 
   for (uint32_t cubemap_i = 0; cubemap_i < Scene::kMaxCubemaps; cubemap_i++) {
     vkDestroyImageView(device_, cubemap_image_views_[cubemap_i], nullptr);
-    vkFreeMemory(device_, cubemap_memory_[cubemap_i], nullptr);
+    FreeMemory(cubemap_memory_[cubemap_i]);
     vkDestroyImage(device_, cubemap_images_[cubemap_i], nullptr);
   }
   cubemap_image_views_.clear();
@@ -132,7 +143,7 @@ void Application::Renderer::LateShutDown() {
   if (debug_enabled_) {
     for (uint32_t bill_i = 0; bill_i < Scene::kMaxBillboards; bill_i++) {
       vkDestroyImageView(device_, billboard_image_views_[bill_i], nullptr);
-      vkFreeMemory(device_, billboard_memory_[bill_i], nullptr);
+      FreeMemory(billboard_memory_[bill_i]);
       vkDestroyImage(device_, billboard_images_[bill_i], nullptr);
     }
     billboard_image_views_.clear();
@@ -140,37 +151,15 @@ void Application::Renderer::LateShutDown() {
     billboard_images_.clear();
   }
 
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    vkFreeMemory(device_, renderer_uniform_memory_[frame_i], nullptr);
-    vkDestroyBuffer(device_, renderer_uniforms_[frame_i], nullptr);
+  DestroyUniformRings();
+
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    DestroyGeometryBuffer(vertex_geometries_[format_i]);
+    DestroyGeometryBuffer(position_geometries_[format_i]);
   }
-  renderer_uniform_memory_.clear();
-  renderer_uniforms_.clear();
-
-  vkDestroyBuffer(device_, vertex_buffer_, nullptr);
-  vkFreeMemory(device_, vertex_memory_, nullptr);
-  vkDestroyBuffer(device_, index_buffer_, nullptr);
-  vkFreeMemory(device_, index_memory_, nullptr);
-  for (VkBuffer buffer_ : directional_light_uniform_buffers_)
-    vkDestroyBuffer(device_, buffer_, nullptr);
-  for (VkDeviceMemory memory_ : directional_light_uniform_memory_)
-    vkFreeMemory(device_, memory_, nullptr);
-  directional_light_uniform_buffers_.clear();
-  directional_light_uniform_memory_.clear();
-  for (VkBuffer buffer_ : material_uniform_buffers_)
-    vkDestroyBuffer(device_, buffer_, nullptr);
-  for (VkDeviceMemory memory_ : material_uniform_memory_)
-    vkFreeMemory(device_, memory_, nullptr);
-  material_uniform_buffers_.clear();
-  material_uniform_memory_.clear();
-  for (VkBuffer buffer_ : skybox_uniform_buffers_)
-    vkDestroyBuffer(device_, buffer_, nullptr);
-  for (VkDeviceMemory memory_ : skybox_uniform_memory_)
-    vkFreeMemory(device_, memory_, nullptr);
-  skybox_uniform_buffers_.clear();
-  skybox_uniform_memory_.clear();
+  DestroyGeometryBuffer(index_geometry_);
   vkDestroyBuffer(device_, skybox_vertex_buffer_, nullptr);
-  vkFreeMemory(device_, skybox_vertex_memory_, nullptr);
+  FreeMemory(skybox_vertex_memory_);
 
   // Destroy descriptors - no need to destroy descriptor sets, they are cleaned up with the pool
   vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
@@ -187,7 +176,8 @@ void Application::Renderer::LateShutDown() {
 
   // Destroy fixed size pipelines
   vkDestroyPipelineLayout(device_, shadowmap_pipeline_layout_, nullptr);
-  vkDestroyPipeline(device_, shadowmap_pipeline_, nullptr);
+  for (VkPipeline pipeline : shadowmap_pipelines_)
+    vkDestroyPipeline(device_, pipeline, nullptr);
   vkDestroyPipelineLayout(device_, illuminance_pipeline_layout_, nullptr);
   vkDestroyPipeline(device_, log_illuminance_pipeline_, nullptr);
   vkDestroyPipeline(device_, reduce_illuminance_pipeline_, nullptr);
@@ -195,13 +185,19 @@ void Application::Renderer::LateShutDown() {
   // Destroy Render passes
   vkDestroyRenderPass(device_, shadowmap_render_pass_, nullptr);
 
+  DestroyRecordingResources();
+  DestroyIlluminanceCommandBuffers();
+  DestroyUploadResources();
+  DestroyMipmapResources();
+  DestroyDecodeResources();
   vkFreeCommandBuffers(device_, command_pool_,
                        static_cast<uint32_t>(command_buffers_.size()),
                        command_buffers_.data());
   vkDestroyCommandPool(device_, command_pool_, nullptr);
   vkDestroySampler(device_, shadowmap_sampler_, nullptr);
   vkDestroySampler(device_, texture_sampler_, nullptr);
-  vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+  DestroyPipelineCache();
+  DestroyMemoryPools();
   vkDestroyDevice(device_, nullptr);
   vkDestroyInstance(instance_, nullptr);
 }
@@ -219,10 +215,12 @@ void Application::Renderer::CreateInstance() {
   instance_ci.pApplicationInfo = &app_info;
 
   std::vector<const char*> instance_extensions;
-  uint32_t required_extension_count = 0;
-  const char **required_extensions = glfwGetRequiredInstanceExtensions(&required_extension_count);
-  for (uint32_t ext_i = 0; ext_i < required_extension_count; ext_i++)
-    instance_extensions.push_back(required_extensions[ext_i]);
+  if (!headless_) {
+    uint32_t required_extension_count = 0;
+    const char **required_extensions = glfwGetRequiredInstanceExtensions(&required_extension_count);
+    for (uint32_t ext_i = 0; ext_i < required_extension_count; ext_i++)
+      instance_extensions.push_back(required_extensions[ext_i]);
+  }
   std::vector<const char*> instance_layers;
   if (debug_enabled_) {
     instance_extensions.push_back("VK_EXT_debug_utils");
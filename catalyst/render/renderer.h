@@ -1,22 +1,34 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <optional>
 #include <string>
+#include <functional>
+#include <map>
 
 #include <vulkan/vulkan.h>
 
 #include <catalyst/application/application.h>
+#include <catalyst/filesystem/importer.h>
+#include <catalyst/thread/threadpool.h>
 
 namespace catalyst {
+class Mesh;
 class Application :: Renderer {
  public:
-  Renderer(Application* app);
+  static const uint32_t kDefaultFrameCount = 2;
+
+  Renderer(Application* app, uint32_t frame_count = kDefaultFrameCount);
   void StartUp();
   void LoadScene(const Scene& scene);
   void UnloadScene();
   void Update();
   void EarlyShutDown();
   void LateShutDown();
+  FrameTimings GetFrameTimings() const;
+  MemoryStatistics GetMemoryStatistics() const;
 
  private:
   class QueueFamilyIndexCollection {
@@ -48,6 +60,10 @@ class Application :: Renderer {
     int input_dim;
     bool input0;
   };
+  struct MipmapPushConstantData {
+    glm::ivec2 src_extent;
+    uint32_t srgb;
+  };
   struct DirectionalLight {
     alignas(16) glm::mat4 world_to_light_transform;
     alignas(16) glm::mat4 light_to_clip_transform;
@@ -101,6 +117,15 @@ class Application :: Renderer {
     int ssao_enabled;
     int ssr_enabled;
   };
+  // Dynamic offsets of this frame's uniforms in its uniform ring
+  struct UniformOffsets {
+    uint32_t directional_light;
+    uint32_t material;
+    uint32_t skybox;
+    uint32_t renderer_settings;
+    uint32_t tonemap;
+    uint32_t ssr;
+  };
   struct SceneDrawDetails {
     PushConstantData push_constants;
     DirectionalLightUniform directional_light_uniform;
@@ -109,16 +134,189 @@ class Application :: Renderer {
     TonemappingUniform tonemap_uniform;
     SsrUniform ssr_uniform;
     RendererSettingsUniform renderer_uniform;
+    UniformOffsets uniform_offsets;
     uint32_t debugdraw_offset_;
   };
   struct SceneResourceDetails {
     uint32_t mesh_count;
     uint32_t texture_count;
-    uint32_t vertex_count;
-    uint32_t index_count;
     uint32_t cubemap_count;
-    std::vector<uint32_t> vertex_offsets_;
-    std::vector<uint32_t> index_offsets_;
+    // Meshes whose geometry is uploaded, by mesh id
+    std::vector<const Mesh*> meshes_;
+  };
+  struct PassAccess {
+    // Exactly one of image and buffer is set
+    VkImage image;
+    VkBuffer buffer;
+    VkImageAspectFlags aspect;
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    // Layout the image is used in for the whole pass, render passes do not
+    // transition their attachments
+    VkImageLayout layout;
+    // Previous contents are not needed, so no data flows from earlier writes
+    bool discard;
+  };
+  struct ScenePass {
+    // Render pass the pass records into, VK_NULL_HANDLE for passes recorded
+    // outside of a render pass (eg. compute)
+    VkRenderPass render_pass;
+    VkFramebuffer framebuffer;
+    std::function<void(VkCommandBuffer&, VkSubpassContents)> begin;
+    std::function<void(VkCommandBuffer&)> record;
+    // Declared resource usage, CompileScenePasses derives ordering, culling
+    // and barriers from it
+    std::vector<PassAccess> reads;
+    std::vector<PassAccess> writes;
+    // Passes with effects outside of their declared writes are never culled
+    bool side_effects = false;
+    // Barriers recorded before the pass begins, filled by CompileScenePasses
+    VkPipelineStageFlags src_stage = 0;
+    VkPipelineStageFlags dst_stage = 0;
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+  };
+  // Synchronization state of an image between scene passes, images sharing
+  // memory share a single state
+  struct PassResourceState {
+    // Image of the aliasing set that was accessed last
+    VkImage image = VK_NULL_HANDLE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool known = false;
+    VkPipelineStageFlags write_stages = 0;
+    VkAccessFlags write_access = 0;
+    VkPipelineStageFlags read_stages = 0;
+    // Stages and accesses the last write has been made visible to
+    VkPipelineStageFlags visible_stages = 0;
+    VkAccessFlags visible_access = 0;
+    int32_t barrier_batch = -1;
+    uint32_t barrier_i = 0;
+  };
+  // Range of a memory block backing a single resource (or a set of aliased
+  // images)
+  struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Host address of the range, nullptr unless the memory is host visible
+    void* mapped = nullptr;
+    uint32_t pool_i = 0;
+    MemoryCategory category = MemoryCategory::kStaging;
+  };
+  struct MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* mapped;
+    // Free ranges by offset, adjacent ranges are always merged
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+    uint32_t allocation_count;
+    // Blocks holding a single resource larger than half the block size
+    bool dedicated;
+  };
+  struct GeometryRange {
+    uint32_t offset = 0;
+    uint32_t count = 0;
+  };
+  // Vertex or index buffer the meshes sub-allocate from, in elements. It is
+  // grown and compacted by copying into a new buffer on the transfer queue.
+  struct GeometryBuffer {
+    VkBuffer buffer;
+    MemoryAllocation memory;
+    VkDeviceSize element_size;
+    VkBufferUsageFlags usage;
+    uint32_t capacity;
+    uint32_t live_count;
+    // Range of each mesh by mesh id, empty for meshes without geometry
+    std::vector<GeometryRange> ranges;
+    // Free ranges by offset, adjacent ranges are always merged
+    std::map<uint32_t, uint32_t> free_ranges;
+    // Ranges frames in flight may still draw, with the frame timeline value
+    // after which they are free
+    std::vector<std::pair<uint64_t, GeometryRange>> released_ranges;
+  };
+  // Vertex input of the mesh pipelines for one vertex format, with the
+  // specialization telling pbr.vert how to decode it
+  struct VertexInputState {
+    VkVertexInputBindingDescription binding;
+    std::array<VkVertexInputAttributeDescription, 5> attributes;
+    VkPipelineVertexInputStateCreateInfo ci;
+    VkBool32 packed;
+    VkSpecializationMapEntry specialization_entry;
+    VkSpecializationInfo specialization;
+  };
+  struct Shadowmap {
+    // Shadowmaps are redrawn every frame, so the images of all frames in
+    // flight alias one allocation
+    MemoryAllocation memory;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> image_views;
+    std::vector<VkFramebuffer> framebuffers;
+  };
+  struct RecordingContext {
+    VkCommandPool command_pool;
+    std::vector<VkCommandBuffer> command_buffers;
+    uint32_t used_command_buffers;
+  };
+  struct UploadBatch {
+    VkCommandBuffer command_buffer;
+    // Value signaled on the upload timeline once the transfer queue finishes
+    uint64_t upload_value;
+    // Value of the frame that consumed the batch, 0 while still pending
+    uint64_t frame_value;
+    // Work that needs a graphics queue, recorded at the start of a frame
+    std::vector<std::function<void(VkCommandBuffer&)>> graphics_commands;
+    // Staging resources released once the consuming frame has completed
+    std::vector<VkBuffer> buffers;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> image_views;
+    std::vector<MemoryAllocation> memory;
+    // Allocated from the mipmap descriptor pool
+    std::vector<VkDescriptorSet> descriptor_sets;
+  };
+  // An image whose mip chain is generated from its base level, with one
+  // descriptor set per level when it is downsampled by the compute shader
+  struct MipmapChain {
+    VkImage image;
+    VkFormat format;
+    VkExtent3D extent;
+    uint32_t mip_levels;
+    uint32_t array_layers;
+    std::vector<VkDescriptorSet> descriptor_sets;
+  };
+  // Texture or cubemap face decoded on a worker thread, waiting for the
+  // render thread to upload it
+  struct DecodedImage {
+    // Scene load that requested it, results of replaced scenes are dropped
+    uint64_t generation;
+    // Texture index, or cubemap index for cubemap faces
+    uint32_t slot;
+    bool cubemap;
+    uint32_t face;
+    std::string path;
+    TextureCompression compression;
+    // Cooked block compressed mips instead of RGBA8 pixels
+    bool compressed;
+    bool success;
+    CookedTextureData cooked;
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+  };
+  // Graphics queue work recorded while creating resources, submitted as a
+  // single batch instead of one submission per command
+  struct SetupContext {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    bool recording;
+    // Submitted, but not yet waited on
+    bool pending;
+    // Staging arena, rewound once the pending submission has completed
+    VkBuffer staging_buffer;
+    MemoryAllocation staging_memory;
+    VkDeviceSize staging_head;
+    // Staging buffers too large for the arena, freed with the submission
+    std::vector<VkBuffer> buffers;
+    std::vector<MemoryAllocation> memory;
   };
 
 #ifndef NDEBUG
@@ -134,29 +332,45 @@ class Application :: Renderer {
   VkPhysicalDevice physical_device_;
   VkDevice device_;
   VkPhysicalDeviceMemoryProperties mem_props_;
+  // Blocks resources are sub-allocated from. Every memory type has a pool for
+  // buffers followed by one for images, so linear and optimal resources never
+  // share a block and bufferImageGranularity can be ignored.
+  static const VkDeviceSize kMemoryBlockSize = 64 * 1024 * 1024;
+  std::vector<std::vector<MemoryBlock>> memory_pools_;
+  std::vector<VkDeviceSize> memory_category_bytes_;
+  std::vector<VkDeviceSize> memory_category_peak_bytes_;
+  bool memory_budget_supported_;
+  // Heap usage is sampled every frame and whenever a block is allocated
+  VkDeviceSize memory_usage_peak_bytes_;
 
   Window *window_;
+  // Headless windows have no surface, frames are rendered into a ring of
+  // offscreen images standing in for the swapchain
+  bool headless_;
   VkSurfaceKHR surface_;
   VkSwapchainKHR swapchain_;
+  std::vector<MemoryAllocation> offscreen_memory_;
+  VkImageLayout output_image_layout_;
   VkExtent2D swapchain_extent_;
   VkExtent2D half_swapchain_extent_;
   VkFormat swapchain_image_format_;
   uint32_t frame_count_;
+  uint32_t current_frame_;
   std::vector<VkImage> swapchain_images_;
   std::vector<VkImageView> swapchain_image_views_;
   VkFormat depth_format_;
-  std::vector<VkDeviceMemory> depth_memory_;
+  std::vector<MemoryAllocation> depth_memory_;
   std::vector<VkImage> depth_images_;
   std::vector<VkImageView> depth_image_views_;
   VkFormat ssao_format_;
-  std::vector<VkDeviceMemory> ssao_memory_;
+  std::vector<MemoryAllocation> ssao_memory_;
   std::vector<VkImage> ssao_images_;
   std::vector<VkImageView> ssao_image_views_;
   VkFormat hdr_format_;
-  std::vector<VkDeviceMemory> hdr_memory_;
+  std::vector<MemoryAllocation> hdr_memory_;
   std::vector<VkImage> hdr_images_;
   std::vector<VkImageView> hdr_image_views_;
-  VkDeviceMemory ssn_memory_;
+  MemoryAllocation ssn_memory_;
   VkFormat ssn_format_;
   VkImage ssn_image_;
   VkImageView ssn_image_view_;
@@ -170,12 +384,13 @@ class Application :: Renderer {
   VkPipelineLayout depthmap_pipeline_layout_;
   VkPipelineLayout ssao_pipeline_layout_;
   VkPipelineLayout hdr_pipeline_layout_;
-  VkPipeline graphics_pipeline_;
+  // Mesh pipelines, one per vertex format
+  std::array<VkPipeline, kVertexFormatCount> graphics_pipelines_;
   VkPipeline debugdraw_pipeline_;
   VkPipeline debugdraw_lines_pipeline_;
-  VkPipeline shadowmap_pipeline_;
+  std::array<VkPipeline, kVertexFormatCount> shadowmap_pipelines_;
   VkPipeline skybox_pipeline_;
-  VkPipeline depthmap_pipeline_;
+  std::array<VkPipeline, kVertexFormatCount> depthmap_pipelines_;
   VkPipeline ssao_pipeline_;
   VkPipeline hdr_pipeline_;
   VkRenderPass render_pass_;
@@ -185,10 +400,9 @@ class Application :: Renderer {
   VkRenderPass ssao_render_pass_;
   VkRenderPass hdr_render_pass_;
   std::vector<VkFramebuffer> framebuffers_;
-  std::vector<std::vector<VkFramebuffer>> shadowmap_framebuffers_;
   std::vector<VkFramebuffer> depthmap_framebuffers_;
   std::vector<VkFramebuffer> ssao_framebuffers_;
-  std::vector<VkFramebuffer> hdr_framebuffers_;
+  std::vector<std::vector<VkFramebuffer>> hdr_framebuffers_;
 
   VkDescriptorSetLayout descriptor_set_layout_;
   VkDescriptorSetLayout ssao_descriptor_set_layout_;
@@ -200,44 +414,82 @@ class Application :: Renderer {
 
   VkCommandPool command_pool_;
   std::vector<VkCommandBuffer> command_buffers_;
+  ThreadPool* recording_thread_pool_;
+  std::vector<std::vector<RecordingContext>> recording_contexts_;
   std::vector<VkSemaphore> image_acquired_semaphores_;
+  // Indexed by swapchain image, created with the swapchain
   std::vector<VkSemaphore> image_presented_semaphores_;
-  std::vector<VkFence> in_flight_fences_;
+  VkSemaphore frame_timeline_semaphore_;
+  uint64_t frame_timeline_value_;
+  std::vector<uint64_t> frame_timeline_values_;
+  VkCommandPool upload_command_pool_;
+  VkSemaphore upload_timeline_semaphore_;
+  uint64_t upload_timeline_value_;
+  uint64_t upload_wait_value_;
+  std::vector<UploadBatch> upload_batches_;
+  static const VkDeviceSize kSetupStagingSize = 16 * 1024 * 1024;
+  SetupContext setup_context_;
+
+  bool timestamps_supported_;
+  float timestamp_period_;
+  VkQueryPool timestamp_query_pool_;
+  uint64_t last_gpu_frame_end_;
+  FrameTimings frame_timings_;
 
   const Scene* scene_;
   SceneResourceDetails scene_resource_details_;
-  VkDeviceMemory vertex_memory_;
-  VkBuffer vertex_buffer_;
-  VkDeviceMemory index_memory_;
-  VkBuffer index_buffer_;
-  std::vector<VkDeviceMemory> directional_light_uniform_memory_;
-  std::vector<VkBuffer> directional_light_uniform_buffers_;
-  std::vector<std::vector<VkDeviceMemory>> shadowmap_memory_;
-  std::vector<std::vector<VkImage>> shadowmap_images_;
-  std::vector<std::vector<VkImageView>> shadowmap_image_views_;
+  static const uint32_t kMinGeometryCapacity = 64 * 1024;
+  // Vertices of each vertex format are allocated from their own buffer
+  std::array<GeometryBuffer, kVertexFormatCount> vertex_geometries_;
+  // The same vertices with only their positions, for the depth only passes
+  std::array<GeometryBuffer, kVertexFormatCount> position_geometries_;
+  GeometryBuffer index_geometry_;
+  // One shadowmap per directional light drawn in the last frame
+  std::vector<Shadowmap> shadowmaps_;
+  // Shadowmaps frames in flight may still sample, with the frame timeline
+  // value after which they are destroyed
+  std::vector<std::pair<uint64_t, Shadowmap>> released_shadowmaps_;
+  // Sampled through shadowmap slots without a light
+  MemoryAllocation default_shadowmap_memory_;
+  VkImage default_shadowmap_image_;
+  VkImageView default_shadowmap_image_view_;
+  std::vector<bool> shadowmap_descriptors_stale_;
   std::vector<VkBuffer> debugdraw_buffer_;
-  std::vector<VkDeviceMemory> debugdraw_memory_;
-  std::vector<VkBuffer> material_uniform_buffers_;
-  std::vector<VkDeviceMemory> material_uniform_memory_;
-  std::vector<VkDeviceMemory> texture_memory_;
+  std::vector<MemoryAllocation> debugdraw_memory_;
+  std::vector<MemoryAllocation> texture_memory_;
   std::vector<VkImage> texture_images_;
   std::vector<VkImageView> texture_image_views_;
-  std::vector<VkDeviceMemory> cubemap_memory_;
+  // Sampled through texture slots nothing has been loaded into
+  MemoryAllocation default_texture_memory_;
+  VkImage default_texture_image_;
+  VkImageView default_texture_image_view_;
+  // Frames whose descriptor sets still reference replaced texture views
+  std::vector<bool> texture_descriptors_stale_;
+  // Without textureCompressionBC textures are uploaded as RGBA8 and their
+  // mips are generated on the GPU
+  bool texture_compression_supported_;
+  // The mipmap compute fallback stores without a format qualifier, so it
+  // works for any storage format
+  bool storage_write_without_format_supported_;
+  std::vector<MemoryAllocation> cubemap_memory_;
   std::vector<VkImage> cubemap_images_;
   std::vector<VkImageView> cubemap_image_views_;
-  std::vector<VkDeviceMemory> skybox_uniform_memory_;
-  std::vector<VkBuffer> skybox_uniform_buffers_;
-  VkDeviceMemory skybox_vertex_memory_;
+  MemoryAllocation skybox_vertex_memory_;
   VkBuffer skybox_vertex_buffer_;
-  VkDeviceMemory ssao_sample_memory_;
+  MemoryAllocation ssao_sample_memory_;
   VkBuffer ssao_sample_uniform_;
-  std::vector<VkDeviceMemory> hdr_tonemapping_memory_;
-  std::vector<VkBuffer> hdr_tonemapping_buffers_;
+  // Uniforms written every frame are pushed into a persistently mapped ring
+  // per frame in flight and bound with dynamic offsets
+  static const VkDeviceSize kUniformRingSize = 64 * 1024;
+  VkDeviceSize uniform_alignment_;
+  std::vector<VkBuffer> uniform_ring_buffers_;
+  std::vector<MemoryAllocation> uniform_ring_memory_;
+  std::vector<VkDeviceSize> uniform_ring_heads_;
 
   std::vector<bool> rendered_frames_;
   VkFormat ssr_format_;
   std::vector<VkImage> ssr_images_;
-  std::vector<VkDeviceMemory> ssr_memory_;
+  std::vector<MemoryAllocation> ssr_memory_;
   std::vector<VkImageView> ssr_image_views_;
   std::vector<VkFramebuffer> ssr_framebuffers_;
   VkDescriptorSetLayout ssr_descriptor_set_layout_;
@@ -245,12 +497,10 @@ class Application :: Renderer {
   VkRenderPass ssr_render_pass_;
   VkPipelineLayout ssr_pipeline_layout_;
   VkPipeline ssr_pipeline_;
-  std::vector<VkBuffer> ssr_uniform_;
-  std::vector<VkDeviceMemory> ssr_uniform_memory_;
 
   std::vector<VkImage> billboard_images_;
   std::vector<VkImageView> billboard_image_views_;
-  std::vector<VkDeviceMemory> billboard_memory_;
+  std::vector<MemoryAllocation> billboard_memory_;
   VkDescriptorSetLayout debugdraw_descriptor_set_layout_;
   std::vector<VkDescriptorSet> debugdraw_descriptor_sets_;
 
@@ -262,23 +512,46 @@ class Application :: Renderer {
 
   ComputeDetails compute_details_;
   std::vector<std::vector<VkBuffer>> illuminance_buffers_;
-  std::vector<std::vector<VkDeviceMemory>> illuminance_memory_;
+  std::vector<std::vector<MemoryAllocation>> illuminance_memory_;
   VkPipelineLayout illuminance_pipeline_layout_;
   VkPipeline log_illuminance_pipeline_;
   VkPipeline reduce_illuminance_pipeline_;
   VkDescriptorSetLayout illuminance_descriptor_set_layout_;
   std::vector<VkDescriptorSet> illuminance_descriptor_sets_;
-
-  std::vector<VkBuffer> renderer_uniforms_;
-  std::vector<VkDeviceMemory> renderer_uniform_memory_;
+  // Compute downsampling for formats without linear blit support
+  static const uint32_t kMipmapDescriptorSetCount = 256;
+  VkDescriptorSetLayout mipmap_descriptor_set_layout_;
+  VkDescriptorPool mipmap_descriptor_pool_;
+  VkPipelineLayout mipmap_pipeline_layout_;
+  VkPipeline mipmap_pipeline_;
+  // Image decoding runs on its own pool, so frames never wait on it
+  ThreadPool* decode_thread_pool_;
+  TextureCooker* texture_cooker_;
+  std::atomic<uint64_t> decode_generation_;
+  std::mutex decoded_images_mutex_;
+  std::vector<DecodedImage> decoded_images_;
+  // Decoded faces of cubemaps still waiting for the rest, by cubemap index
+  std::map<uint32_t, std::vector<DecodedImage>> cubemap_faces_;
+  VkCommandPool compute_command_pool_;
+  std::vector<VkCommandBuffer> compute_command_buffers_;
+  VkSemaphore compute_timeline_semaphore_;
+  std::vector<uint32_t> illuminance_result_buffers_;
+  uint64_t exposure_timeline_value_;
+  uint32_t exposure_frame_;
 
   VkSampleCountFlagBits msaa_samples_;
   std::vector<VkImage> depth_msaa_images_;
   std::vector<VkImageView> depth_msaa_views_;
-  std::vector<VkDeviceMemory> depth_msaa_memory_;
+  std::vector<MemoryAllocation> depth_msaa_memory_;
   std::vector<VkImage> hdr_msaa_images_;
   std::vector<VkImageView> hdr_msaa_views_;
-  std::vector<VkDeviceMemory> hdr_msaa_memory_;
+  std::vector<MemoryAllocation> hdr_msaa_memory_;
+
+  // Images bound to the same memory as an earlier image, mapped to that image
+  std::map<VkImage, VkImage> image_aliases_;
+  // Image states carry over between frames, so aliased images also synchronize
+  // with the accesses of earlier frames
+  std::map<VkImage, PassResourceState> pass_image_states_;
 
   void CreateInstance();
 
@@ -304,6 +577,7 @@ class Application :: Renderer {
       std::vector<VkPresentModeKHR> available_present_modes);
   VkExtent2D SelectSwapExtent(VkSurfaceCapabilitiesKHR capabilities);
   void CreateSwapchain();
+  void CreateOffscreenImages();
   void CreateDepthResources();
   void DestroySwapchain();
   void RecreateSwapchain();
@@ -312,37 +586,49 @@ class Application :: Renderer {
   VkShaderModule CreateShaderModule(const std::vector<char>& buffer);
   void CreateSamplers();
   void CreatePipelines(bool include_fixed_size = true);
+  // The state points into itself, so it is filled in place. Position only
+  // state reads the position geometry instead of the full vertices.
+  void GetVertexInputState(VertexFormat format, bool position_only,
+                           VertexInputState& state);
   void CreateRenderPasses(bool include_fixed_size = true);
-  void CreateFramebuffers(bool include_fixed_size = true);
+  void CreateFramebuffers();
 
   // Rendering Pipeline - Graphics
+  // The cache is loaded from and written back to disk across runs
   void CreatePipelineCache();
+  void DestroyPipelineCache();
   void CreateGraphicsPipeline();
   void CreateGraphicsRenderPass();
   void CreateGraphicsFramebuffers();
-  void BeginGraphicsRenderPass(VkCommandBuffer& cmd,
-                               uint32_t swapchain_image_i);
+  void BeginGraphicsRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                               VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Rendering Pipeline - Debug Draw
   void CreateDebugDrawResources();
   void CreateDebugDrawRenderPass();
   void CreateDebugDrawPipeline();
   void CreateDebugDrawLinesPipeline();
-  void BeginDebugDrawRenderPass(VkCommandBuffer& cmd,
-                                uint32_t swapchain_image_i);
+  void BeginDebugDrawRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                                uint32_t swapchain_image_i,
+                                VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Rendering Pipeline - Shadowmaps
   void CreateShadowmapRenderPass();
   void CreateShadowmapPipeline();
-  void CreateDirectionalShadowmapFramebuffers();
+  void CreateShadowmap(Shadowmap& shadowmap);
+  void DestroyShadowmap(Shadowmap& shadowmap);
+  void ReserveShadowmaps(uint32_t light_count);
+  void RetireShadowmaps();
   void BeginShadowmapRenderPass(VkCommandBuffer& cmd,
-                                VkFramebuffer& framebuffer);
+                                VkFramebuffer& framebuffer,
+                                VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Rendering Pipeline - Depthmap
   void CreateDepthmapRenderPass();
   void CreateDepthmapPipeline();
   void CreateDepthmapFramebuffers();
-  void BeginDepthmapRenderPass(VkCommandBuffer& cmd, uint32_t frame_i);
+  void BeginDepthmapRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                               VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Rendering Pipeline - Skybox
   void CreateSkyboxPipeline();
@@ -352,74 +638,161 @@ class Application :: Renderer {
   void CreateSsaoRenderPass();
   void CreateSsaoPipeline();
   void CreateSsaoFramebuffers();
-  void BeginSsaoRenderPass(VkCommandBuffer& cmd, uint32_t swapchain_image_i);
+  void BeginSsaoRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                           VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Rendering Pipeline - SSR
   void CreateSsrResources();
   void CreateSsrRenderPass();
   void CreateSsrPipeline();
   void CreateSsrFramebuffers();
-  void BeginSsrRenderPass(VkCommandBuffer& cmd, uint32_t swapchain_image_i);
-  void ComputeSsrMap(VkCommandBuffer& cmd, uint32_t image_i, SceneDrawDetails& details);
+  void BeginSsrRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                          VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+  void ComputeSsrMap(VkCommandBuffer& cmd, uint32_t frame_i, SceneDrawDetails& details);
 
   // Rendering Pipeline - HDR
   void CreateHdrResources();
   void CreateHdrRenderPass();
   void CreateHdrPipeline();
   void CreateHdrFramebuffers();
-  void BeginHdrRenderPass(VkCommandBuffer& cmd, uint32_t swapchain_image_i);
+  void BeginHdrRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                          uint32_t swapchain_image_i,
+                          VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   // Compute Pipeline - Illuminance
   void CreateIlluminanceResources();
   void CreateIlluminancePipelines();
-  void ComputeTonemapping(VkCommandBuffer& cmd, uint32_t swapchain_image_i, SceneDrawDetails& details);
+  void CreateIlluminanceCommandBuffers();
+  void DestroyIlluminanceCommandBuffers();
+  void ComputeTonemapping(VkCommandBuffer& cmd, uint32_t frame_i, SceneDrawDetails& details);
+  void SubmitIlluminanceReduction(uint32_t frame_i);
 
   // Needed for each window, can be in rendermanager_surface.cc
   void CreateCommandPool();
   void CreateCommandBuffers();
   void CreateSyncObjects();
+  void CreateTimestampQueryPool();
+  void UpdateGpuFrameTimings(uint32_t frame_i);
 
   // Descriptor management
   void CreateDescriptorSetLayout();
   void CreateDescriptorPool();
   void CreateDescriptorSets();
   void WriteFixedSizeDescriptorSets();
+  void WriteShadowmapDescriptorSet(uint32_t frame_i);
+  void WriteTextureDescriptorSet(uint32_t frame_i);
   void WriteResizeableDescriptorSets();
 
   // Fixed Size Resources
   void CreateVertexBuffer();
   void CreateIndexBuffer();
-  void CreateDirectionalLightUniformBuffer();
   void CreateDirectionalShadowmapResources();
-  void CreateMaterialUniformBuffer();
   void CreateTextureResources();
   void CreateCubemapResources();
   void CreateSkyboxResources();
   void CreateBillboardResources();
-  void CreateRendererSettingsResources();
 
   // Scene Resources
   void LoadSceneResources();
   void LoadMeshes();
   void LoadTextures();
+  void LoadCompressedTexture(uint32_t tex_i, const DecodedImage& image,
+                             UploadBatch& batch);
+  void LoadUncompressedTexture(uint32_t tex_i, const DecodedImage& image,
+                               UploadBatch& batch);
   void LoadCubemaps();
+  void LoadCubemap(uint32_t cmap_i, const std::vector<DecodedImage>& faces,
+                   UploadBatch& batch);
+
+  // Memory - renderer_memory.cc
+  void CreateMemoryPools();
+  void DestroyMemoryPools();
+  void AllocateMemory(MemoryAllocation& allocation, MemoryCategory category,
+                      const VkMemoryRequirements& mem_reqs,
+                      const VkMemoryPropertyFlags req_props,
+                      const VkMemoryPropertyFlags preferred_props, bool image);
+  void FreeMemory(MemoryAllocation& allocation);
+  void* MapMemory(const MemoryAllocation& allocation);
+  void GetDeviceMemoryUsage(uint64_t& usage_bytes,
+                            uint64_t& budget_bytes) const;
+  void UpdateMemoryUsagePeak();
+
+  // Geometry - renderer_geometry.cc
+  void CreateGeometryBuffer(GeometryBuffer& geometry,
+                            VkDeviceSize element_size,
+                            VkBufferUsageFlags usage);
+  void DestroyGeometryBuffer(GeometryBuffer& geometry);
+  void AllocateGeometry(GeometryBuffer& geometry, uint32_t mesh_id,
+                        uint32_t count);
+  void FreeGeometry(GeometryBuffer& geometry, uint32_t mesh_id);
+  void RetireGeometryRanges(GeometryBuffer& geometry);
+  void ReserveGeometry(GeometryBuffer& geometry, uint32_t count,
+                       UploadBatch& batch);
+  void CompactGeometryBuffer(GeometryBuffer& geometry, uint32_t capacity,
+                             UploadBatch& batch);
+
+  // Mipmaps - renderer_mipmap.cc
+  void CreateMipmapResources();
+  void DestroyMipmapResources();
+  bool IsMipmapBlitSupported(VkFormat format);
+  bool IsMipmapComputeSupported(VkFormat format);
+  // sRGB formats are stored through their UNORM counterpart
+  static VkFormat GetMipmapStorageFormat(VkFormat format);
+  void GetMipmapImageFlags(VkFormat format, VkImageCreateFlags& flags,
+                           VkImageUsageFlags& usage);
+  void PrepareMipmapChain(MipmapChain& chain, UploadBatch& batch);
+  void CmdGenerateMipmaps(VkCommandBuffer& cmd, const MipmapChain& chain);
+  void CmdBlitMipmaps(VkCommandBuffer& cmd, const MipmapChain& chain);
+  void CmdDownsampleMipmaps(VkCommandBuffer& cmd, const MipmapChain& chain);
+
+  // Decoding - renderer_decode.cc
+  void CreateDecodeResources();
+  void DestroyDecodeResources();
+  void QueueImageDecode(DecodedImage image);
+  std::vector<DecodedImage> TakeDecodedImages(bool cubemap);
+
+  // Uniforms - renderer_uniform.cc
+  void CreateUniformRings();
+  void DestroyUniformRings();
+  void ResetUniformRing(uint32_t frame_i);
+  void* AllocateUniform(uint32_t frame_i, VkDeviceSize size, uint32_t& offset);
+  uint32_t PushUniform(uint32_t frame_i, const void* data, VkDeviceSize size);
 
   // Utilities - renderer_utilities.cc
   static std::vector<char> ReadFile(const std::string& path);
+  bool FindMemoryType(const VkMemoryRequirements& mem_reqs,
+                      const VkMemoryPropertyFlags& req_props,
+                      uint32_t& mem_index);
   uint32_t SelectMemoryType(const VkMemoryRequirements& mem_reqs,
                             const VkMemoryPropertyFlags& req_props);
-  void CreateBuffer(VkBuffer& buffer, VkDeviceMemory& memory,
-                    const VkDeviceSize& size, const VkBufferUsageFlags& usage,
-                    const VkMemoryPropertyFlags& req_props);
-  void CreateImage(VkImage& image, VkDeviceMemory& memory,
-                   VkImageCreateFlags flags, const VkFormat format,
-                   const VkExtent3D extent, const uint32_t mip_levels,
+  void CreateBuffer(VkBuffer& buffer, MemoryAllocation& memory,
+                    MemoryCategory category, const VkDeviceSize& size,
+                    const VkBufferUsageFlags& usage,
+                    const VkMemoryPropertyFlags& req_props,
+                    bool transfer_shared = false);
+  void CreateImage(VkImage& image, MemoryAllocation& memory,
+                   MemoryCategory category, VkImageCreateFlags flags,
+                   const VkFormat format, const VkExtent3D extent,
+                   const uint32_t mip_levels,
                    const uint32_t array_layers, const VkImageUsageFlags usage,
                    const VkMemoryPropertyFlags req_props,
                    const VkSampleCountFlagBits samples);
+  void CreateAliasedImages(std::vector<VkImage>& images,
+                           MemoryAllocation& memory, MemoryCategory category,
+                           VkImageCreateFlags flags, const VkFormat format,
+                           const VkExtent3D extent,
+                           const uint32_t mip_levels,
+                           const uint32_t array_layers,
+                           const VkImageUsageFlags usage,
+                           const VkMemoryPropertyFlags req_props,
+                           const VkMemoryPropertyFlags preferred_props,
+                           const VkSampleCountFlagBits samples);
+  void RemoveImageAliases(const std::vector<VkImage>& images);
+  // A non-zero usage restricts the view to a subset of the image's usage
   void CreateImageView(VkImageView& image_view, VkImage& image,
                        VkImageViewType type, const VkFormat format,
-                       const VkImageAspectFlags aspect_flags);
+                       const VkImageAspectFlags aspect_flags,
+                       const VkImageUsageFlags usage = 0);
   void TransitionImageLayout(VkImage& image,
                              const VkImageAspectFlagBits image_aspect,
                              const VkImageLayout initial_layout,
@@ -428,24 +801,79 @@ class Application :: Renderer {
                              const VkPipelineStageFlagBits dst_scope,
                              const VkAccessFlags src_access_mask,
                              const VkAccessFlags dst_access_mask);
-  void BeginSingleUseCommandBuffer(VkCommandBuffer& cmd);
-  void EndSingleUseCommandBuffer(VkCommandBuffer& cmd);
+  void CmdTransitionImageLayout(VkCommandBuffer& cmd, VkImage image,
+                                const VkImageAspectFlagBits image_aspect,
+                                const VkImageLayout initial_layout,
+                                const VkImageLayout final_layout,
+                                const VkPipelineStageFlags src_scope,
+                                const VkPipelineStageFlags dst_scope,
+                                const VkAccessFlags src_access_mask,
+                                const VkAccessFlags dst_access_mask);
 
   // Draw Commands
   void DrawFrame();
-  void DrawScene(uint32_t image_i);
+  void DrawScene(uint32_t frame_i, uint32_t image_i);
   void DrawScenePrePass(VkCommandBuffer& cmd, SceneDrawDetails& details, const SceneObject* focus,
                     glm::mat4 model_transform);
+  // Binds the pipeline and vertex buffer of each vertex format in turn
+  void DrawSceneMeshes(
+      VkCommandBuffer& cmd,
+      const std::array<VkPipeline, kVertexFormatCount>& pipelines,
+      const std::array<GeometryBuffer, kVertexFormatCount>& vertex_geometries,
+      VkPipelineLayout& layout, SceneDrawDetails& details);
   void DrawSceneMeshes(VkCommandBuffer& cmd, VkPipelineLayout& layout, SceneDrawDetails& details,
+                       VertexFormat format,
+                       const GeometryBuffer& vertex_geometry,
                        const SceneObject* focus, glm::mat4 model_transform);
-  void DebugDrawScene(uint32_t image_i, SceneDrawDetails& details);
-  void DebugDrawSceneAabb(uint32_t image_i, const Aabb& aabb, SceneDrawDetails& details);
-  void DebugDrawSceneBillboard(uint32_t image_i,
+  void PushCameraConstants(VkCommandBuffer& cmd, VkPipelineLayout& layout,
+                           SceneDrawDetails& details);
+  void DebugDrawScene(VkCommandBuffer& cmd, uint32_t frame_i,
+                      SceneDrawDetails& details);
+  void DebugDrawSceneAabb(VkCommandBuffer& cmd, uint32_t frame_i, const Aabb& aabb,
+                          SceneDrawDetails& details);
+  void DebugDrawSceneBillboard(VkCommandBuffer& cmd, uint32_t frame_i,
                                const DebugDrawBillboard* billboard,
                                SceneDrawDetails& details);
-  void DrawSceneShadowmaps(VkCommandBuffer& cmd, uint32_t swapchain_image_i, SceneDrawDetails& details);
-  void DrawSceneZPrePass(VkCommandBuffer& cmd, uint32_t swapchain_image_i,
-                         SceneDrawDetails& details);
+  void DrawSceneShadowmap(VkCommandBuffer& cmd, uint32_t shadow_i,
+                          SceneDrawDetails& details);
+  void DrawSceneZPrePass(VkCommandBuffer& cmd, SceneDrawDetails& details);
+
+  // Command Recording - renderer_recording.cc
+  void CreateRecordingResources();
+  void DestroyRecordingResources();
+  VkCommandBuffer AcquireSecondaryCommandBuffer(uint32_t frame_i,
+                                                uint32_t thread_i);
+  void RecordScenePasses(VkCommandBuffer& cmd, uint32_t frame_i,
+                         std::vector<ScenePass>& passes, bool parallel);
+
+  // Render Graph - renderer_graph.cc
+  PassAccess ImageAccess(VkImage image, VkImageAspectFlags aspect,
+                         VkPipelineStageFlags stage, VkAccessFlags access,
+                         VkImageLayout layout, bool discard = false);
+  PassAccess BufferAccess(VkBuffer buffer, VkPipelineStageFlags stage,
+                          VkAccessFlags access);
+  void CompileScenePasses(std::vector<ScenePass>& passes);
+  void CmdScenePassBarriers(VkCommandBuffer& cmd, const ScenePass& pass);
+  void ResetScenePassStates();
+  void ResetScenePassImage(VkImage image);
+
+  // Asset Uploads - renderer_upload.cc
+  void CreateUploadResources();
+  void DestroyUploadResources();
+  void BeginUploadBatch(UploadBatch& batch);
+  void SubmitUploadBatch(UploadBatch& batch);
+  // False when the transfer and graphics queues share a family
+  bool IsUploadOwnershipTransferred() const;
+  void ReleaseUploadImage(VkCommandBuffer& cmd, VkImage image);
+  void AcquireUploadImage(VkCommandBuffer& cmd, VkImage image);
+  void RecordUploadGraphicsCommands(VkCommandBuffer& cmd);
+  void RetireUploadBatches();
+  void FreeUploadBatch(UploadBatch& batch);
+  VkCommandBuffer& BeginSetupCommands();
+  VkBuffer StageSetupData(const void* data, VkDeviceSize size,
+                          VkDeviceSize& offset);
+  void SubmitSetupCommands();
+  void WaitSetupCommands();
 
   // Debug Messenger for Vulkan Validation Layers
   static void PopulateDebugMessengerCreateInfo(
@@ -8,6 +8,7 @@ void Application::Renderer::CreateDebugDrawResources() {
   debugdraw_memory_.resize(frame_count_);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     CreateBuffer(debugdraw_buffer_[frame_i], debugdraw_memory_[frame_i],
+                 MemoryCategory::kGeometry,
                  sizeof(DebugDrawVertex) * Scene::kMaxDebugDrawVertices,
                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
@@ -21,16 +22,10 @@ void Application::Renderer::CreateBillboardResources() {
   VkDeviceSize billboard_size =
       Scene::kMaxBillboardResolution * Scene::kMaxBillboardResolution * 4;
   TextureImporter texture_importer;
-  VkBuffer staging_buffer = VK_NULL_HANDLE;
-  VkDeviceMemory staging_memory = VK_NULL_HANDLE;
-  CreateBuffer(staging_buffer, staging_memory, billboard_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
   for (uint32_t bill_i = 0; bill_i < Scene::kMaxBillboards; bill_i++) {
     CreateImage(
-        billboard_images_[bill_i], billboard_memory_[bill_i], 0,
-        VK_FORMAT_R8G8B8A8_SRGB,
+        billboard_images_[bill_i], billboard_memory_[bill_i],
+        MemoryCategory::kTextures, 0, VK_FORMAT_R8G8B8A8_SRGB,
         {Scene::kMaxBillboardResolution, Scene::kMaxBillboardResolution, 1}, 1,
         1, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
@@ -46,25 +41,22 @@ void Application::Renderer::CreateBillboardResources() {
   // Load Primitive Billboards
   texture_importer.ReadFile("../assets/billboards/sun.png");
   const TextureData* tex_data = texture_importer.GetData();
-  void* staging_data = nullptr;
-  vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data);
-  memcpy(staging_data, tex_data->data, billboard_size);
-  vkUnmapMemory(device_, staging_memory);
+  VkDeviceSize staging_offset = 0;
+  VkBuffer staging_buffer =
+      StageSetupData(tex_data->data, billboard_size, staging_offset);
   texture_importer.DestroyData();
   VkBufferImageCopy copy_info{};
+  copy_info.bufferOffset = staging_offset;
   copy_info.imageExtent = {Scene::kMaxBillboardResolution,
                            Scene::kMaxBillboardResolution, 1};
   copy_info.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   copy_info.imageSubresource.baseArrayLayer = 0;
   copy_info.imageSubresource.layerCount = 1;
   copy_info.imageSubresource.mipLevel = 0;
-  VkCommandBuffer cmd;
-  BeginSingleUseCommandBuffer(cmd);
-  vkCmdCopyBufferToImage(cmd, staging_buffer,
+  vkCmdCopyBufferToImage(BeginSetupCommands(), staging_buffer,
                          billboard_images_[static_cast<uint32_t>(
                              BillboardType::kDirectionalLight)-1],
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_info);
-  EndSingleUseCommandBuffer(cmd);
   for (uint32_t bill_i = 0; bill_i < Scene::kMaxBillboards; bill_i++) {
     TransitionImageLayout(
         billboard_images_[bill_i], VK_IMAGE_ASPECT_COLOR_BIT,
@@ -73,8 +65,6 @@ void Application::Renderer::CreateBillboardResources() {
         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
         VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
   }
-  vkFreeMemory(device_, staging_memory, nullptr);
-  vkDestroyBuffer(device_,staging_buffer,nullptr);
 }
 void Application::Renderer::CreateDebugDrawRenderPass() {
   VkAttachmentDescription color_attachment{};
@@ -85,8 +75,8 @@ void Application::Renderer::CreateDebugDrawRenderPass() {
   color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-  color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentDescription depth_attachment{};
   depth_attachment.flags = 0;
@@ -459,7 +449,8 @@ void Application::Renderer::CreateDebugDrawLinesPipeline() {
   vkDestroyShaderModule(device_, frag_shader, nullptr);
 }
 void Application::Renderer::BeginDebugDrawRenderPass(
-    VkCommandBuffer& cmd, uint32_t swapchain_image_i) {
+    VkCommandBuffer& cmd, uint32_t frame_i, uint32_t swapchain_image_i,
+    VkSubpassContents contents) {
   VkClearValue color_clear;
   color_clear.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
   VkClearValue depth_clear;
@@ -470,12 +461,12 @@ void Application::Renderer::BeginDebugDrawRenderPass(
   render_pass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_bi.pNext = nullptr;
   render_pass_bi.renderPass = debugdraw_render_pass_;
-  render_pass_bi.framebuffer = hdr_framebuffers_[swapchain_image_i];
+  render_pass_bi.framebuffer = hdr_framebuffers_[frame_i][swapchain_image_i];
   render_pass_bi.renderArea.extent = swapchain_extent_;
   render_pass_bi.renderArea.offset.x = 0;
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 1;
   render_pass_bi.pClearValues = clear_values;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 }  // namespace catalyst
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateDecodeResources() {
+  // Leave a core to the render thread
+  uint32_t thread_count =
+      std::max(2u, std::thread::hardware_concurrency()) - 1;
+  decode_thread_pool_ = new ThreadPool(thread_count);
+  texture_cooker_ = new TextureCooker("../cache/textures");
+  decode_generation_ = 0;
+}
+void Application::Renderer::DestroyDecodeResources() {
+  // Queued decodes see the new generation and return without decoding
+  decode_generation_++;
+  decode_thread_pool_->Wait();
+  delete decode_thread_pool_;
+  delete texture_cooker_;
+  decoded_images_.clear();
+  cubemap_faces_.clear();
+}
+void Application::Renderer::QueueImageDecode(DecodedImage image) {
+  decode_thread_pool_->Submit([this, image](uint32_t thread_i) mutable {
+    if (image.generation != decode_generation_) return;
+    if (image.compressed) {
+      image.success =
+          texture_cooker_->Cook(image.path, image.compression, image.cooked);
+    } else {
+      TextureImporter texture_importer;
+      image.success = texture_importer.ReadFile(image.path);
+      if (image.success) {
+        const TextureData* tex_data = texture_importer.GetData();
+        image.width = tex_data->width;
+        image.height = tex_data->height;
+        image.pixels.assign(tex_data->data,
+                            tex_data->data + tex_data->width *
+                                                 tex_data->height *
+                                                 tex_data->channels);
+      }
+    }
+    std::lock_guard<std::mutex> lock(decoded_images_mutex_);
+    decoded_images_.push_back(std::move(image));
+  });
+}
+std::vector<Application::Renderer::DecodedImage>
+Application::Renderer::TakeDecodedImages(bool cubemap) {
+  std::vector<DecodedImage> taken;
+  std::lock_guard<std::mutex> lock(decoded_images_mutex_);
+  uint64_t generation = decode_generation_;
+  auto kept = std::partition(
+      decoded_images_.begin(), decoded_images_.end(),
+      [cubemap, generation](const DecodedImage& image) {
+        return image.generation == generation && image.cubemap != cubemap;
+      });
+  for (auto it = kept; it != decoded_images_.end(); it++) {
+    if (it->generation == generation) taken.push_back(std::move(*it));
+  }
+  decoded_images_.erase(kept, decoded_images_.end());
+  return taken;
+}
+}  // namespace catalyst
@@ -12,7 +12,8 @@ void Application::Renderer::CreateDepthmapRenderPass() {
   depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth_attachment.initialLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_attachment.finalLayout =
       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -26,9 +27,10 @@ void Application::Renderer::CreateDepthmapRenderPass() {
   depth_resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   depth_resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth_resolve_attachment.initialLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_resolve_attachment.finalLayout =
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference2 depth_ref{};
   depth_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
@@ -41,7 +43,7 @@ void Application::Renderer::CreateDepthmapRenderPass() {
   depth_resolve_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
   depth_resolve_ref.pNext = nullptr;
   depth_resolve_ref.attachment = 1;
-  depth_resolve_ref.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  depth_resolve_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_resolve_ref.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 
   VkSubpassDescriptionDepthStencilResolve depth_stencil_resolve{};
@@ -67,21 +69,6 @@ void Application::Renderer::CreateDepthmapRenderPass() {
   subpass.preserveAttachmentCount = 0;
   subpass.pPreserveAttachments = nullptr;
 
-  VkSubpassDependency2 dependency{};
-  dependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
-  dependency.pNext = nullptr;
-  dependency.srcSubpass = 0;
-  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
-                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-  dependency.viewOffset = 0;
-
   VkAttachmentDescription2 attachments[] = {depth_attachment,
                                            depth_resolve_attachment};
 
@@ -93,8 +80,8 @@ void Application::Renderer::CreateDepthmapRenderPass() {
   render_pass_ci.pAttachments = attachments;
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 1;
-  render_pass_ci.pDependencies = &dependency;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
   render_pass_ci.correlatedViewMaskCount = 0;
   render_pass_ci.pCorrelatedViewMasks = nullptr;
   VkResult create_result = vkCreateRenderPass2(device_, &render_pass_ci,
@@ -135,53 +122,6 @@ void Application::Renderer::CreateDepthmapPipeline() {
   VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_ci,
                                                      frag_shader_stage_ci};
 
-  VkVertexInputBindingDescription vertex_bd{};
-  vertex_bd.binding = 0;
-  vertex_bd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  vertex_bd.stride = sizeof(Vertex);
-
-  VkVertexInputAttributeDescription vertex_pos_ad{};
-  vertex_pos_ad.binding = 0;
-  vertex_pos_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_pos_ad.location = 0;
-  vertex_pos_ad.offset = 0;
-
-  VkVertexInputAttributeDescription vertex_norm_ad{};
-  vertex_norm_ad.binding = 0;
-  vertex_norm_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_norm_ad.location = 1;
-  vertex_norm_ad.offset = offsetof(Vertex, normal);
-
-  VkVertexInputAttributeDescription vertex_uv_ad{};
-  vertex_uv_ad.binding = 0;
-  vertex_uv_ad.format = VK_FORMAT_R32G32_SFLOAT;
-  vertex_uv_ad.location = 2;
-  vertex_uv_ad.offset = offsetof(Vertex, uv);
-
-  VkVertexInputAttributeDescription vertex_tan_ad{};
-  vertex_tan_ad.binding = 0;
-  vertex_tan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_tan_ad.location = 3;
-  vertex_tan_ad.offset = offsetof(Vertex, tangent);
-
-  VkVertexInputAttributeDescription vertex_bitan_ad{};
-  vertex_bitan_ad.binding = 0;
-  vertex_bitan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_bitan_ad.location = 4;
-  vertex_bitan_ad.offset = offsetof(Vertex, bitangent);
-
-  VkVertexInputAttributeDescription vertex_ads[] = {
-      vertex_pos_ad, vertex_norm_ad, vertex_uv_ad, vertex_tan_ad,
-      vertex_bitan_ad};
-
-  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-  vertex_input_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.vertexAttributeDescriptionCount = 5;
-  vertex_input_info.pVertexBindingDescriptions = &vertex_bd;
-  vertex_input_info.pVertexAttributeDescriptions = vertex_ads;
-
   VkPipelineInputAssemblyStateCreateInfo input_assembly_state{};
   input_assembly_state.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -273,7 +213,6 @@ void Application::Renderer::CreateDepthmapPipeline() {
   pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_ci.stageCount = 2;
   pipeline_ci.pStages = shader_stages;
-  pipeline_ci.pVertexInputState = &vertex_input_info;
   pipeline_ci.pInputAssemblyState = &input_assembly_state;
   pipeline_ci.pViewportState = &viewport_state;
   pipeline_ci.pRasterizationState = &rasterizer_state;
@@ -285,9 +224,17 @@ void Application::Renderer::CreateDepthmapPipeline() {
   pipeline_ci.subpass = 0;
   pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
 
-  create_result = vkCreateGraphicsPipelines(
-      device_, pipeline_cache_, 1, &pipeline_ci, nullptr, &depthmap_pipeline_);
-  ASSERT(create_result == VK_SUCCESS, "Failed to create depthmap pipeline!");
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    VertexInputState vertex_input;
+    GetVertexInputState(static_cast<VertexFormat>(format_i), true,
+                        vertex_input);
+    pipeline_ci.pVertexInputState = &vertex_input.ci;
+    create_result = vkCreateGraphicsPipelines(
+        device_, pipeline_cache_, 1, &pipeline_ci, nullptr,
+        &depthmap_pipelines_[format_i]);
+    ASSERT(create_result == VK_SUCCESS,
+           "Failed to create depthmap pipeline!");
+  }
 
   vkDestroyShaderModule(device_, vert_shader, nullptr);
   vkDestroyShaderModule(device_, frag_shader, nullptr);
@@ -318,7 +265,8 @@ void Application::Renderer::CreateDepthmapFramebuffers() {
 }
 
 void Application::Renderer::BeginDepthmapRenderPass(VkCommandBuffer& cmd,
-                                                    uint32_t image_i) {
+                                                    uint32_t image_i,
+                                                    VkSubpassContents contents) {
   VkClearValue depth_clear;
   depth_clear.depthStencil.depth = 1.0f;
   depth_clear.depthStencil.stencil = 0;
@@ -333,7 +281,7 @@ void Application::Renderer::BeginDepthmapRenderPass(VkCommandBuffer& cmd,
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 2;
   render_pass_bi.pClearValues = clear_values;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 
 }
\ No newline at end of file
@@ -4,7 +4,8 @@ namespace catalyst {
 void Application::Renderer::CreateDescriptorSetLayout() {
   VkDescriptorSetLayoutBinding directional_light_binding{};
   directional_light_binding.binding = 0;
-  directional_light_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  directional_light_binding.descriptorType =
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   directional_light_binding.descriptorCount = 1;
   directional_light_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   directional_light_binding.pImmutableSamplers = nullptr;
@@ -19,7 +20,8 @@ void Application::Renderer::CreateDescriptorSetLayout() {
 
   VkDescriptorSetLayoutBinding material_uniform_binding{};
   material_uniform_binding.binding = 2;
-  material_uniform_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  material_uniform_binding.descriptorType =
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   material_uniform_binding.descriptorCount = 1;
   material_uniform_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   material_uniform_binding.pImmutableSamplers = nullptr;
@@ -41,7 +43,7 @@ void Application::Renderer::CreateDescriptorSetLayout() {
 
   VkDescriptorSetLayoutBinding skybox_binding{};
   skybox_binding.binding = 5;
-  skybox_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  skybox_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   skybox_binding.descriptorCount = 1;
   skybox_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   skybox_binding.pImmutableSamplers = nullptr;
@@ -62,7 +64,8 @@ void Application::Renderer::CreateDescriptorSetLayout() {
 
   VkDescriptorSetLayoutBinding renderer_settings_binding{};
   renderer_settings_binding.binding = 8;
-  renderer_settings_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  renderer_settings_binding.descriptorType =
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   renderer_settings_binding.descriptorCount = 1;
   renderer_settings_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   renderer_settings_binding.pImmutableSamplers = nullptr;
@@ -135,7 +138,7 @@ void Application::Renderer::CreateDescriptorSetLayout() {
   VkDescriptorSetLayoutBinding hdr_tone_binding{};
   hdr_tone_binding.binding = 1;
   hdr_tone_binding.descriptorType =
-      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   hdr_tone_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   hdr_tone_binding.descriptorCount = 1;
   hdr_tone_binding.pImmutableSamplers = nullptr;
@@ -200,7 +203,7 @@ void Application::Renderer::CreateDescriptorSetLayout() {
   VkDescriptorSetLayoutBinding ssr_uniform_binding{};
   ssr_uniform_binding.binding = 2;
   ssr_uniform_binding.descriptorType =
-      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   ssr_uniform_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   ssr_uniform_binding.descriptorCount = 1;
   ssr_uniform_binding.pImmutableSamplers = nullptr;
@@ -245,7 +248,10 @@ void Application::Renderer::CreateDescriptorPool() {
 
   VkDescriptorPoolSize uniform_size;
   uniform_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  uniform_size.descriptorCount = frame_count*7;
+  uniform_size.descriptorCount = frame_count;
+  VkDescriptorPoolSize dynamic_uniform_size;
+  dynamic_uniform_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  dynamic_uniform_size.descriptorCount = frame_count * 6;
   VkDescriptorPoolSize sampler_size;
   sampler_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   sampler_size.descriptorCount =
@@ -254,7 +260,8 @@ void Application::Renderer::CreateDescriptorPool() {
   VkDescriptorPoolSize storage_size;
   storage_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
   storage_size.descriptorCount = (frame_count * 2);
-  VkDescriptorPoolSize pool_sizes[] = {uniform_size, sampler_size, storage_size};
+  VkDescriptorPoolSize pool_sizes[] = {uniform_size, dynamic_uniform_size,
+                                       sampler_size, storage_size};
 
   VkDescriptorPoolCreateInfo pool_ci{};
   pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -339,9 +346,9 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
   set_wis.resize(frame_count_);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     VkDescriptorBufferInfo& set_bi = set_bis[frame_i];
-    set_bi.buffer = directional_light_uniform_buffers_[frame_i];
+    set_bi.buffer = uniform_ring_buffers_[frame_i];
     set_bi.offset = 0;
-    set_bi.range = VK_WHOLE_SIZE;
+    set_bi.range = DirectionalLightUniform::GetSize();
     VkWriteDescriptorSet& set_wi = set_wis[frame_i];
     set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     set_wi.pNext = nullptr;
@@ -349,42 +356,21 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
     set_wi.dstBinding = 0;
     set_wi.dstArrayElement = 0;
     set_wi.descriptorCount = 1;
-    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     set_wi.pBufferInfo = &set_bis[frame_i];
   }
   vkUpdateDescriptorSets(device_, frame_count_, set_wis.data(), 0, nullptr);
 
   // Directional Light Shadows
-  std::vector<std::vector<VkDescriptorImageInfo>> shadow_image_infos;
-  shadow_image_infos.resize(frame_count_);
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    shadow_image_infos[frame_i].resize(Scene::kMaxDirectionalLights);
-    for (uint32_t shadow_i = 0; shadow_i < Scene::kMaxDirectionalLights;
-         shadow_i++) {
-      VkDescriptorImageInfo& set_si = shadow_image_infos[frame_i][shadow_i];
-      set_si.sampler = shadowmap_sampler_;
-      set_si.imageView = shadowmap_image_views_[frame_i][shadow_i];
-      set_si.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-    }
-    VkWriteDescriptorSet& set_wi = set_wis[frame_i];
-    set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    set_wi.pNext = nullptr;
-    set_wi.dstSet = descriptor_sets_[frame_i];
-    set_wi.dstBinding = 1;
-    set_wi.dstArrayElement = 0;
-    set_wi.descriptorCount = Scene::kMaxDirectionalLights;
-    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    set_wi.pBufferInfo = nullptr;
-    set_wi.pImageInfo = shadow_image_infos[frame_i].data();
-  }
-  vkUpdateDescriptorSets(device_, frame_count_, set_wis.data(), 0, nullptr);
+  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++)
+    WriteShadowmapDescriptorSet(frame_i);
 
   // Material Uniform
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     VkDescriptorBufferInfo& set_bi = set_bis[frame_i];
-    set_bi.buffer = material_uniform_buffers_[frame_i];
+    set_bi.buffer = uniform_ring_buffers_[frame_i];
     set_bi.offset = 0;
-    set_bi.range = VK_WHOLE_SIZE;
+    set_bi.range = MaterialUniformBlock::GetSize();
     VkWriteDescriptorSet& set_wi = set_wis[frame_i];
     set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     set_wi.pNext = nullptr;
@@ -392,34 +378,14 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
     set_wi.dstBinding = 2;
     set_wi.dstArrayElement = 0;
     set_wi.descriptorCount = 1;
-    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     set_wi.pBufferInfo = &set_bis[frame_i];
   }
   vkUpdateDescriptorSets(device_, frame_count_, set_wis.data(), 0, nullptr);
 
   // Texture Images
-  std::vector<std::vector<VkDescriptorImageInfo>> texture_image_infos;
-  texture_image_infos.resize(frame_count_);
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    texture_image_infos[frame_i].resize(Scene::kMaxTextures);
-    for (uint32_t tex_i = 0; tex_i < Scene::kMaxTextures; tex_i++) {
-      VkDescriptorImageInfo& set_si = texture_image_infos[frame_i][tex_i];
-      set_si.sampler = texture_sampler_;
-      set_si.imageView = texture_image_views_[tex_i];
-      set_si.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    }
-    VkWriteDescriptorSet& set_wi = set_wis[frame_i];
-    set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    set_wi.pNext = nullptr;
-    set_wi.dstSet = descriptor_sets_[frame_i];
-    set_wi.dstBinding = 3;
-    set_wi.dstArrayElement = 0;
-    set_wi.descriptorCount = Scene::kMaxTextures;
-    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    set_wi.pBufferInfo = nullptr;
-    set_wi.pImageInfo = texture_image_infos[frame_i].data();
-  }
-  vkUpdateDescriptorSets(device_, frame_count_, set_wis.data(), 0, nullptr);
+  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++)
+    WriteTextureDescriptorSet(frame_i);
 
   // Cubemap Images
   std::vector<std::vector<VkDescriptorImageInfo>> cubemap_image_infos;
@@ -448,9 +414,9 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
   // Skybox Uniform
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     VkDescriptorBufferInfo& set_bi = set_bis[frame_i];
-    set_bi.buffer = skybox_uniform_buffers_[frame_i];
+    set_bi.buffer = uniform_ring_buffers_[frame_i];
     set_bi.offset = 0;
-    set_bi.range = VK_WHOLE_SIZE;
+    set_bi.range = sizeof(SkyboxUniform);
     VkWriteDescriptorSet& set_wi = set_wis[frame_i];
     set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     set_wi.pNext = nullptr;
@@ -458,7 +424,7 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
     set_wi.dstBinding = 5;
     set_wi.dstArrayElement = 0;
     set_wi.descriptorCount = 1;
-    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    set_wi.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     set_wi.pBufferInfo = &set_bis[frame_i];
   }
   vkUpdateDescriptorSets(device_, frame_count_, set_wis.data(), 0, nullptr);
@@ -467,16 +433,17 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
     std::vector<VkDescriptorBufferInfo> infos(frame_count_);
     std::vector<VkWriteDescriptorSet> writes(frame_count_);
     for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-      infos[frame_i].buffer = renderer_uniforms_[frame_i];
+      infos[frame_i].buffer = uniform_ring_buffers_[frame_i];
       infos[frame_i].offset = 0;
-      infos[frame_i].range = VK_WHOLE_SIZE;
+      infos[frame_i].range = sizeof(RendererSettingsUniform);
       writes[frame_i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       writes[frame_i].pNext = nullptr;
       writes[frame_i].dstSet = descriptor_sets_[frame_i];
       writes[frame_i].dstBinding = 8;
       writes[frame_i].dstArrayElement = 0;
       writes[frame_i].descriptorCount = 1;
-      writes[frame_i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      writes[frame_i].descriptorType =
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
       writes[frame_i].pBufferInfo = &infos[frame_i];
     }
     vkUpdateDescriptorSets(device_, frame_count_, writes.data(), 0, nullptr);
@@ -506,6 +473,55 @@ void Application::Renderer::WriteFixedSizeDescriptorSets() {
   }
 }
 
+void Application::Renderer::WriteShadowmapDescriptorSet(uint32_t frame_i) {
+  std::vector<VkDescriptorImageInfo> shadow_image_infos(
+      Scene::kMaxDirectionalLights);
+  for (uint32_t shadow_i = 0; shadow_i < Scene::kMaxDirectionalLights;
+       shadow_i++) {
+    VkDescriptorImageInfo& set_si = shadow_image_infos[shadow_i];
+    set_si.sampler = shadowmap_sampler_;
+    set_si.imageView = shadow_i < shadowmaps_.size()
+                           ? shadowmaps_[shadow_i].image_views[frame_i]
+                           : default_shadowmap_image_view_;
+    set_si.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  }
+  VkWriteDescriptorSet set_wi{};
+  set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  set_wi.pNext = nullptr;
+  set_wi.dstSet = descriptor_sets_[frame_i];
+  set_wi.dstBinding = 1;
+  set_wi.dstArrayElement = 0;
+  set_wi.descriptorCount = Scene::kMaxDirectionalLights;
+  set_wi.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  set_wi.pBufferInfo = nullptr;
+  set_wi.pImageInfo = shadow_image_infos.data();
+  vkUpdateDescriptorSets(device_, 1, &set_wi, 0, nullptr);
+  shadowmap_descriptors_stale_[frame_i] = false;
+}
+void Application::Renderer::WriteTextureDescriptorSet(uint32_t frame_i) {
+  std::vector<VkDescriptorImageInfo> texture_image_infos(Scene::kMaxTextures);
+  for (uint32_t tex_i = 0; tex_i < Scene::kMaxTextures; tex_i++) {
+    VkDescriptorImageInfo& set_si = texture_image_infos[tex_i];
+    set_si.sampler = texture_sampler_;
+    set_si.imageView = texture_image_views_[tex_i] != VK_NULL_HANDLE
+                           ? texture_image_views_[tex_i]
+                           : default_texture_image_view_;
+    set_si.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+  VkWriteDescriptorSet set_wi{};
+  set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  set_wi.pNext = nullptr;
+  set_wi.dstSet = descriptor_sets_[frame_i];
+  set_wi.dstBinding = 3;
+  set_wi.dstArrayElement = 0;
+  set_wi.descriptorCount = Scene::kMaxTextures;
+  set_wi.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  set_wi.pBufferInfo = nullptr;
+  set_wi.pImageInfo = texture_image_infos.data();
+  vkUpdateDescriptorSets(device_, 1, &set_wi, 0, nullptr);
+  texture_descriptors_stale_[frame_i] = false;
+}
+
 void Application::Renderer::WriteResizeableDescriptorSets() {
   // Graphics: SSAO Image
   {
@@ -632,16 +648,17 @@ void Application::Renderer::WriteResizeableDescriptorSets() {
     std::vector<VkDescriptorBufferInfo> infos(frame_count_);
     std::vector<VkWriteDescriptorSet> writes(frame_count_);
     for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-      infos[frame_i].buffer = hdr_tonemapping_buffers_[frame_i];
+      infos[frame_i].buffer = uniform_ring_buffers_[frame_i];
       infos[frame_i].offset = 0;
-      infos[frame_i].range = VK_WHOLE_SIZE;
+      infos[frame_i].range = sizeof(TonemappingUniform);
       writes[frame_i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       writes[frame_i].pNext = nullptr;
       writes[frame_i].dstSet = hdr_descriptor_sets_[frame_i];
       writes[frame_i].dstBinding = 1;
       writes[frame_i].dstArrayElement = 0;
       writes[frame_i].descriptorCount = 1;
-      writes[frame_i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      writes[frame_i].descriptorType =
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
       writes[frame_i].pBufferInfo = &infos[frame_i];
     }
     vkUpdateDescriptorSets(device_, frame_count_, writes.data(), 0, nullptr);
@@ -713,16 +730,17 @@ void Application::Renderer::WriteResizeableDescriptorSets() {
     std::vector<VkDescriptorBufferInfo> infos(frame_count_);
     std::vector<VkWriteDescriptorSet> writes(frame_count_);
     for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-      infos[frame_i].buffer = ssr_uniform_[frame_i];
+      infos[frame_i].buffer = uniform_ring_buffers_[frame_i];
       infos[frame_i].offset = 0;
-      infos[frame_i].range = VK_WHOLE_SIZE;
+      infos[frame_i].range = sizeof(SsrUniform);
       writes[frame_i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
       writes[frame_i].pNext = nullptr;
       writes[frame_i].dstSet = ssr_descriptor_sets_[frame_i];
       writes[frame_i].dstBinding = 2;
       writes[frame_i].dstArrayElement = 0;
       writes[frame_i].descriptorCount = 1;
-      writes[frame_i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      writes[frame_i].descriptorType =
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
       writes[frame_i].pBufferInfo = &infos[frame_i];
     }
     vkUpdateDescriptorSets(device_, frame_count_, writes.data(), 0, nullptr);
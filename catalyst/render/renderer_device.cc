@@ -31,19 +31,28 @@ bool Application::Renderer::CheckPhysicalDeviceSuitability(
   bool extensions_supported =
       CheckPhysicalDeviceExtensionSupport(physical_device);
 
-  bool swapchain_supported = false;
-  if (extensions_supported) {
+  bool swapchain_supported = headless_;
+  if (extensions_supported && !headless_) {
     SwapchainSupportDetails swapChainSupport = CheckSwapchainSupport(physical_device);
     swapchain_supported = !swapChainSupport.formats.empty() &&
                         !swapChainSupport.present_modes.empty();
   }
 
-  VkPhysicalDeviceFeatures supported_features;
-  vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+  VkPhysicalDeviceVulkan12Features supported_features12{};
+  supported_features12.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  supported_features12.pNext = nullptr;
+  VkPhysicalDeviceFeatures2 supported_features2{};
+  supported_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supported_features2.pNext = &supported_features12;
+  vkGetPhysicalDeviceFeatures2(physical_device, &supported_features2);
+  const VkPhysicalDeviceFeatures& supported_features =
+      supported_features2.features;
 
   return indices.IsComplete() && extensions_supported &&
          supported_features.samplerAnisotropy &&
-         supported_features.fillModeNonSolid && supported_features.wideLines;
+         supported_features.fillModeNonSolid && supported_features.wideLines &&
+         supported_features12.timelineSemaphore;
 }
 
 bool Application::Renderer::CheckPhysicalDeviceExtensionSupport(VkPhysicalDevice physical_device) {
@@ -57,7 +66,8 @@ bool Application::Renderer::CheckPhysicalDeviceExtensionSupport(VkPhysicalDevice
       physical_device, nullptr, &extension_count, available_extensions.data());
 
   bool extension_missing = false;
-  std::vector<std::string> required_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<std::string> required_extensions;
+  if (!headless_) required_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
   for (const std::string& required_extension : required_extensions) {
     bool extension_found = false;
     for (const VkExtensionProperties& extension : available_extensions) {
@@ -94,9 +104,14 @@ Application::Renderer::FindQueueFamilyIndices(VkPhysicalDevice physical_device)
       indices.compute_queue_index_ = queue_i;
     if (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT)
       indices.transfer_queue_index_ = queue_i;
+    // Without a surface nothing is presented, the graphics queue stands in
+    // for the present queue
     VkBool32 present_support = VK_FALSE;
-    vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_i, surface_,
-                                         &present_support);
+    if (headless_)
+      present_support = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    else
+      vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_i, surface_,
+                                           &present_support);
     if (present_support) indices.present_queue_index_ = queue_i;
     queue_i++;
   }
@@ -137,17 +152,52 @@ void Application::Renderer::CreateLogicalDevice() {
   device_features.samplerAnisotropy = VK_TRUE;
   device_features.fillModeNonSolid = VK_TRUE;
   device_features.wideLines = VK_TRUE;
+  // Optional, textures are uploaded uncompressed without it
+  VkPhysicalDeviceFeatures supported_features{};
+  vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+  texture_compression_supported_ =
+      supported_features.textureCompressionBC == VK_TRUE;
+  device_features.textureCompressionBC =
+      texture_compression_supported_ ? VK_TRUE : VK_FALSE;
+  // Optional, the mipmap compute fallback is unavailable without it
+  storage_write_without_format_supported_ =
+      supported_features.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+  device_features.shaderStorageImageWriteWithoutFormat =
+      storage_write_without_format_supported_ ? VK_TRUE : VK_FALSE;
+
+  VkPhysicalDeviceVulkan12Features device_features12{};
+  device_features12.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  device_features12.pNext = nullptr;
+  device_features12.timelineSemaphore = VK_TRUE;
 
   VkDeviceCreateInfo device_ci{};
   device_ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  device_ci.pNext = &device_features12;
 
   device_ci.queueCreateInfoCount = static_cast<uint32_t>(queue_cis.size());
   device_ci.pQueueCreateInfos = queue_cis.data();
 
   device_ci.pEnabledFeatures = &device_features;
 
-  std::vector<const char*> device_extensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<const char*> device_extensions;
+  if (!headless_) device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // Optional, memory statistics fall back to the heap sizes without it
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr,
+                                       &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available_extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(physical_device_, nullptr,
+                                       &extension_count,
+                                       available_extensions.data());
+  memory_budget_supported_ = false;
+  for (const VkExtensionProperties& extension : available_extensions) {
+    if (std::string(extension.extensionName) ==
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+      memory_budget_supported_ = true;
+  }
+  if (memory_budget_supported_)
+    device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
   device_ci.enabledExtensionCount =
       static_cast<uint32_t>(device_extensions.size());
   device_ci.ppEnabledExtensionNames = device_extensions.data();
@@ -0,0 +1,157 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateGeometryBuffer(GeometryBuffer& geometry,
+                                                 VkDeviceSize element_size,
+                                                 VkBufferUsageFlags usage) {
+  geometry.element_size = element_size;
+  // Compaction copies out of the buffer as well as into it
+  geometry.usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  geometry.capacity = kMinGeometryCapacity;
+  geometry.live_count = 0;
+  geometry.ranges.clear();
+  geometry.free_ranges.clear();
+  geometry.free_ranges[0] = geometry.capacity;
+  geometry.released_ranges.clear();
+  CreateBuffer(geometry.buffer, geometry.memory, MemoryCategory::kGeometry,
+               geometry.element_size * geometry.capacity, geometry.usage,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+}
+void Application::Renderer::DestroyGeometryBuffer(GeometryBuffer& geometry) {
+  vkDestroyBuffer(device_, geometry.buffer, nullptr);
+  FreeMemory(geometry.memory);
+  geometry.ranges.clear();
+  geometry.free_ranges.clear();
+  geometry.released_ranges.clear();
+}
+void Application::Renderer::AllocateGeometry(GeometryBuffer& geometry,
+                                             uint32_t mesh_id,
+                                             uint32_t count) {
+  if (geometry.ranges.size() <= mesh_id) geometry.ranges.resize(mesh_id + 1);
+  GeometryRange& range = geometry.ranges[mesh_id];
+  ASSERT(range.count == 0, "Mesh geometry is already allocated!");
+  if (count == 0) return;
+  auto free_range =
+      std::find_if(geometry.free_ranges.begin(), geometry.free_ranges.end(),
+                   [count](const std::pair<const uint32_t, uint32_t>& range) {
+                     return range.second >= count;
+                   });
+  ASSERT(free_range != geometry.free_ranges.end(),
+         "Geometry buffer was not reserved!");
+  range.offset = free_range->first;
+  range.count = count;
+  uint32_t remaining = free_range->second - count;
+  geometry.free_ranges.erase(free_range);
+  if (remaining > 0) geometry.free_ranges[range.offset + count] = remaining;
+  geometry.live_count += count;
+}
+void Application::Renderer::FreeGeometry(GeometryBuffer& geometry,
+                                         uint32_t mesh_id) {
+  if (mesh_id >= geometry.ranges.size()) return;
+  GeometryRange& range = geometry.ranges[mesh_id];
+  if (range.count == 0) return;
+  // Frames submitted so far may still draw the range
+  geometry.released_ranges.push_back({frame_timeline_value_, range});
+  geometry.live_count -= range.count;
+  range = GeometryRange();
+}
+void Application::Renderer::RetireGeometryRanges(GeometryBuffer& geometry) {
+  uint64_t completed_value = 0;
+  vkGetSemaphoreCounterValue(device_, frame_timeline_semaphore_,
+                             &completed_value);
+  auto retired_begin = std::partition(
+      geometry.released_ranges.begin(), geometry.released_ranges.end(),
+      [completed_value](const std::pair<uint64_t, GeometryRange>& released) {
+        return released.first > completed_value;
+      });
+  for (auto it = retired_begin; it != geometry.released_ranges.end(); it++) {
+    // Merge the range with its free neighbours
+    uint32_t offset = it->second.offset;
+    uint32_t count = it->second.count;
+    auto next = geometry.free_ranges.lower_bound(offset);
+    if (next != geometry.free_ranges.end() && next->first == offset + count) {
+      count += next->second;
+      next = geometry.free_ranges.erase(next);
+    }
+    if (next != geometry.free_ranges.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == offset) {
+        offset = prev->first;
+        count += prev->second;
+        geometry.free_ranges.erase(prev);
+      }
+    }
+    geometry.free_ranges[offset] = count;
+  }
+  geometry.released_ranges.erase(retired_begin,
+                                 geometry.released_ranges.end());
+}
+void Application::Renderer::ReserveGeometry(GeometryBuffer& geometry,
+                                            uint32_t count,
+                                            UploadBatch& batch) {
+  // Grow to fit the new ranges and shrink buffers that are mostly empty
+  uint32_t required = geometry.live_count + count;
+  uint32_t capacity = geometry.capacity;
+  while (capacity < required) capacity *= 2;
+  while (capacity / 2 >= kMinGeometryCapacity && required <= capacity / 4)
+    capacity /= 2;
+  uint32_t largest_range = 0;
+  for (const auto& range : geometry.free_ranges)
+    largest_range = std::max(largest_range, range.second);
+  // With the new ranges in one free range, first fit never fails to place them
+  if (capacity != geometry.capacity || largest_range < count)
+    CompactGeometryBuffer(geometry, capacity, batch);
+}
+void Application::Renderer::CompactGeometryBuffer(GeometryBuffer& geometry,
+                                                  uint32_t capacity,
+                                                  UploadBatch& batch) {
+  VkBuffer buffer;
+  MemoryAllocation memory;
+  CreateBuffer(buffer, memory, MemoryCategory::kGeometry,
+               geometry.element_size * capacity, geometry.usage,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+  // Earlier batches wrote the old buffer on the same queue
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  // Pack the live ranges in mesh order, released ranges are dropped
+  std::vector<VkBufferCopy> copies;
+  uint32_t head = 0;
+  for (GeometryRange& range : geometry.ranges) {
+    if (range.count == 0) continue;
+    VkBufferCopy copy{};
+    copy.srcOffset = geometry.element_size * range.offset;
+    copy.dstOffset = geometry.element_size * head;
+    copy.size = geometry.element_size * range.count;
+    copies.push_back(copy);
+    range.offset = head;
+    head += range.count;
+  }
+  if (!copies.empty()) {
+    vkCmdCopyBuffer(batch.command_buffer, geometry.buffer, buffer,
+                    static_cast<uint32_t>(copies.size()), copies.data());
+  }
+
+  // Frames in flight keep drawing from the old buffer until the batch retires
+  batch.buffers.push_back(geometry.buffer);
+  batch.memory.push_back(geometry.memory);
+  geometry.buffer = buffer;
+  geometry.memory = memory;
+  geometry.capacity = capacity;
+  geometry.free_ranges.clear();
+  if (head < capacity) geometry.free_ranges[head] = capacity - head;
+  geometry.released_ranges.clear();
+}
+}  // namespace catalyst
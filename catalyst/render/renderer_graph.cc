@@ -0,0 +1,275 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+Application::Renderer::PassAccess Application::Renderer::ImageAccess(
+    VkImage image, VkImageAspectFlags aspect, VkPipelineStageFlags stage,
+    VkAccessFlags access, VkImageLayout layout, bool discard) {
+  PassAccess pass_access;
+  pass_access.image = image;
+  pass_access.buffer = VK_NULL_HANDLE;
+  pass_access.aspect = aspect;
+  pass_access.stage = stage;
+  pass_access.access = access;
+  pass_access.layout = layout;
+  pass_access.discard = discard;
+  return pass_access;
+}
+Application::Renderer::PassAccess Application::Renderer::BufferAccess(
+    VkBuffer buffer, VkPipelineStageFlags stage, VkAccessFlags access) {
+  PassAccess pass_access;
+  pass_access.image = VK_NULL_HANDLE;
+  pass_access.buffer = buffer;
+  pass_access.aspect = 0;
+  pass_access.stage = stage;
+  pass_access.access = access;
+  pass_access.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  pass_access.discard = false;
+  return pass_access;
+}
+void Application::Renderer::CompileScenePasses(std::vector<ScenePass>& passes) {
+  // Passes that touched a resource so far, in declaration order
+  struct ResourceUsage {
+    int32_t writer = -1;
+    int32_t transition = -1;
+    std::vector<uint32_t> readers;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    bool known = false;
+  };
+  uint32_t pass_count = static_cast<uint32_t>(passes.size());
+  std::vector<std::vector<uint32_t>> order_deps(pass_count);
+  std::vector<std::vector<uint32_t>> data_deps(pass_count);
+  // Images sharing memory are tracked as a single resource
+  auto alias_of = [this](VkImage image) {
+    auto alias = image_aliases_.find(image);
+    return alias != image_aliases_.end() ? alias->second : image;
+  };
+  auto derive_dependencies = [&passes, &order_deps, &data_deps,
+                              &alias_of](const std::vector<uint32_t>& order) {
+    for (uint32_t pass_i : order) {
+      order_deps[pass_i].clear();
+      data_deps[pass_i].clear();
+    }
+    std::map<VkImage, ResourceUsage> image_usages;
+    std::map<VkBuffer, ResourceUsage> buffer_usages;
+    for (uint32_t pass_i : order) {
+      auto add_dep = [pass_i](std::vector<uint32_t>& deps, int32_t dep_i) {
+        if (dep_i >= 0 && static_cast<uint32_t>(dep_i) != pass_i)
+          deps.push_back(static_cast<uint32_t>(dep_i));
+      };
+      auto visit = [&](const PassAccess& access, bool is_write) {
+        ResourceUsage& usage = access.image != VK_NULL_HANDLE
+                                   ? image_usages[alias_of(access.image)]
+                                   : buffer_usages[access.buffer];
+        if (!is_write || !access.discard)
+          add_dep(data_deps[pass_i], usage.writer);
+        add_dep(order_deps[pass_i], usage.writer);
+        add_dep(order_deps[pass_i], usage.transition);
+        // Layout transitions conflict with every access since the last one
+        bool layout_change = usage.known && access.layout != usage.layout;
+        if (is_write || layout_change) {
+          for (uint32_t reader_i : usage.readers)
+            add_dep(order_deps[pass_i], reader_i);
+          usage.readers.clear();
+          usage.transition = pass_i;
+          if (is_write) usage.writer = pass_i;
+        }
+        if (!is_write) usage.readers.push_back(pass_i);
+        usage.layout = access.layout;
+        usage.known = true;
+      };
+      for (const PassAccess& access : passes[pass_i].reads) visit(access, false);
+      for (const PassAccess& access : passes[pass_i].writes) visit(access, true);
+    }
+  };
+
+  // Step 1: Cull passes whose writes never reach a pass with side effects
+  std::vector<uint32_t> declared_passes(pass_count);
+  std::iota(declared_passes.begin(), declared_passes.end(), 0);
+  derive_dependencies(declared_passes);
+  std::vector<bool> live(pass_count, false);
+  for (uint32_t pass_i = pass_count; pass_i-- > 0;) {
+    if (passes[pass_i].side_effects) live[pass_i] = true;
+    if (!live[pass_i]) continue;
+    for (uint32_t dep_i : data_deps[pass_i]) live[dep_i] = true;
+  }
+  std::vector<uint32_t> live_passes;
+  for (uint32_t pass_i = 0; pass_i < pass_count; pass_i++) {
+    if (live[pass_i]) live_passes.push_back(pass_i);
+  }
+
+  // Step 2: Schedule the remaining passes by dependency level, so passes that
+  // do not depend on each other share a single barrier
+  derive_dependencies(live_passes);
+  std::vector<uint32_t> levels(pass_count, 0);
+  for (uint32_t pass_i : live_passes) {
+    for (uint32_t dep_i : order_deps[pass_i])
+      levels[pass_i] = std::max(levels[pass_i], levels[dep_i] + 1);
+  }
+  std::stable_sort(live_passes.begin(), live_passes.end(),
+                   [&levels](uint32_t a, uint32_t b) {
+                     return levels[a] < levels[b];
+                   });
+
+  // Step 3: Derive the barriers recorded before the first pass of each level.
+  // Images keep their state from earlier frames, buffers not accessed yet this
+  // frame and images without a state are assumed to be in the layout of their
+  // first access, unless it discards them.
+  for (auto& image_state : pass_image_states_)
+    image_state.second.barrier_batch = -1;
+  std::map<VkBuffer, PassResourceState> buffer_states;
+  uint32_t batch_begin = 0;
+  for (uint32_t order_i = 0; order_i < live_passes.size(); order_i++) {
+    ScenePass& pass = passes[live_passes[order_i]];
+    pass.src_stage = 0;
+    pass.dst_stage = 0;
+    pass.image_barriers.clear();
+    pass.buffer_barriers.clear();
+    if (levels[live_passes[order_i]] != levels[live_passes[batch_begin]])
+      batch_begin = order_i;
+    ScenePass& batch = passes[live_passes[batch_begin]];
+    auto synchronize = [&](const PassAccess& access, bool is_write) {
+      bool is_image = access.image != VK_NULL_HANDLE;
+      PassResourceState& state =
+          is_image ? pass_image_states_[alias_of(access.image)]
+                   : buffer_states[access.buffer];
+      // Another image bound to the same memory leaves this one's contents and
+      // layout undefined
+      bool alias_change =
+          is_image && state.known && state.image != access.image;
+      ASSERT(!alias_change || access.discard,
+             "Aliased image accessed without discarding its contents!");
+      // Accesses within a level never conflict, so they extend its barrier
+      if (state.barrier_batch == static_cast<int32_t>(batch_begin)) {
+        if (is_image)
+          batch.image_barriers[state.barrier_i].dstAccessMask |= access.access;
+        else
+          batch.buffer_barriers[state.barrier_i].dstAccessMask |=
+              access.access;
+        batch.dst_stage |= access.stage;
+        state.read_stages |= access.stage;
+        state.visible_stages |= access.stage;
+        state.visible_access |= access.access;
+        return;
+      }
+      bool transition =
+          is_image && (alias_change || (state.known
+                                            ? access.layout != state.layout
+                                            : access.discard));
+      VkPipelineStageFlags src_stages = 0;
+      VkAccessFlags src_access = 0;
+      if (!state.known) {
+        // Chains with the semaphore waits of the submission (eg. swapchain
+        // image acquisition)
+        if (transition) src_stages = access.stage;
+      } else if (transition || is_write) {
+        src_stages = state.write_stages | state.read_stages;
+        src_access = state.write_access;
+      } else if ((access.stage & ~state.visible_stages) ||
+                 (access.access & ~state.visible_access)) {
+        src_stages = state.write_stages;
+        src_access = state.write_access;
+      }
+
+      if (transition || src_stages != 0) {
+        batch.src_stage |= src_stages;
+        batch.dst_stage |= access.stage;
+        if (is_image) {
+          VkImageMemoryBarrier image_barrier{};
+          image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+          image_barrier.pNext = nullptr;
+          image_barrier.srcAccessMask = src_access;
+          image_barrier.dstAccessMask = access.access;
+          image_barrier.oldLayout =
+              access.discard ? VK_IMAGE_LAYOUT_UNDEFINED
+                             : (state.known ? state.layout : access.layout);
+          image_barrier.newLayout = access.layout;
+          image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          image_barrier.image = access.image;
+          image_barrier.subresourceRange.aspectMask = access.aspect;
+          image_barrier.subresourceRange.baseMipLevel = 0;
+          image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+          image_barrier.subresourceRange.baseArrayLayer = 0;
+          image_barrier.subresourceRange.layerCount =
+              VK_REMAINING_ARRAY_LAYERS;
+          state.barrier_i = static_cast<uint32_t>(batch.image_barriers.size());
+          batch.image_barriers.push_back(image_barrier);
+        } else {
+          VkBufferMemoryBarrier buffer_barrier{};
+          buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+          buffer_barrier.pNext = nullptr;
+          buffer_barrier.srcAccessMask = src_access;
+          buffer_barrier.dstAccessMask = access.access;
+          buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          buffer_barrier.buffer = access.buffer;
+          buffer_barrier.offset = 0;
+          buffer_barrier.size = VK_WHOLE_SIZE;
+          state.barrier_i =
+              static_cast<uint32_t>(batch.buffer_barriers.size());
+          batch.buffer_barriers.push_back(buffer_barrier);
+        }
+        state.barrier_batch = static_cast<int32_t>(batch_begin);
+      }
+
+      if (is_write) {
+        state.write_stages = access.stage;
+        state.write_access = access.access;
+        state.read_stages = 0;
+        state.visible_stages = 0;
+        state.visible_access = 0;
+      } else if (transition) {
+        // Later reads only need to wait for the transition
+        state.write_stages = access.stage;
+        state.write_access = 0;
+        state.read_stages = access.stage;
+        state.visible_stages = access.stage;
+        state.visible_access = access.access;
+      } else {
+        state.read_stages |= access.stage;
+        if (src_stages != 0) {
+          state.visible_stages |= access.stage;
+          state.visible_access |= access.access;
+        }
+      }
+      state.image = access.image;
+      state.layout = access.layout;
+      state.known = true;
+    };
+    for (const PassAccess& access : pass.reads) synchronize(access, false);
+    for (const PassAccess& access : pass.writes) synchronize(access, true);
+  }
+
+  std::vector<ScenePass> scheduled_passes;
+  scheduled_passes.reserve(live_passes.size());
+  for (uint32_t pass_i : live_passes)
+    scheduled_passes.push_back(std::move(passes[pass_i]));
+  passes = std::move(scheduled_passes);
+}
+void Application::Renderer::ResetScenePassStates() {
+  pass_image_states_.clear();
+}
+void Application::Renderer::ResetScenePassImage(VkImage image) {
+  auto alias = image_aliases_.find(image);
+  pass_image_states_.erase(alias != image_aliases_.end() ? alias->second
+                                                         : image);
+}
+void Application::Renderer::CmdScenePassBarriers(VkCommandBuffer& cmd,
+                                                 const ScenePass& pass) {
+  if (pass.image_barriers.empty() && pass.buffer_barriers.empty()) return;
+  vkCmdPipelineBarrier(
+      cmd, pass.src_stage != 0 ? pass.src_stage
+                               : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      pass.dst_stage, 0, 0, nullptr,
+      static_cast<uint32_t>(pass.buffer_barriers.size()),
+      pass.buffer_barriers.data(),
+      static_cast<uint32_t>(pass.image_barriers.size()),
+      pass.image_barriers.data());
+}
+}  // namespace catalyst
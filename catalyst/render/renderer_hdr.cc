@@ -6,13 +6,22 @@ void Application::Renderer::CreateHdrResources() {
   hdr_images_.resize(frame_count_);
   hdr_image_views_.resize(frame_count_);
   hdr_memory_.resize(frame_count_);
-  hdr_tonemapping_buffers_.resize(frame_count_);
-  hdr_tonemapping_memory_.resize(frame_count_);
   hdr_msaa_images_.resize(frame_count_);
-  hdr_msaa_memory_.resize(frame_count_);
+  hdr_msaa_memory_.assign(frame_count_, MemoryAllocation());
   hdr_msaa_views_.resize(frame_count_);
+  // The multisampled target is resolved at the end of the main pass and never
+  // stored, tile based GPUs can keep it in lazily allocated memory
+  CreateAliasedImages(
+      hdr_msaa_images_, hdr_msaa_memory_[0], MemoryCategory::kRenderTargets, 0,
+      hdr_format_,
+      {swapchain_extent_.width, swapchain_extent_.height, 1}, 1, 1,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+          VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, msaa_samples_);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateImage(hdr_images_[frame_i], hdr_memory_[frame_i], 0, hdr_format_,
+    CreateImage(hdr_images_[frame_i], hdr_memory_[frame_i],
+                MemoryCategory::kRenderTargets, 0, hdr_format_,
                 {swapchain_extent_.width, swapchain_extent_.height, 1}, 1, 1,
                 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
                     VK_IMAGE_USAGE_SAMPLED_BIT |
@@ -21,17 +30,6 @@ void Application::Renderer::CreateHdrResources() {
     CreateImageView(hdr_image_views_[frame_i], hdr_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, hdr_format_,
                     VK_IMAGE_ASPECT_COLOR_BIT);
-    CreateBuffer(
-        hdr_tonemapping_buffers_[frame_i], hdr_tonemapping_memory_[frame_i],
-        sizeof(TonemappingUniform),
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    CreateImage(hdr_msaa_images_[frame_i], hdr_msaa_memory_[frame_i], 0,
-                hdr_format_,
-                {swapchain_extent_.width, swapchain_extent_.height, 1}, 1, 1,
-                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, msaa_samples_);
     CreateImageView(hdr_msaa_views_[frame_i], hdr_msaa_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, hdr_format_,
                     VK_IMAGE_ASPECT_COLOR_BIT);
@@ -46,8 +44,8 @@ void Application::Renderer::CreateHdrRenderPass() {
   color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentDescription depth_attachment{};
   depth_attachment.flags = 0;
@@ -57,7 +55,8 @@ void Application::Renderer::CreateHdrRenderPass() {
   depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  depth_attachment.initialLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_attachment.finalLayout =
       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -83,19 +82,6 @@ void Application::Renderer::CreateHdrRenderPass() {
 
   VkAttachmentDescription attachments[] = {color_attachment, depth_attachment};
 
-  VkSubpassDependency dependency{};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
-                             VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
   VkRenderPassCreateInfo render_pass_ci{};
   render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   render_pass_ci.pNext = nullptr;
@@ -104,8 +90,8 @@ void Application::Renderer::CreateHdrRenderPass() {
   render_pass_ci.pAttachments = attachments;
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 1;
-  render_pass_ci.pDependencies = &dependency;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
   VkResult create_result =
       vkCreateRenderPass(device_, &render_pass_ci, nullptr, &hdr_render_pass_);
   ASSERT(create_result == VK_SUCCESS, "Could not create HDR render pass!");
@@ -270,28 +256,34 @@ void Application::Renderer::CreateHdrPipeline() {
   vkDestroyShaderModule(device_, frag_shader, nullptr);
 }
 void Application::Renderer::CreateHdrFramebuffers() {
+  uint32_t image_count = static_cast<uint32_t>(swapchain_image_views_.size());
   hdr_framebuffers_.resize(frame_count_);
-  VkFramebufferCreateInfo framebuffer_ci{};
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    VkImageView attachments[] = {swapchain_image_views_[frame_i],
-                                 depth_image_views_[frame_i]};
-    VkFramebufferCreateInfo framebuffer_ci{};
-    framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebuffer_ci.pNext = nullptr;
-    framebuffer_ci.flags = 0;
-    framebuffer_ci.renderPass = hdr_render_pass_;
-    framebuffer_ci.attachmentCount = 2;
-    framebuffer_ci.pAttachments = attachments;
-    framebuffer_ci.width = swapchain_extent_.width;
-    framebuffer_ci.height = swapchain_extent_.height;
-    framebuffer_ci.layers = 1;
-    VkResult create_result = vkCreateFramebuffer(
-        device_, &framebuffer_ci, nullptr, &hdr_framebuffers_[frame_i]);
-    ASSERT(create_result == VK_SUCCESS, "Could not create HDR framebuffer!");
+    hdr_framebuffers_[frame_i].resize(image_count);
+    for (uint32_t image_i = 0; image_i < image_count; image_i++) {
+      VkImageView attachments[] = {swapchain_image_views_[image_i],
+                                   depth_image_views_[frame_i]};
+      VkFramebufferCreateInfo framebuffer_ci{};
+      framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebuffer_ci.pNext = nullptr;
+      framebuffer_ci.flags = 0;
+      framebuffer_ci.renderPass = hdr_render_pass_;
+      framebuffer_ci.attachmentCount = 2;
+      framebuffer_ci.pAttachments = attachments;
+      framebuffer_ci.width = swapchain_extent_.width;
+      framebuffer_ci.height = swapchain_extent_.height;
+      framebuffer_ci.layers = 1;
+      VkResult create_result =
+          vkCreateFramebuffer(device_, &framebuffer_ci, nullptr,
+                              &hdr_framebuffers_[frame_i][image_i]);
+      ASSERT(create_result == VK_SUCCESS, "Could not create HDR framebuffer!");
+    }
   }
 }
 void Application::Renderer::BeginHdrRenderPass(VkCommandBuffer& cmd,
-                                               uint32_t swapchain_image_i) {
+                                               uint32_t frame_i,
+                                               uint32_t swapchain_image_i,
+                                               VkSubpassContents contents) {
   VkClearValue color_clear;
   color_clear.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
   VkClearValue depth_clear;
@@ -302,12 +294,12 @@ void Application::Renderer::BeginHdrRenderPass(VkCommandBuffer& cmd,
   render_pass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_bi.pNext = nullptr;
   render_pass_bi.renderPass = hdr_render_pass_;
-  render_pass_bi.framebuffer = hdr_framebuffers_[swapchain_image_i];
+  render_pass_bi.framebuffer = hdr_framebuffers_[frame_i][swapchain_image_i];
   render_pass_bi.renderArea.extent = swapchain_extent_;
   render_pass_bi.renderArea.offset.x = 0;
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 2;
   render_pass_bi.pClearValues = clear_values;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 }
\ No newline at end of file
@@ -4,6 +4,10 @@ namespace catalyst {
 void Application::Renderer::CreateIlluminanceResources() {
   illuminance_buffers_.resize(frame_count_);
   illuminance_memory_.resize(frame_count_);
+  // Reductions of the previous swapchain extent are no longer usable
+  illuminance_result_buffers_.assign(frame_count_, 0);
+  exposure_timeline_value_ = 0;
+  exposure_frame_ = 0;
   VkDeviceSize illuminance_size =
       sizeof(glm::vec4) * swapchain_extent_.height * swapchain_extent_.width;
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
@@ -11,7 +15,8 @@ void Application::Renderer::CreateIlluminanceResources() {
     illuminance_memory_[frame_i].resize(2);
     for (uint32_t buff_i = 0; buff_i < 2; buff_i++) {
       CreateBuffer(illuminance_buffers_[frame_i][buff_i],
-                   illuminance_memory_[frame_i][buff_i], illuminance_size,
+                   illuminance_memory_[frame_i][buff_i],
+                   MemoryCategory::kUniforms, illuminance_size,
                    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -87,10 +92,80 @@ void Application::Renderer::CreateIlluminancePipelines() {
   vkDestroyShaderModule(device_, log_shader, nullptr);
   vkDestroyShaderModule(device_, reduce_shader, nullptr);
 }
+void Application::Renderer::CreateIlluminanceCommandBuffers() {
+  VkCommandPoolCreateInfo command_pool_ci{};
+  command_pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  command_pool_ci.pNext = nullptr;
+  command_pool_ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  command_pool_ci.queueFamilyIndex =
+      queue_family_indices_.compute_queue_index_.value();
+  VkResult create_result = vkCreateCommandPool(device_, &command_pool_ci,
+                                               nullptr, &compute_command_pool_);
+  ASSERT(create_result == VK_SUCCESS, "Failed to create compute command pool!");
+
+  compute_command_buffers_.resize(frame_count_);
+  VkCommandBufferAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.pNext = nullptr;
+  alloc_info.commandPool = compute_command_pool_;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount =
+      static_cast<uint32_t>(compute_command_buffers_.size());
+  VkResult alloc_result = vkAllocateCommandBuffers(
+      device_, &alloc_info, compute_command_buffers_.data());
+  ASSERT(alloc_result == VK_SUCCESS,
+         "Failed to allocate compute command buffers!");
+}
+void Application::Renderer::DestroyIlluminanceCommandBuffers() {
+  vkFreeCommandBuffers(device_, compute_command_pool_,
+                       static_cast<uint32_t>(compute_command_buffers_.size()),
+                       compute_command_buffers_.data());
+  compute_command_buffers_.clear();
+  vkDestroyCommandPool(device_, compute_command_pool_, nullptr);
+}
 void Application::Renderer::ComputeTonemapping(VkCommandBuffer& cmd,
-                                            uint32_t swapchain_image_i,
+                                            uint32_t frame_i,
                                             SceneDrawDetails& details) {
-  // Step 1: Copy HDR buffer contents to Illuminance storage buffer
+  // The illuminance reduction runs on the compute queue after this frame is
+  // submitted, so tonemapping uses the exposure of the previous frame
+  uint32_t graphics_family = queue_family_indices_.graphics_queue_index_.value();
+  uint32_t compute_family = queue_family_indices_.compute_queue_index_.value();
+  // Step 1: Acquire the last reduction result from the compute queue and copy
+  // its Log Illuminance Sum into the tonemapping uniform, DrawScene pushed the
+  // other fields
+  if (exposure_timeline_value_ > 0) {
+    VkBuffer result_buffer =
+        illuminance_buffers_[exposure_frame_]
+                            [illuminance_result_buffers_[exposure_frame_]];
+    VkBufferMemoryBarrier acquire_barrier{};
+    acquire_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    acquire_barrier.pNext = nullptr;
+    acquire_barrier.srcAccessMask = 0;
+    acquire_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    acquire_barrier.srcQueueFamilyIndex = compute_family;
+    acquire_barrier.dstQueueFamilyIndex = graphics_family;
+    acquire_barrier.offset = 0;
+    acquire_barrier.buffer = result_buffer;
+    acquire_barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
+                         &acquire_barrier, 0, nullptr);
+    VkBufferCopy buffer_cp{};
+    buffer_cp.size = sizeof(float);
+    buffer_cp.srcOffset = 0;
+    buffer_cp.dstOffset = details.uniform_offsets.tonemap +
+                          offsetof(TonemappingUniform, log_illuminance_sum);
+    vkCmdCopyBuffer(cmd, result_buffer, uniform_ring_buffers_[frame_i], 1,
+                    &buffer_cp);
+    // With a single frame in flight the result may live in the buffer the HDR
+    // copy below overwrites
+    if (exposure_frame_ == frame_i) {
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                           nullptr, 0, nullptr);
+    }
+  }
+  // Step 2: Copy HDR buffer contents to Illuminance storage buffer
   VkBufferImageCopy copy_info{};
   copy_info.bufferOffset = 0;
   copy_info.bufferRowLength = 0;
@@ -103,29 +178,56 @@ void Application::Renderer::ComputeTonemapping(VkCommandBuffer& cmd,
   copy_info.imageExtent = {swapchain_extent_.width, swapchain_extent_.height,
                            1};
   vkCmdCopyImageToBuffer(
-      cmd, hdr_images_[swapchain_image_i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      illuminance_buffers_[swapchain_image_i][0], 1, &copy_info);
+      cmd, hdr_images_[frame_i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      illuminance_buffers_[frame_i][0], 1, &copy_info);
+  // Step 3: Release the Illuminance storage buffer to the compute queue
+  VkBufferMemoryBarrier release_barrier{};
+  release_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  release_barrier.pNext = nullptr;
+  release_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  release_barrier.dstAccessMask = 0;
+  release_barrier.srcQueueFamilyIndex = graphics_family;
+  release_barrier.dstQueueFamilyIndex = compute_family;
+  release_barrier.offset = 0;
+  release_barrier.buffer = illuminance_buffers_[frame_i][0];
+  release_barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
+                       &release_barrier, 0, nullptr);
+}
+void Application::Renderer::SubmitIlluminanceReduction(uint32_t frame_i) {
+  uint32_t graphics_family = queue_family_indices_.graphics_queue_index_.value();
+  uint32_t compute_family = queue_family_indices_.compute_queue_index_.value();
+  VkCommandBuffer& cmd = compute_command_buffers_[frame_i];
+  vkResetCommandBuffer(cmd, 0);
+
+  VkCommandBufferBeginInfo cmd_bi{};
+  cmd_bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmd_bi.pNext = nullptr;
+  cmd_bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  cmd_bi.pInheritanceInfo = nullptr;
+  VkResult begin_result = vkBeginCommandBuffer(cmd, &cmd_bi);
+  ASSERT(begin_result == VK_SUCCESS,
+         "Failed to begin recording compute command buffer!");
+
   uint32_t num_pixels = swapchain_extent_.width * swapchain_extent_.height;
   uint32_t num_dispatches = (num_pixels + compute_details_.workgroup_size - 1) /
                             compute_details_.workgroup_size;
-  // Step 2: Wait for copy to finish and make new data available to compute
-  // shader
+  // Step 1: Acquire the Illuminance storage buffer from the graphics queue
   VkBufferMemoryBarrier buff_barrier0{};
   buff_barrier0.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
   buff_barrier0.pNext = nullptr;
-  buff_barrier0.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  buff_barrier0.srcAccessMask = 0;
   buff_barrier0.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  buff_barrier0.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  buff_barrier0.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
+  buff_barrier0.srcQueueFamilyIndex = graphics_family;
+  buff_barrier0.dstQueueFamilyIndex = compute_family;
   buff_barrier0.offset = 0;
-  buff_barrier0.buffer = illuminance_buffers_[swapchain_image_i][0];
+  buff_barrier0.buffer = illuminance_buffers_[frame_i][0];
   buff_barrier0.size = VK_WHOLE_SIZE;
-  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
                        &buff_barrier0, 0, nullptr);
-  // Step 3: Dispatch Log Illuminance Compute Shader
+  // Step 2: Dispatch Log Illuminance Compute Shader
   ComputePushConstantData pc_data{};
   pc_data.input_dim = num_pixels;
   pc_data.input0 = true;
@@ -134,34 +236,32 @@ void Application::Renderer::ComputeTonemapping(VkCommandBuffer& cmd,
                      sizeof(ComputePushConstantData), &pc_data);
   vkCmdBindDescriptorSets(
       cmd, VK_PIPELINE_BIND_POINT_COMPUTE, illuminance_pipeline_layout_, 0, 1,
-      &illuminance_descriptor_sets_[swapchain_image_i], 0, nullptr);
+      &illuminance_descriptor_sets_[frame_i], 0, nullptr);
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
                     log_illuminance_pipeline_);
   vkCmdDispatch(cmd, num_dispatches, 1, 1);
-  // Step 4: Wait for Log Illuminance Computation
+  // Step 3: Wait for Log Illuminance Computation
   VkBufferMemoryBarrier buff_barrier1{};
   buff_barrier1.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
   buff_barrier1.pNext = nullptr;
   buff_barrier1.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
   buff_barrier1.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  buff_barrier1.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  buff_barrier1.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
+  buff_barrier1.srcQueueFamilyIndex = compute_family;
+  buff_barrier1.dstQueueFamilyIndex = compute_family;
   buff_barrier1.offset = 0;
-  buff_barrier1.buffer = illuminance_buffers_[swapchain_image_i][0];
+  buff_barrier1.buffer = illuminance_buffers_[frame_i][0];
   buff_barrier1.size = VK_WHOLE_SIZE;
   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
                        &buff_barrier1, 0, nullptr);
-  // Step 5: Reduce Illuminance
+  // Step 4: Reduce Illuminance
   uint32_t illuminance_size = num_pixels;
   uint32_t current_input = 0;
   uint32_t current_output = 1;
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
                     reduce_illuminance_pipeline_);
   while (illuminance_size > 1) {
-    // 5a: Compute workgroup size and submit job
+    // 4a: Compute workgroup size and submit job
     uint32_t num_groups =
         (illuminance_size + compute_details_.workgroup_size - 1) /
         compute_details_.workgroup_size;
@@ -172,107 +272,86 @@ void Application::Renderer::ComputeTonemapping(VkCommandBuffer& cmd,
                        sizeof(ComputePushConstantData), &pc_data);
     vkCmdDispatch(cmd, num_groups, 1, 1);
 
-    // 5b: Update parameters
+    // 4b: Update parameters
     illuminance_size = num_groups;
     std::swap(current_input, current_output);
 
-    // 5c: Before reducing again, add barriers for the swap
+    // 4c: Before reducing again, add barriers for the swap
     if (illuminance_size > 1) {
       VkBufferMemoryBarrier barriers[2];
       barriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
       barriers[0].pNext = nullptr;
       barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
       barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-      barriers[0].srcQueueFamilyIndex =
-          queue_family_indices_.graphics_queue_index_.value();
-      barriers[0].dstQueueFamilyIndex =
-          queue_family_indices_.graphics_queue_index_.value();
+      barriers[0].srcQueueFamilyIndex = compute_family;
+      barriers[0].dstQueueFamilyIndex = compute_family;
       barriers[0].offset = 0;
       barriers[0].buffer =
-          illuminance_buffers_[swapchain_image_i][current_input];
+          illuminance_buffers_[frame_i][current_input];
       barriers[0].size = VK_WHOLE_SIZE;
 
       barriers[1].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
       barriers[1].pNext = nullptr;
       barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
       barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-      barriers[1].srcQueueFamilyIndex =
-          queue_family_indices_.graphics_queue_index_.value();
-      barriers[1].dstQueueFamilyIndex =
-          queue_family_indices_.graphics_queue_index_.value();
+      barriers[1].srcQueueFamilyIndex = compute_family;
+      barriers[1].dstQueueFamilyIndex = compute_family;
       barriers[1].offset = 0;
       barriers[1].buffer =
-          illuminance_buffers_[swapchain_image_i][current_output];
+          illuminance_buffers_[frame_i][current_output];
       barriers[1].size = VK_WHOLE_SIZE;
       vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
                            2, barriers, 0, nullptr);
     }
   }
-  // Step 6: Wait for Reduce Illumination Computation
+  // Step 5: Release the reduction result to the graphics queue, the next frame
+  // copies it into its Tonemapping Uniform Buffer
   VkBufferMemoryBarrier buff_barrier2{};
   buff_barrier2.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
   buff_barrier2.pNext = nullptr;
   buff_barrier2.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  buff_barrier2.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  buff_barrier2.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  buff_barrier2.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
+  buff_barrier2.dstAccessMask = 0;
+  buff_barrier2.srcQueueFamilyIndex = compute_family;
+  buff_barrier2.dstQueueFamilyIndex = graphics_family;
   buff_barrier2.offset = 0;
-  buff_barrier2.buffer = illuminance_buffers_[swapchain_image_i][current_input];
+  buff_barrier2.buffer = illuminance_buffers_[frame_i][current_input];
   buff_barrier2.size = VK_WHOLE_SIZE;
   vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1,
                        &buff_barrier2, 0, nullptr);
-  // Step 7: Populate Tonemapping Uniform Buffer fields other than Log Illuminance Sum
-  void* tonemap_data;
-  TonemappingUniform tonemap_uniform = details.tonemap_uniform;
-  tonemap_uniform.num_pixels = num_pixels;
-  vkMapMemory(device_, hdr_tonemapping_memory_[swapchain_image_i], 0, VK_WHOLE_SIZE, 0, &tonemap_data);
-  memcpy(tonemap_data, &tonemap_uniform, sizeof(tonemap_uniform));
-  vkUnmapMemory(device_, hdr_tonemapping_memory_[swapchain_image_i]);
-  // Step 8: Directly copy Log Illuminance Sum from compute result
-  VkBufferCopy buffer_cp{};
-  buffer_cp.size = sizeof(float);
-  buffer_cp.srcOffset = 0;
-  buffer_cp.dstOffset = offsetof(TonemappingUniform,log_illuminance_sum);
-  vkCmdCopyBuffer(cmd, illuminance_buffers_[swapchain_image_i][current_input],
-                  hdr_tonemapping_buffers_[swapchain_image_i], 1, &buffer_cp);
-  // Step 9: Barriers to ensure descriptors are in correct state before HDR pass
-  VkImageMemoryBarrier hdr_barrier{};
-  hdr_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  hdr_barrier.pNext = nullptr;
-  hdr_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-  hdr_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  hdr_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  hdr_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  hdr_barrier.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  hdr_barrier.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  hdr_barrier.image = hdr_images_[swapchain_image_i];
-  hdr_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  hdr_barrier.subresourceRange.baseMipLevel = 0;
-  hdr_barrier.subresourceRange.levelCount = 1;
-  hdr_barrier.subresourceRange.baseArrayLayer = 0;
-  hdr_barrier.subresourceRange.layerCount = 1;
+  illuminance_result_buffers_[frame_i] = current_input;
 
-  VkBufferMemoryBarrier tone_barrier{};
-  tone_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-  tone_barrier.pNext = nullptr;
-  tone_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  tone_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  tone_barrier.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  tone_barrier.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  tone_barrier.offset = 0;
-  tone_barrier.buffer = hdr_tonemapping_buffers_[swapchain_image_i];
-  tone_barrier.size = VK_WHOLE_SIZE;
-  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                       VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &tone_barrier, 1,
-                       &hdr_barrier);
+  VkResult end_result = vkEndCommandBuffer(cmd);
+  ASSERT(end_result == VK_SUCCESS,
+         "Failed to finish recording compute command buffer!");
+
+  // Wait for the graphics submission of this frame, which produced the HDR
+  // copy, and signal the same value on the compute timeline
+  uint64_t timeline_value = frame_timeline_values_[frame_i];
+  VkTimelineSemaphoreSubmitInfo timeline_si{};
+  timeline_si.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_si.pNext = nullptr;
+  timeline_si.waitSemaphoreValueCount = 1;
+  timeline_si.pWaitSemaphoreValues = &timeline_value;
+  timeline_si.signalSemaphoreValueCount = 1;
+  timeline_si.pSignalSemaphoreValues = &timeline_value;
+
+  VkPipelineStageFlags semaphore_wait_stages =
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  VkSubmitInfo cmd_si{};
+  cmd_si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  cmd_si.pNext = &timeline_si;
+  cmd_si.waitSemaphoreCount = 1;
+  cmd_si.pWaitSemaphores = &frame_timeline_semaphore_;
+  cmd_si.pWaitDstStageMask = &semaphore_wait_stages;
+  cmd_si.commandBufferCount = 1;
+  cmd_si.pCommandBuffers = &cmd;
+  cmd_si.signalSemaphoreCount = 1;
+  cmd_si.pSignalSemaphores = &compute_timeline_semaphore_;
+  vkQueueSubmit(compute_queue_, 1, &cmd_si, VK_NULL_HANDLE);
+
+  exposure_timeline_value_ = timeline_value;
+  exposure_frame_ = frame_i;
 }
-}  // namespace catalyst
\ No newline at end of file
+}  // namespace catalyst
@@ -0,0 +1,235 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateMemoryPools() {
+  memory_pools_.clear();
+  memory_pools_.resize(2 * mem_props_.memoryTypeCount);
+  memory_category_bytes_.assign(kMemoryCategoryCount, 0);
+  memory_category_peak_bytes_.assign(kMemoryCategoryCount, 0);
+  memory_usage_peak_bytes_ = 0;
+}
+void Application::Renderer::DestroyMemoryPools() {
+  for (std::vector<MemoryBlock>& pool : memory_pools_) {
+    for (MemoryBlock& block : pool) {
+      if (block.mapped != nullptr) vkUnmapMemory(device_, block.memory);
+      vkFreeMemory(device_, block.memory, nullptr);
+    }
+  }
+  memory_pools_.clear();
+}
+void Application::Renderer::AllocateMemory(
+    MemoryAllocation& allocation, MemoryCategory category,
+    const VkMemoryRequirements& mem_reqs,
+    const VkMemoryPropertyFlags req_props,
+    const VkMemoryPropertyFlags preferred_props, bool image) {
+  uint32_t mem_index = 0;
+  if (!FindMemoryType(mem_reqs, req_props | preferred_props, mem_index))
+    mem_index = SelectMemoryType(mem_reqs, req_props);
+  uint32_t pool_i = 2 * mem_index + (image ? 1 : 0);
+  std::vector<MemoryBlock>& pool = memory_pools_[pool_i];
+  VkDeviceSize alignment = std::max<VkDeviceSize>(mem_reqs.alignment, 1);
+  bool dedicated = mem_reqs.size > kMemoryBlockSize / 2;
+
+  // Step 1: First fit in the existing blocks
+  int32_t block_i = -1;
+  VkDeviceSize range_offset = 0;
+  VkDeviceSize offset = 0;
+  for (uint32_t pool_block_i = 0; !dedicated && pool_block_i < pool.size();
+       pool_block_i++) {
+    if (pool[pool_block_i].dedicated) continue;
+    for (const auto& range : pool[pool_block_i].free_ranges) {
+      VkDeviceSize aligned_offset =
+          (range.first + alignment - 1) / alignment * alignment;
+      if (aligned_offset + mem_reqs.size <= range.first + range.second) {
+        block_i = static_cast<int32_t>(pool_block_i);
+        range_offset = range.first;
+        offset = aligned_offset;
+        break;
+      }
+    }
+    if (block_i >= 0) break;
+  }
+
+  // Step 2: Allocate a new block if none has room
+  if (block_i < 0) {
+    MemoryBlock block;
+    block.size = dedicated ? mem_reqs.size : kMemoryBlockSize;
+    block.mapped = nullptr;
+    block.allocation_count = 0;
+    block.dedicated = dedicated;
+    block.free_ranges[0] = block.size;
+    VkMemoryAllocateInfo memory_ai{};
+    memory_ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memory_ai.pNext = nullptr;
+    memory_ai.allocationSize = block.size;
+    memory_ai.memoryTypeIndex = mem_index;
+    VkResult alloc_result =
+        vkAllocateMemory(device_, &memory_ai, nullptr, &block.memory);
+    ASSERT(alloc_result == VK_SUCCESS, "Failed to allocate memory!");
+    // Host visible blocks stay mapped for their whole lifetime
+    if (mem_props_.memoryTypes[mem_index].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+      VkResult map_result = vkMapMemory(device_, block.memory, 0,
+                                        VK_WHOLE_SIZE, 0, &block.mapped);
+      ASSERT(map_result == VK_SUCCESS, "Failed to map memory!");
+    }
+    block_i = static_cast<int32_t>(pool.size());
+    pool.push_back(block);
+    range_offset = 0;
+    offset = 0;
+    UpdateMemoryUsagePeak();
+  }
+
+  // Step 3: Split the free range around the allocation
+  MemoryBlock& block = pool[block_i];
+  VkDeviceSize range_end = range_offset + block.free_ranges[range_offset];
+  block.free_ranges.erase(range_offset);
+  if (offset > range_offset)
+    block.free_ranges[range_offset] = offset - range_offset;
+  if (offset + mem_reqs.size < range_end)
+    block.free_ranges[offset + mem_reqs.size] =
+        range_end - offset - mem_reqs.size;
+  block.allocation_count++;
+
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.size = mem_reqs.size;
+  allocation.mapped = block.mapped != nullptr
+                          ? static_cast<char*>(block.mapped) + offset
+                          : nullptr;
+  allocation.pool_i = pool_i;
+  allocation.category = category;
+  uint32_t category_i = static_cast<uint32_t>(category);
+  memory_category_bytes_[category_i] += mem_reqs.size;
+  memory_category_peak_bytes_[category_i] =
+      std::max(memory_category_peak_bytes_[category_i],
+               memory_category_bytes_[category_i]);
+}
+void Application::Renderer::FreeMemory(MemoryAllocation& allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) return;
+  std::vector<MemoryBlock>& pool = memory_pools_[allocation.pool_i];
+  auto block = std::find_if(pool.begin(), pool.end(),
+                            [&allocation](const MemoryBlock& pool_block) {
+                              return pool_block.memory == allocation.memory;
+                            });
+  ASSERT(block != pool.end(), "Freed memory does not belong to its pool!");
+
+  // Merge the range with its free neighbours
+  VkDeviceSize offset = allocation.offset;
+  VkDeviceSize size = allocation.size;
+  auto next = block->free_ranges.lower_bound(offset);
+  if (next != block->free_ranges.end() && next->first == offset + size) {
+    size += next->second;
+    next = block->free_ranges.erase(next);
+  }
+  if (next != block->free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      block->free_ranges.erase(prev);
+    }
+  }
+  block->free_ranges[offset] = size;
+  block->allocation_count--;
+  memory_category_bytes_[static_cast<uint32_t>(allocation.category)] -=
+      allocation.size;
+  allocation = MemoryAllocation();
+
+  // Keep one empty block per pool around, so resources recreated together
+  // (eg. on swapchain recreation) do not reallocate device memory
+  if (block->allocation_count > 0) return;
+  bool spare_block = std::any_of(
+      pool.begin(), pool.end(), [&block](const MemoryBlock& pool_block) {
+        return &pool_block != &*block && !pool_block.dedicated &&
+               pool_block.allocation_count == 0;
+      });
+  if (block->dedicated || spare_block) {
+    if (block->mapped != nullptr) vkUnmapMemory(device_, block->memory);
+    vkFreeMemory(device_, block->memory, nullptr);
+    pool.erase(block);
+  }
+}
+void* Application::Renderer::MapMemory(const MemoryAllocation& allocation) {
+  ASSERT(allocation.mapped != nullptr, "Memory is not host visible!");
+  return allocation.mapped;
+}
+Application::MemoryStatistics Application::Renderer::GetMemoryStatistics()
+    const {
+  MemoryStatistics statistics{};
+  VkDeviceSize free_bytes = 0;
+  VkDeviceSize largest_free_bytes = 0;
+  for (uint32_t pool_i = 0; pool_i < memory_pools_.size(); pool_i++) {
+    for (const MemoryBlock& block : memory_pools_[pool_i]) {
+      statistics.block_count++;
+      statistics.allocation_count += block.allocation_count;
+      statistics.block_bytes += block.size;
+      VkDeviceSize largest_range = 0;
+      for (const auto& range : block.free_ranges) {
+        free_bytes += range.second;
+        largest_range = std::max(largest_range, range.second);
+      }
+      largest_free_bytes += largest_range;
+    }
+  }
+  statistics.used_bytes = statistics.block_bytes - free_bytes;
+  statistics.fragmentation =
+      free_bytes > 0 ? 1.0f - static_cast<float>(largest_free_bytes) /
+                                  static_cast<float>(free_bytes)
+                     : 0.0f;
+  for (uint32_t category_i = 0; category_i < kMemoryCategoryCount;
+       category_i++) {
+    statistics.category_bytes[category_i] = memory_category_bytes_[category_i];
+    statistics.category_peak_bytes[category_i] =
+        memory_category_peak_bytes_[category_i];
+  }
+
+  GetDeviceMemoryUsage(statistics.usage_bytes, statistics.budget_bytes);
+  statistics.peak_usage_bytes =
+      std::max<uint64_t>(memory_usage_peak_bytes_, statistics.usage_bytes);
+  return statistics;
+}
+void Application::Renderer::GetDeviceMemoryUsage(
+    uint64_t& usage_bytes, uint64_t& budget_bytes) const {
+  usage_bytes = 0;
+  budget_bytes = 0;
+  std::vector<VkDeviceSize> heap_block_bytes(mem_props_.memoryHeapCount, 0);
+  for (uint32_t pool_i = 0; pool_i < memory_pools_.size(); pool_i++) {
+    uint32_t heap_i = mem_props_.memoryTypes[pool_i / 2].heapIndex;
+    for (const MemoryBlock& block : memory_pools_[pool_i])
+      heap_block_bytes[heap_i] += block.size;
+  }
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props{};
+  budget_props.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  budget_props.pNext = nullptr;
+  VkPhysicalDeviceMemoryProperties2 mem_props2{};
+  mem_props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  mem_props2.pNext = memory_budget_supported_ ? &budget_props : nullptr;
+  vkGetPhysicalDeviceMemoryProperties2(physical_device_, &mem_props2);
+  for (uint32_t heap_i = 0; heap_i < mem_props_.memoryHeapCount; heap_i++) {
+    if (!(mem_props_.memoryHeaps[heap_i].flags &
+          VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+      continue;
+    if (memory_budget_supported_) {
+      budget_bytes += budget_props.heapBudget[heap_i];
+      usage_bytes += budget_props.heapUsage[heap_i];
+    } else {
+      budget_bytes += mem_props_.memoryHeaps[heap_i].size;
+      usage_bytes += heap_block_bytes[heap_i];
+    }
+  }
+}
+void Application::Renderer::UpdateMemoryUsagePeak() {
+  uint64_t usage_bytes = 0;
+  uint64_t budget_bytes = 0;
+  GetDeviceMemoryUsage(usage_bytes, budget_bytes);
+  memory_usage_peak_bytes_ =
+      std::max<VkDeviceSize>(memory_usage_peak_bytes_, usage_bytes);
+}
+}  // namespace catalyst
@@ -0,0 +1,376 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateMipmapResources() {
+  if (!storage_write_without_format_supported_) return;
+  VkDescriptorSetLayoutBinding src_binding{};
+  src_binding.binding = 0;
+  src_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  src_binding.descriptorCount = 1;
+  src_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  src_binding.pImmutableSamplers = nullptr;
+  VkDescriptorSetLayoutBinding dst_binding{};
+  dst_binding.binding = 1;
+  dst_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  dst_binding.descriptorCount = 1;
+  dst_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  dst_binding.pImmutableSamplers = nullptr;
+  VkDescriptorSetLayoutBinding bindings[] = {src_binding, dst_binding};
+  VkDescriptorSetLayoutCreateInfo set_layout_ci{};
+  set_layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  set_layout_ci.pNext = nullptr;
+  set_layout_ci.flags = 0;
+  set_layout_ci.bindingCount = 2;
+  set_layout_ci.pBindings = bindings;
+  VkResult create_result = vkCreateDescriptorSetLayout(
+      device_, &set_layout_ci, nullptr, &mipmap_descriptor_set_layout_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Failed to create mipmap descriptor set layout!");
+
+  // Sets live as long as the upload batch that generates the mip chain
+  VkDescriptorPoolSize sampler_size;
+  sampler_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  sampler_size.descriptorCount = kMipmapDescriptorSetCount;
+  VkDescriptorPoolSize storage_size;
+  storage_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  storage_size.descriptorCount = kMipmapDescriptorSetCount;
+  VkDescriptorPoolSize pool_sizes[] = {sampler_size, storage_size};
+  VkDescriptorPoolCreateInfo pool_ci{};
+  pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_ci.pNext = nullptr;
+  pool_ci.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+  pool_ci.maxSets = kMipmapDescriptorSetCount;
+  pool_ci.poolSizeCount = 2;
+  pool_ci.pPoolSizes = pool_sizes;
+  create_result = vkCreateDescriptorPool(device_, &pool_ci, nullptr,
+                                         &mipmap_descriptor_pool_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Failed to create mipmap descriptor pool!");
+
+  VkPushConstantRange push_constant{};
+  push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant.offset = 0;
+  push_constant.size = sizeof(MipmapPushConstantData);
+  VkPipelineLayoutCreateInfo layout_ci{};
+  layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layout_ci.pNext = nullptr;
+  layout_ci.flags = 0;
+  layout_ci.pushConstantRangeCount = 1;
+  layout_ci.pPushConstantRanges = &push_constant;
+  layout_ci.setLayoutCount = 1;
+  layout_ci.pSetLayouts = &mipmap_descriptor_set_layout_;
+  create_result = vkCreatePipelineLayout(device_, &layout_ci, nullptr,
+                                         &mipmap_pipeline_layout_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Could not create mipmap pipeline layout!");
+
+  const std::vector<char> shader_code =
+      ReadFile("../assets/shaders/downsample_mipmap.comp.spv");
+  VkShaderModule shader = CreateShaderModule(shader_code);
+  VkPipelineShaderStageCreateInfo shader_ci{};
+  shader_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shader_ci.pNext = nullptr;
+  shader_ci.flags = 0;
+  shader_ci.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  shader_ci.module = shader;
+  shader_ci.pName = "main";
+  shader_ci.pSpecializationInfo = nullptr;
+  VkComputePipelineCreateInfo pipeline_ci{};
+  pipeline_ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_ci.pNext = nullptr;
+  pipeline_ci.flags = 0;
+  pipeline_ci.stage = shader_ci;
+  pipeline_ci.layout = mipmap_pipeline_layout_;
+  pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_ci.basePipelineIndex = 0;
+  create_result = vkCreateComputePipelines(
+      device_, pipeline_cache_, 1, &pipeline_ci, nullptr, &mipmap_pipeline_);
+  ASSERT(create_result == VK_SUCCESS, "Could not create mipmap pipeline!");
+  vkDestroyShaderModule(device_, shader, nullptr);
+}
+void Application::Renderer::DestroyMipmapResources() {
+  if (!storage_write_without_format_supported_) return;
+  vkDestroyPipeline(device_, mipmap_pipeline_, nullptr);
+  vkDestroyPipelineLayout(device_, mipmap_pipeline_layout_, nullptr);
+  vkDestroyDescriptorPool(device_, mipmap_descriptor_pool_, nullptr);
+  vkDestroyDescriptorSetLayout(device_, mipmap_descriptor_set_layout_,
+                               nullptr);
+}
+bool Application::Renderer::IsMipmapBlitSupported(VkFormat format) {
+  VkFormatProperties format_props{};
+  vkGetPhysicalDeviceFormatProperties(physical_device_, format,
+                                      &format_props);
+  VkFormatFeatureFlags blit_features =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (format_props.optimalTilingFeatures & blit_features) == blit_features;
+}
+VkFormat Application::Renderer::GetMipmapStorageFormat(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return VK_FORMAT_R8G8B8A8_UNORM;
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      return VK_FORMAT_B8G8R8A8_UNORM;
+    case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+      return VK_FORMAT_A8B8G8R8_UNORM_PACK32;
+    default:
+      return format;
+  }
+}
+bool Application::Renderer::IsMipmapComputeSupported(VkFormat format) {
+  if (!storage_write_without_format_supported_) return false;
+  VkFormatProperties format_props{};
+  vkGetPhysicalDeviceFormatProperties(physical_device_, format,
+                                      &format_props);
+  VkFormatProperties storage_props{};
+  vkGetPhysicalDeviceFormatProperties(
+      physical_device_, GetMipmapStorageFormat(format), &storage_props);
+  return (format_props.optimalTilingFeatures &
+          VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+         (storage_props.optimalTilingFeatures &
+          VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+}
+void Application::Renderer::GetMipmapImageFlags(VkFormat format,
+                                                VkImageCreateFlags& flags,
+                                                VkImageUsageFlags& usage) {
+  if (IsMipmapBlitSupported(format)) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    return;
+  }
+  ASSERT(IsMipmapComputeSupported(format),
+         "Format does not support mipmap generation!");
+  usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+  // The sRGB format itself usually can't be stored to, its views that are
+  // only sampled leave the storage usage out
+  if (GetMipmapStorageFormat(format) != format) {
+    flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT |
+             VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+  }
+}
+void Application::Renderer::PrepareMipmapChain(MipmapChain& chain,
+                                               UploadBatch& batch) {
+  chain.descriptor_sets.clear();
+  if (chain.mip_levels < 2 || IsMipmapBlitSupported(chain.format)) return;
+  uint32_t set_count = chain.mip_levels - 1;
+  std::vector<VkDescriptorSetLayout> layouts(set_count,
+                                             mipmap_descriptor_set_layout_);
+  VkDescriptorSetAllocateInfo set_ai{};
+  set_ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  set_ai.pNext = nullptr;
+  set_ai.descriptorPool = mipmap_descriptor_pool_;
+  set_ai.descriptorSetCount = set_count;
+  set_ai.pSetLayouts = layouts.data();
+  chain.descriptor_sets.resize(set_count);
+  VkResult alloc_result = vkAllocateDescriptorSets(
+      device_, &set_ai, chain.descriptor_sets.data());
+  ASSERT(alloc_result == VK_SUCCESS,
+         "Failed to allocate mipmap descriptor sets!");
+  batch.descriptor_sets.insert(batch.descriptor_sets.end(),
+                               chain.descriptor_sets.begin(),
+                               chain.descriptor_sets.end());
+
+  // Level i is sampled to write level i + 1
+  std::vector<VkImageView> src_views(set_count);
+  std::vector<VkImageView> dst_views(set_count);
+  VkImageViewUsageCreateInfo view_usage_ci{};
+  view_usage_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+  view_usage_ci.pNext = nullptr;
+  for (uint32_t mip_i = 0; mip_i < chain.mip_levels; mip_i++) {
+    VkImageViewCreateInfo view_ci{};
+    view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_ci.pNext = &view_usage_ci;
+    view_ci.flags = 0;
+    view_ci.image = chain.image;
+    view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    view_ci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_ci.subresourceRange.baseMipLevel = mip_i;
+    view_ci.subresourceRange.levelCount = 1;
+    view_ci.subresourceRange.baseArrayLayer = 0;
+    view_ci.subresourceRange.layerCount = chain.array_layers;
+    if (mip_i + 1 < chain.mip_levels) {
+      view_ci.format = chain.format;
+      view_usage_ci.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+      VkResult create_result =
+          vkCreateImageView(device_, &view_ci, nullptr, &src_views[mip_i]);
+      ASSERT(create_result == VK_SUCCESS, "Failed to create image view!");
+      batch.image_views.push_back(src_views[mip_i]);
+    }
+    if (mip_i > 0) {
+      view_ci.format = GetMipmapStorageFormat(chain.format);
+      view_usage_ci.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+      VkResult create_result =
+          vkCreateImageView(device_, &view_ci, nullptr, &dst_views[mip_i - 1]);
+      ASSERT(create_result == VK_SUCCESS, "Failed to create image view!");
+      batch.image_views.push_back(dst_views[mip_i - 1]);
+    }
+  }
+
+  std::vector<VkDescriptorImageInfo> image_infos(2 * set_count);
+  std::vector<VkWriteDescriptorSet> set_wis(2 * set_count);
+  for (uint32_t set_i = 0; set_i < set_count; set_i++) {
+    VkDescriptorImageInfo& src_info = image_infos[2 * set_i];
+    src_info.sampler = texture_sampler_;
+    src_info.imageView = src_views[set_i];
+    src_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkDescriptorImageInfo& dst_info = image_infos[2 * set_i + 1];
+    dst_info.sampler = VK_NULL_HANDLE;
+    dst_info.imageView = dst_views[set_i];
+    dst_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    for (uint32_t binding_i = 0; binding_i < 2; binding_i++) {
+      VkWriteDescriptorSet& set_wi = set_wis[2 * set_i + binding_i];
+      set_wi.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      set_wi.pNext = nullptr;
+      set_wi.dstSet = chain.descriptor_sets[set_i];
+      set_wi.dstBinding = binding_i;
+      set_wi.dstArrayElement = 0;
+      set_wi.descriptorCount = 1;
+      set_wi.descriptorType = binding_i == 0
+                                  ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                  : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      set_wi.pBufferInfo = nullptr;
+      set_wi.pImageInfo = &image_infos[2 * set_i + binding_i];
+    }
+  }
+  vkUpdateDescriptorSets(device_, static_cast<uint32_t>(set_wis.size()),
+                         set_wis.data(), 0, nullptr);
+}
+void Application::Renderer::CmdGenerateMipmaps(VkCommandBuffer& cmd,
+                                               const MipmapChain& chain) {
+  // Expects every level in TRANSFER_SRC_OPTIMAL with the base level written,
+  // each level is then downsampled from the one above it. Leaves the image
+  // in SHADER_READ_ONLY_OPTIMAL for the fragment shader.
+  if (chain.descriptor_sets.empty())
+    CmdBlitMipmaps(cmd, chain);
+  else
+    CmdDownsampleMipmaps(cmd, chain);
+}
+void Application::Renderer::CmdBlitMipmaps(VkCommandBuffer& cmd,
+                                           const MipmapChain& chain) {
+  VkImageMemoryBarrier image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  image_barrier.pNext = nullptr;
+  image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.image = chain.image;
+  image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.layerCount = chain.array_layers;
+  image_barrier.subresourceRange.levelCount = 1;
+  int32_t mip_width = static_cast<int32_t>(chain.extent.width);
+  int32_t mip_height = static_cast<int32_t>(chain.extent.height);
+  for (uint32_t mip_i = 1; mip_i < chain.mip_levels; mip_i++) {
+    image_barrier.subresourceRange.baseMipLevel = mip_i;
+    image_barrier.srcAccessMask = 0;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &image_barrier);
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0] = {0, 0, 0};
+    blit.srcOffsets[1] = {mip_width, mip_height, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = chain.array_layers;
+    blit.srcSubresource.mipLevel = mip_i - 1;
+    mip_width = std::max(mip_width / 2, 1);
+    mip_height = std::max(mip_height / 2, 1);
+    blit.dstOffsets[0] = {0, 0, 0};
+    blit.dstOffsets[1] = {mip_width, mip_height, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = chain.array_layers;
+    blit.dstSubresource.mipLevel = mip_i;
+    vkCmdBlitImage(cmd, chain.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   chain.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &image_barrier);
+  }
+  CmdTransitionImageLayout(
+      cmd, chain.image, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT);
+}
+void Application::Renderer::CmdDownsampleMipmaps(VkCommandBuffer& cmd,
+                                                 const MipmapChain& chain) {
+  VkImageMemoryBarrier image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  image_barrier.pNext = nullptr;
+  image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.image = chain.image;
+  image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.layerCount = chain.array_layers;
+  image_barrier.subresourceRange.baseMipLevel = 0;
+  image_barrier.subresourceRange.levelCount = 1;
+  image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &image_barrier);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap_pipeline_);
+  MipmapPushConstantData pc_data{};
+  pc_data.src_extent = glm::ivec2(chain.extent.width, chain.extent.height);
+  pc_data.srgb = GetMipmapStorageFormat(chain.format) != chain.format;
+  for (uint32_t mip_i = 1; mip_i < chain.mip_levels; mip_i++) {
+    image_barrier.subresourceRange.baseMipLevel = mip_i;
+    image_barrier.srcAccessMask = 0;
+    image_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &image_barrier);
+
+    glm::ivec2 dst_extent = glm::max(pc_data.src_extent / 2, glm::ivec2(1));
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            mipmap_pipeline_layout_, 0, 1,
+                            &chain.descriptor_sets[mip_i - 1], 0, nullptr);
+    vkCmdPushConstants(cmd, mipmap_pipeline_layout_,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(MipmapPushConstantData), &pc_data);
+    vkCmdDispatch(cmd, (dst_extent.x + 7) / 8, (dst_extent.y + 7) / 8,
+                  chain.array_layers);
+    pc_data.src_extent = dst_extent;
+
+    image_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &image_barrier);
+  }
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.pNext = nullptr;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier,
+                       0, nullptr, 0, nullptr);
+}
+}  // namespace catalyst
@@ -0,0 +1,134 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateRecordingResources() {
+  uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  recording_thread_pool_ = new ThreadPool(thread_count);
+
+  // Command pools are externally synchronized, so every worker thread gets its
+  // own pool for each frame in flight
+  VkCommandPoolCreateInfo command_pool_ci{};
+  command_pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  command_pool_ci.pNext = nullptr;
+  command_pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  command_pool_ci.queueFamilyIndex =
+      queue_family_indices_.graphics_queue_index_.value();
+  recording_contexts_.resize(frame_count_);
+  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
+    recording_contexts_[frame_i].resize(thread_count);
+    for (uint32_t thread_i = 0; thread_i < thread_count; thread_i++) {
+      RecordingContext& context = recording_contexts_[frame_i][thread_i];
+      VkResult create_result = vkCreateCommandPool(
+          device_, &command_pool_ci, nullptr, &context.command_pool);
+      ASSERT(create_result == VK_SUCCESS,
+             "Failed to create recording command pool!");
+      context.used_command_buffers = 0;
+    }
+  }
+}
+void Application::Renderer::DestroyRecordingResources() {
+  delete recording_thread_pool_;
+  recording_thread_pool_ = nullptr;
+  for (std::vector<RecordingContext>& frame_contexts : recording_contexts_) {
+    for (RecordingContext& context : frame_contexts) {
+      // Destroying the pool frees its command buffers
+      vkDestroyCommandPool(device_, context.command_pool, nullptr);
+      context.command_buffers.clear();
+    }
+  }
+  recording_contexts_.clear();
+}
+VkCommandBuffer Application::Renderer::AcquireSecondaryCommandBuffer(
+    uint32_t frame_i, uint32_t thread_i) {
+  RecordingContext& context = recording_contexts_[frame_i][thread_i];
+  if (context.used_command_buffers == context.command_buffers.size()) {
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.pNext = nullptr;
+    alloc_info.commandPool = context.command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    alloc_info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer;
+    VkResult alloc_result =
+        vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
+    ASSERT(alloc_result == VK_SUCCESS,
+           "Failed to allocate secondary command buffer!");
+    context.command_buffers.push_back(command_buffer);
+  }
+  return context.command_buffers[context.used_command_buffers++];
+}
+void Application::Renderer::RecordScenePasses(VkCommandBuffer& cmd,
+                                              uint32_t frame_i,
+                                              std::vector<ScenePass>& passes,
+                                              bool parallel) {
+  if (!parallel) {
+    for (ScenePass& pass : passes) {
+      CmdScenePassBarriers(cmd, pass);
+      if (pass.begin) pass.begin(cmd, VK_SUBPASS_CONTENTS_INLINE);
+      pass.record(cmd);
+      if (pass.begin) vkCmdEndRenderPass(cmd);
+    }
+    return;
+  }
+
+  // The frame's previous submission has completed, so its secondary command
+  // buffers can be recycled
+  for (RecordingContext& context : recording_contexts_[frame_i]) {
+    vkResetCommandPool(device_, context.command_pool, 0);
+    context.used_command_buffers = 0;
+  }
+
+  std::vector<VkCommandBuffer> secondary_cmds(passes.size());
+  for (uint32_t pass_i = 0; pass_i < passes.size(); pass_i++) {
+    recording_thread_pool_->Submit([this, frame_i, pass_i, &passes,
+                                    &secondary_cmds](uint32_t thread_i) {
+      ScenePass& pass = passes[pass_i];
+      VkCommandBuffer secondary_cmd =
+          AcquireSecondaryCommandBuffer(frame_i, thread_i);
+
+      VkCommandBufferInheritanceInfo inheritance_info{};
+      inheritance_info.sType =
+          VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance_info.pNext = nullptr;
+      inheritance_info.renderPass = pass.render_pass;
+      inheritance_info.subpass = 0;
+      inheritance_info.framebuffer = pass.framebuffer;
+      inheritance_info.occlusionQueryEnable = VK_FALSE;
+
+      VkCommandBufferBeginInfo cmd_bi{};
+      cmd_bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      cmd_bi.pNext = nullptr;
+      cmd_bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      if (pass.render_pass != VK_NULL_HANDLE)
+        cmd_bi.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      cmd_bi.pInheritanceInfo = &inheritance_info;
+      VkResult begin_result = vkBeginCommandBuffer(secondary_cmd, &cmd_bi);
+      ASSERT(begin_result == VK_SUCCESS,
+             "Failed to begin recording secondary command buffer!");
+
+      pass.record(secondary_cmd);
+
+      VkResult end_result = vkEndCommandBuffer(secondary_cmd);
+      ASSERT(end_result == VK_SUCCESS,
+             "Failed to finish recording secondary command buffer!");
+      secondary_cmds[pass_i] = secondary_cmd;
+    });
+  }
+  recording_thread_pool_->Wait();
+
+  // Stitch the secondary command buffers together in pass order
+  for (uint32_t pass_i = 0; pass_i < passes.size(); pass_i++) {
+    ScenePass& pass = passes[pass_i];
+    CmdScenePassBarriers(cmd, pass);
+    if (pass.begin)
+      pass.begin(cmd, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(cmd, 1, &secondary_cmds[pass_i]);
+    if (pass.begin) vkCmdEndRenderPass(cmd);
+  }
+}
+}  // namespace catalyst
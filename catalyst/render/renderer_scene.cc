@@ -1,5 +1,8 @@
 #include <catalyst/render/renderer.h>
 
+#include <algorithm>
+#include <iostream>
+
 #include <glm/gtx/transform.hpp>
 
 #include <catalyst/scene/scene.h>
@@ -22,10 +25,21 @@ size_t Application::Renderer::MaterialUniformBlock::GetSize() {
          sizeof(uint32_t);
 }
 void Application::Renderer::LoadScene(const Scene& scene) {
+  // Geometry of the previous scene is released once its frames complete
+  for (uint32_t mesh_i = 0;
+       mesh_i < scene_resource_details_.meshes_.size(); mesh_i++) {
+    for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+      FreeGeometry(vertex_geometries_[format_i], mesh_i);
+      FreeGeometry(position_geometries_[format_i], mesh_i);
+    }
+    FreeGeometry(index_geometry_, mesh_i);
+  }
   scene_ = &scene;
   scene_resource_details_ = {0};
-  scene_resource_details_.vertex_offsets_.clear();
-  scene_resource_details_.index_offsets_.clear();
+  scene_resource_details_.meshes_.clear();
+  // Images still decoding for the previous scene are dropped
+  decode_generation_++;
+  cubemap_faces_.clear();
   LoadSceneResources();
 }
 void Application::Renderer::LoadSceneResources() {
@@ -34,129 +48,444 @@ void Application::Renderer::LoadSceneResources() {
   LoadCubemaps();
 }
 void Application::Renderer::LoadMeshes() {
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    RetireGeometryRanges(vertex_geometries_[format_i]);
+    RetireGeometryRanges(position_geometries_[format_i]);
+  }
+  RetireGeometryRanges(index_geometry_);
   uint32_t mesh_count = static_cast<uint32_t>(scene_->meshes_.size());
-  if (scene_resource_details_.mesh_count == mesh_count) return;
-  VkCommandBuffer cmd;
-  BeginSingleUseCommandBuffer(cmd);
-  VkBuffer vertex_staging_buffer;
-  VkDeviceMemory vertex_staging_memory;
-  VkBuffer index_staging_buffer;
-  VkDeviceMemory index_staging_memory;
-  uint32_t vertex_buffer_size = 0;
-  uint32_t index_buffer_size = 0;
-  for (uint32_t mesh_i = scene_resource_details_.mesh_count;
-       mesh_i < mesh_count; mesh_i++) {
+  std::vector<const Mesh*>& loaded_meshes = scene_resource_details_.meshes_;
+  // Meshes replaced since their upload release their old ranges
+  std::vector<uint32_t> upload_meshes;
+  std::array<std::vector<uint32_t>, kVertexFormatCount> format_meshes;
+  std::array<uint32_t, kVertexFormatCount> vertex_counts{};
+  uint32_t index_count = 0;
+  for (uint32_t mesh_i = 0; mesh_i < mesh_count; mesh_i++) {
     const Mesh* mesh = scene_->meshes_[mesh_i];
-    uint32_t vertex_size = static_cast<uint32_t>(sizeof(mesh->vertices[0]) *
-                                               mesh->vertices.size());
-    uint32_t index_size =
-        static_cast<uint32_t>(sizeof(mesh->indices[0]) * mesh->indices.size());
-    vertex_buffer_size += vertex_size;
-    index_buffer_size += index_size;
+    if (mesh_i < loaded_meshes.size() && loaded_meshes[mesh_i] == mesh)
+      continue;
+    for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+      FreeGeometry(vertex_geometries_[format_i], mesh_i);
+      FreeGeometry(position_geometries_[format_i], mesh_i);
+    }
+    FreeGeometry(index_geometry_, mesh_i);
+    upload_meshes.push_back(mesh_i);
+    uint32_t format_i = static_cast<uint32_t>(mesh->vertex_format);
+    format_meshes[format_i].push_back(mesh_i);
+    vertex_counts[format_i] += static_cast<uint32_t>(mesh->vertices.size());
+    index_count += static_cast<uint32_t>(mesh->indices.size());
   }
-  CreateBuffer(vertex_staging_buffer, vertex_staging_memory, vertex_buffer_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  CreateBuffer(index_staging_buffer, index_staging_memory, index_buffer_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  void* vertex_data;
-  void* index_data;
-  vkMapMemory(device_, vertex_staging_memory, 0, VK_WHOLE_SIZE, 0, &vertex_data);
-  vkMapMemory(device_, index_staging_memory, 0, VK_WHOLE_SIZE, 0, &index_data);
-  size_t vertex_prefix = scene_resource_details_.vertex_count;
-  size_t vertex_buffer_prefix = 0;
-  size_t index_prefix = scene_resource_details_.index_count;
-  size_t index_buffer_prefix = 0;
-  for (uint32_t mesh_i = scene_resource_details_.mesh_count;
-       mesh_i < mesh_count; mesh_i++) {
-    Mesh* mesh = scene_->meshes_[mesh_i];
-    size_t mesh_vertices = mesh->vertices.size();
-    size_t mesh_indices = mesh->indices.size();
-    size_t mesh_size = sizeof(Vertex) * mesh_vertices;
-    size_t index_size = sizeof(uint32_t) * mesh_indices;
-    memcpy(reinterpret_cast<char*>(vertex_data) + vertex_buffer_prefix, mesh->vertices.data(), mesh_size);
-    memcpy(reinterpret_cast<char*>(index_data) + index_buffer_prefix,
-           mesh->indices.data(), index_size);
-    vertex_buffer_prefix += mesh_size;
-    index_buffer_prefix += index_size;
-    vertex_prefix += mesh_vertices;
-    index_prefix += mesh_indices;
+  if (upload_meshes.empty()) return;
+  loaded_meshes.resize(mesh_count, nullptr);
+  UploadBatch batch;
+  BeginUploadBatch(batch);
+
+  // Step 1: Grow or compact the buffers before allocating, so the ranges
+  // packed by a compaction never overlap the uploads
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    ReserveGeometry(vertex_geometries_[format_i], vertex_counts[format_i],
+                    batch);
+    ReserveGeometry(position_geometries_[format_i], vertex_counts[format_i],
+                    batch);
   }
-  vkUnmapMemory(device_, vertex_staging_memory);
-  VkBufferCopy vertex_buffer_cp{};
-  vertex_buffer_cp.srcOffset = 0;
-  vertex_buffer_cp.dstOffset = sizeof(Vertex)*scene_resource_details_.vertex_count;
-  vertex_buffer_cp.size = vertex_buffer_size;
-  vkCmdCopyBuffer(cmd, vertex_staging_buffer, vertex_buffer_, 1,
-                  &vertex_buffer_cp);
-  VkBufferCopy index_buffer_cp{};
-  index_buffer_cp.srcOffset = 0;
-  index_buffer_cp.dstOffset =
-      sizeof(uint32_t) * scene_resource_details_.index_count;
-  index_buffer_cp.size = index_buffer_size;
-  vkCmdCopyBuffer(cmd, index_staging_buffer, index_buffer_, 1,
-                  &index_buffer_cp);
-  EndSingleUseCommandBuffer(cmd);
-
-  for (uint32_t mesh_i = scene_resource_details_.mesh_count;
-       mesh_i < mesh_count; mesh_i++) {
-    if (mesh_i > 0) {
-      const Mesh* mesh = scene_->meshes_[mesh_i-1];
-      uint32_t mesh_size = static_cast<uint32_t>(mesh->vertices.size());
-      uint32_t index_size = static_cast<uint32_t>(mesh->indices.size());
-      scene_resource_details_.index_offsets_.push_back(
-          scene_resource_details_.index_offsets_.back() + index_size);
-      scene_resource_details_.vertex_offsets_.push_back(
-          scene_resource_details_.vertex_offsets_.back() + mesh_size);
-    } else {
-      scene_resource_details_.vertex_offsets_.push_back(0);
-      scene_resource_details_.index_offsets_.push_back(0);
-    }
+  ReserveGeometry(index_geometry_, index_count, batch);
+  for (uint32_t mesh_i : upload_meshes) {
+    const Mesh* mesh = scene_->meshes_[mesh_i];
+    uint32_t format_i = static_cast<uint32_t>(mesh->vertex_format);
+    uint32_t vertex_count = static_cast<uint32_t>(mesh->vertices.size());
+    AllocateGeometry(vertex_geometries_[format_i], mesh_i, vertex_count);
+    AllocateGeometry(position_geometries_[format_i], mesh_i, vertex_count);
+    AllocateGeometry(index_geometry_, mesh_i,
+                     static_cast<uint32_t>(mesh->indices.size()));
+    loaded_meshes[mesh_i] = mesh;
   }
-  scene_resource_details_.vertex_count = static_cast<uint32_t>(vertex_prefix);
-  scene_resource_details_.index_count = static_cast<uint32_t>(index_prefix);
-  scene_resource_details_.mesh_count =
-      static_cast<uint32_t>(scene_->meshes_.size());
-  vkDestroyBuffer(device_, vertex_staging_buffer, nullptr);
-  vkFreeMemory(device_, vertex_staging_memory, nullptr);
-  vkDestroyBuffer(device_, index_staging_buffer, nullptr);
-  vkFreeMemory(device_, index_staging_memory, nullptr);
+
+  // Step 2: Stage the geometry and copy it into the allocated ranges
+  auto upload = [this, &batch](GeometryBuffer& geometry,
+                               const std::vector<uint32_t>& mesh_ids,
+                               uint32_t count, auto write_mesh_data) {
+    if (count == 0) return;
+    VkBuffer staging_buffer;
+    MemoryAllocation staging_memory;
+    CreateBuffer(staging_buffer, staging_memory, MemoryCategory::kStaging,
+                 geometry.element_size * count,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    char* data = static_cast<char*>(MapMemory(staging_memory));
+    std::vector<VkBufferCopy> copies;
+    VkDeviceSize staging_offset = 0;
+    for (uint32_t mesh_i : mesh_ids) {
+      const GeometryRange& range = geometry.ranges[mesh_i];
+      if (range.count == 0) continue;
+      VkBufferCopy copy{};
+      copy.srcOffset = staging_offset;
+      copy.dstOffset = geometry.element_size * range.offset;
+      copy.size = geometry.element_size * range.count;
+      write_mesh_data(mesh_i, data + staging_offset, copy.size);
+      copies.push_back(copy);
+      staging_offset += copy.size;
+    }
+    vkCmdCopyBuffer(batch.command_buffer, staging_buffer, geometry.buffer,
+                    static_cast<uint32_t>(copies.size()), copies.data());
+    batch.buffers.push_back(staging_buffer);
+    batch.memory.push_back(staging_memory);
+  };
+  const uint32_t float_i = static_cast<uint32_t>(VertexFormat::kFloat);
+  const uint32_t packed_i = static_cast<uint32_t>(VertexFormat::kPacked);
+  upload(vertex_geometries_[float_i], format_meshes[float_i],
+         vertex_counts[float_i],
+         [this](uint32_t mesh_i, char* data, size_t size) {
+           memcpy(data, scene_->meshes_[mesh_i]->vertices.data(), size);
+         });
+  upload(vertex_geometries_[packed_i], format_meshes[packed_i],
+         vertex_counts[packed_i],
+         [this](uint32_t mesh_i, char* data, size_t size) {
+           memcpy(data, scene_->meshes_[mesh_i]->packed_vertices.data(), size);
+         });
+  // The depth only passes read positions from their own stream
+  upload(position_geometries_[float_i], format_meshes[float_i],
+         vertex_counts[float_i],
+         [this](uint32_t mesh_i, char* data, size_t size) {
+           glm::vec3* positions = reinterpret_cast<glm::vec3*>(data);
+           for (const Vertex& vertex : scene_->meshes_[mesh_i]->vertices)
+             *positions++ = vertex.position;
+         });
+  upload(position_geometries_[packed_i], format_meshes[packed_i],
+         vertex_counts[packed_i],
+         [this](uint32_t mesh_i, char* data, size_t size) {
+           for (const PackedVertex& vertex :
+                scene_->meshes_[mesh_i]->packed_vertices) {
+             memcpy(data, vertex.position, sizeof(vertex.position));
+             data += sizeof(vertex.position);
+           }
+         });
+  upload(index_geometry_, upload_meshes, index_count,
+         [this](uint32_t mesh_i, char* data, size_t size) {
+           memcpy(data, scene_->meshes_[mesh_i]->indices.data(), size);
+         });
+  // Frames drawing the new meshes wait on the batch before vertex input
+  SubmitUploadBatch(batch);
+  scene_resource_details_.mesh_count = mesh_count;
 }
 void Application::Renderer::LoadTextures() {
   uint32_t tex_count = static_cast<uint32_t>(scene_->textures_.size());
-  TextureImporter texture_importer;
-  if (scene_resource_details_.texture_count == tex_count) return;
+  std::vector<DecodedImage> decoded = TakeDecodedImages(false);
+  if (scene_resource_details_.texture_count == tex_count && decoded.empty())
+    return;
+  // Normal maps and masks get the two and one channel formats, unless a
+  // material also samples them as color
+  const uint32_t kColorUsage = 1;
+  const uint32_t kNormalUsage = 2;
+  const uint32_t kMaskUsage = 4;
+  std::vector<uint32_t> texture_usage(tex_count, 0);
+  auto add_usage = [&texture_usage, tex_count](int tex_id, uint32_t usage) {
+    if (tex_id >= 0 && tex_id < static_cast<int>(tex_count))
+      texture_usage[tex_id] |= usage;
+  };
+  for (const Material* mat : scene_->materials_) {
+    add_usage(mat->albedo_texture_id_, kColorUsage);
+    add_usage(mat->normal_texture_id_, kNormalUsage);
+    add_usage(mat->metallic_texture_id_, kMaskUsage);
+    add_usage(mat->roughness_texture_id_, kMaskUsage);
+    add_usage(mat->ao_texture_id_, kMaskUsage);
+  }
+  UploadBatch batch;
+  BeginUploadBatch(batch);
   for (uint32_t tex_i = scene_resource_details_.texture_count;
        tex_i < tex_count; tex_i++) {
-    bool read_success =
-        texture_importer.ReadFile(scene_->textures_[tex_i]->path_);
-    ASSERT(read_success, "Could not load texture file!");
-    const TextureData* tex_data = texture_importer.GetData();
-    size_t tex_size =
-        (tex_data->height) * (tex_data->width) * (tex_data->channels);
+    // A texture of a previous scene in the same slot is released once the
+    // frames drawing with it complete, the slot samples the default texture
+    // until the new one is decoded and uploaded
+    if (texture_images_[tex_i] != VK_NULL_HANDLE) {
+      batch.image_views.push_back(texture_image_views_[tex_i]);
+      batch.images.push_back(texture_images_[tex_i]);
+      batch.memory.push_back(texture_memory_[tex_i]);
+      texture_image_views_[tex_i] = VK_NULL_HANDLE;
+      texture_images_[tex_i] = VK_NULL_HANDLE;
+      texture_memory_[tex_i] = MemoryAllocation{};
+    }
+    DecodedImage image{};
+    image.generation = decode_generation_;
+    image.slot = tex_i;
+    image.cubemap = false;
+    image.path = scene_->textures_[tex_i]->path_;
+    image.compression = TextureCompression::kBc7;
+    if (texture_usage[tex_i] == kNormalUsage)
+      image.compression = TextureCompression::kBc5;
+    else if (texture_usage[tex_i] == kMaskUsage)
+      image.compression = TextureCompression::kBc4;
+    image.compressed = texture_compression_supported_;
+    QueueImageDecode(image);
+  }
+  for (const DecodedImage& image : decoded) {
+    // The slot keeps sampling the default texture
+    if (!image.success) {
+      std::cerr << "Could not load texture file: " << image.path << std::endl;
+      continue;
+    }
+    if (image.compressed)
+      LoadCompressedTexture(image.slot, image, batch);
+    else
+      LoadUncompressedTexture(image.slot, image, batch);
+  }
+  texture_descriptors_stale_.assign(frame_count_, true);
+  SubmitUploadBatch(batch);
+  scene_resource_details_.texture_count = tex_count;
+}
+void Application::Renderer::LoadCompressedTexture(uint32_t tex_i,
+                                                  const DecodedImage& image,
+                                                  UploadBatch& batch) {
+  // Mips are cooked ahead of time, so every level is copied as is
+  const CookedTextureData& cooked = image.cooked;
+  size_t tex_size = 0;
+  for (const std::vector<uint8_t>& mip : cooked.mips) tex_size += mip.size();
+  // Staging buffer
+  VkBuffer staging_buffer;
+  MemoryAllocation staging_memory;
+  CreateBuffer(staging_buffer, staging_memory, MemoryCategory::kStaging,
+               tex_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  uint8_t* data = static_cast<uint8_t*>(MapMemory(staging_memory));
+  std::vector<VkBufferImageCopy> buffer_cps(cooked.mips.size());
+  VkDeviceSize offset = 0;
+  for (uint32_t mip_i = 0; mip_i < cooked.mips.size(); mip_i++) {
+    memcpy(data + offset, cooked.mips[mip_i].data(),
+           cooked.mips[mip_i].size());
+    VkBufferImageCopy& buffer_cp = buffer_cps[mip_i];
+    buffer_cp.bufferOffset = offset;
+    buffer_cp.bufferRowLength = 0;
+    buffer_cp.bufferImageHeight = 0;
+    buffer_cp.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    buffer_cp.imageSubresource.mipLevel = mip_i;
+    buffer_cp.imageSubresource.baseArrayLayer = 0;
+    buffer_cp.imageSubresource.layerCount = 1;
+    buffer_cp.imageOffset = {0};
+    buffer_cp.imageExtent = {std::max(cooked.width >> mip_i, 1u),
+                             std::max(cooked.height >> mip_i, 1u), 1};
+    offset += cooked.mips[mip_i].size();
+  }
+
+  VkFormat format = VK_FORMAT_BC7_SRGB_BLOCK;
+  if (cooked.compression == TextureCompression::kBc5)
+    format = VK_FORMAT_BC5_UNORM_BLOCK;
+  else if (cooked.compression == TextureCompression::kBc4)
+    format = VK_FORMAT_BC4_UNORM_BLOCK;
+  VkImage texture_image = VK_NULL_HANDLE;
+  CreateImage(texture_image, texture_memory_[tex_i],
+              MemoryCategory::kTextures, 0, format,
+              {cooked.width, cooked.height, 1},
+              static_cast<uint32_t>(cooked.mips.size()), 1,
+              VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
+  CreateImageView(texture_image_views_[tex_i], texture_image,
+                  VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT,
+                  VK_IMAGE_USAGE_SAMPLED_BIT);
+  texture_images_[tex_i] = texture_image;
+
+  CmdTransitionImageLayout(
+      batch.command_buffer, texture_image, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdCopyBufferToImage(batch.command_buffer, staging_buffer, texture_image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         static_cast<uint32_t>(buffer_cps.size()),
+                         buffer_cps.data());
+  ReleaseUploadImage(batch.command_buffer, texture_image);
+  batch.graphics_commands.push_back([this,
+                                     texture_image](VkCommandBuffer& cmd) {
+    AcquireUploadImage(cmd, texture_image);
+    CmdTransitionImageLayout(
+        cmd, texture_image, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0, VK_ACCESS_SHADER_READ_BIT);
+  });
+
+  batch.buffers.push_back(staging_buffer);
+  batch.memory.push_back(staging_memory);
+}
+void Application::Renderer::LoadUncompressedTexture(uint32_t tex_i,
+                                                    const DecodedImage& image,
+                                                    UploadBatch& batch) {
+  VkFormat format = image.compression == TextureCompression::kBc7
+                        ? VK_FORMAT_R8G8B8A8_SRGB
+                        : VK_FORMAT_R8G8B8A8_UNORM;
+  size_t tex_size = image.pixels.size();
+  // Staging buffer
+  VkBuffer staging_buffer;
+  MemoryAllocation staging_memory;
+  CreateBuffer(staging_buffer, staging_memory, MemoryCategory::kStaging,
+               tex_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  // Copy texture data to staging buffer
+  void* data = MapMemory(staging_memory);
+  memcpy(data, image.pixels.data(), tex_size);
+
+  // Textures are created at their own size with a full mip chain
+  VkExtent3D tex_extent = {image.width, image.height, 1};
+  uint32_t mip_levels = 1;
+  while ((std::max(tex_extent.width, tex_extent.height) >> mip_levels) > 0)
+    mip_levels++;
+  VkImage texture_image = VK_NULL_HANDLE;
+  VkImageCreateFlags image_flags = 0;
+  VkImageUsageFlags image_usage =
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  GetMipmapImageFlags(format, image_flags, image_usage);
+  CreateImage(texture_image, texture_memory_[tex_i],
+              MemoryCategory::kTextures, image_flags, format, tex_extent,
+              mip_levels, 1, image_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+              VK_SAMPLE_COUNT_1_BIT);
+  CreateImageView(texture_image_views_[tex_i], texture_image,
+                  VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT);
+  texture_images_[tex_i] = texture_image;
+
+  VkBufferImageCopy buffer_cp{};
+  buffer_cp.bufferOffset = 0;
+  buffer_cp.bufferRowLength = 0;
+  buffer_cp.bufferImageHeight = 0;
+  buffer_cp.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  buffer_cp.imageSubresource.mipLevel = 0;
+  buffer_cp.imageSubresource.baseArrayLayer = 0;
+  buffer_cp.imageSubresource.layerCount = 1;
+  buffer_cp.imageOffset = {0};
+  buffer_cp.imageExtent = tex_extent;
+
+  // Copy texture data to the base level on the transfer queue
+  CmdTransitionImageLayout(
+      batch.command_buffer, texture_image, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdCopyBufferToImage(batch.command_buffer, staging_buffer, texture_image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_cp);
+  ReleaseUploadImage(batch.command_buffer, texture_image);
+
+  // Blits and compute need a graphics queue, so the mips are generated at
+  // the start of the next frame
+  MipmapChain chain;
+  chain.image = texture_image;
+  chain.format = format;
+  chain.extent = tex_extent;
+  chain.mip_levels = mip_levels;
+  chain.array_layers = 1;
+  PrepareMipmapChain(chain, batch);
+  batch.graphics_commands.push_back([this, chain](VkCommandBuffer& cmd) {
+    AcquireUploadImage(cmd, chain.image);
+    CmdGenerateMipmaps(cmd, chain);
+  });
+
+  batch.buffers.push_back(staging_buffer);
+  batch.memory.push_back(staging_memory);
+}
+void Application::Renderer::LoadCubemaps() {
+  static const std::string faces[] = {"posx", "negx", "posy",
+                                      "negy", "posz", "negz"};
+  uint32_t cmap_count = static_cast<uint32_t>(scene_->cubemaps_.size());
+  std::vector<DecodedImage> decoded = TakeDecodedImages(true);
+  if (scene_resource_details_.cubemap_count == cmap_count && decoded.empty())
+    return;
+  UploadBatch batch;
+  BeginUploadBatch(batch);
+  for (uint32_t cmap_i = scene_resource_details_.cubemap_count;
+       cmap_i < cmap_count; cmap_i++) {
+    // Cleared to black until all faces are decoded and uploaded
+    VkImage cubemap_image = cubemap_images_[cmap_i];
+    batch.graphics_commands.push_back([this,
+                                       cubemap_image](VkCommandBuffer& cmd) {
+      CmdTransitionImageLayout(cmd, cubemap_image, VK_IMAGE_ASPECT_COLOR_BIT,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                               VK_ACCESS_TRANSFER_WRITE_BIT);
+      VkClearColorValue clear_color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+      VkImageSubresourceRange range{};
+      range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      range.baseMipLevel = 0;
+      range.levelCount = VK_REMAINING_MIP_LEVELS;
+      range.baseArrayLayer = 0;
+      range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+      vkCmdClearColorImage(cmd, cubemap_image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color,
+                           1, &range);
+      CmdTransitionImageLayout(cmd, cubemap_image, VK_IMAGE_ASPECT_COLOR_BIT,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT,
+                               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                               VK_ACCESS_TRANSFER_WRITE_BIT,
+                               VK_ACCESS_SHADER_READ_BIT);
+    });
+    for (uint32_t face_i = 0; face_i < 6; face_i++) {
+      DecodedImage image{};
+      image.generation = decode_generation_;
+      image.slot = cmap_i;
+      image.cubemap = true;
+      image.face = face_i;
+      image.path =
+          scene_->cubemaps_[cmap_i]->path_ + "/" + faces[face_i] + ".jpg";
+      image.compression = TextureCompression::kBc7;
+      image.compressed = false;
+      QueueImageDecode(image);
+    }
+  }
+  for (DecodedImage& image : decoded) {
+    if (!image.success)
+      std::cerr << "Failed to read image: " << image.path << std::endl;
+    uint32_t cmap_i = image.slot;
+    std::vector<DecodedImage>& cubemap_faces = cubemap_faces_[cmap_i];
+    cubemap_faces.push_back(std::move(image));
+    if (cubemap_faces.size() < 6) continue;
+    // Failed faces are collected too, so the other faces can be dropped
+    // once all have arrived and the cubemap stays cleared
+    bool faces_read = std::all_of(
+        cubemap_faces.begin(), cubemap_faces.end(),
+        [](const DecodedImage& face) { return face.success; });
+    if (!faces_read) {
+      cubemap_faces_.erase(cmap_i);
+      continue;
+    }
+    std::sort(cubemap_faces.begin(), cubemap_faces.end(),
+              [](const DecodedImage& a, const DecodedImage& b) {
+                return a.face < b.face;
+              });
+    LoadCubemap(cmap_i, cubemap_faces, batch);
+    cubemap_faces_.erase(cmap_i);
+  }
+  SubmitUploadBatch(batch);
+  scene_resource_details_.cubemap_count = cmap_count;
+}
+void Application::Renderer::LoadCubemap(
+    uint32_t cmap_i, const std::vector<DecodedImage>& faces,
+    UploadBatch& batch) {
+  std::vector<VkImage> face_images(6);
+  std::vector<VkImageBlit> face_blits(6);
+  for (uint32_t face_i = 0; face_i < 6; face_i++) {
+    const DecodedImage& face = faces[face_i];
+    size_t tex_size = face.pixels.size();
+
     // Staging buffer
     VkBuffer staging_buffer;
-    VkDeviceMemory staging_memory;
-    CreateBuffer(staging_buffer, staging_memory, tex_size,
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    MemoryAllocation staging_memory;
+    CreateBuffer(staging_buffer, staging_memory, MemoryCategory::kStaging,
+                 tex_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     // Copy texture data to staging buffer
-    void* data;
-    vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &data);
-    memcpy(data, tex_data->data, tex_size);
-    vkUnmapMemory(device_, staging_memory);
+    void* data = MapMemory(staging_memory);
+    memcpy(data, face.pixels.data(), tex_size);
 
     // Staging image
     VkImage staging_image = VK_NULL_HANDLE;
-    VkDeviceMemory staging_image_memory;
+    MemoryAllocation staging_image_memory;
     CreateImage(
-        staging_image, staging_image_memory, 0, VK_FORMAT_R8G8B8A8_SRGB,
-        {tex_data->width, tex_data->height, 1}, 1, 1,
+        staging_image, staging_image_memory, MemoryCategory::kStaging, 0,
+        VK_FORMAT_R8G8B8A8_SRGB, {face.width, face.height, 1}, 1, 1,
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
 
@@ -169,227 +498,107 @@ void Application::Renderer::LoadTextures() {
     buffer_cp.imageSubresource.baseArrayLayer = 0;
     buffer_cp.imageSubresource.layerCount = 1;
     buffer_cp.imageOffset = {0};
-    buffer_cp.imageExtent.width = tex_data->width;
-    buffer_cp.imageExtent.height = tex_data->height;
+    buffer_cp.imageExtent.width = face.width;
+    buffer_cp.imageExtent.height = face.height;
     buffer_cp.imageExtent.depth = 1;
 
-    // Copy texture data to staging image
-    VkCommandBuffer cmd;
-    TransitionImageLayout(
-        staging_image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
-    BeginSingleUseCommandBuffer(cmd);
-    vkCmdCopyBufferToImage(cmd, staging_buffer, staging_image,
+    // Copy texture data to staging image on the transfer queue
+    CmdTransitionImageLayout(
+        batch.command_buffer, staging_image, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdCopyBufferToImage(batch.command_buffer, staging_buffer,
+                           staging_image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
                            &buffer_cp);
-    EndSingleUseCommandBuffer(cmd);
-    TransitionImageLayout(
-        staging_image, VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_ACCESS_TRANSFER_READ_BIT);
-
-    // Blit texture to every mip map
-    TransitionImageLayout(texture_images_[tex_i], VK_IMAGE_ASPECT_COLOR_BIT,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                          VK_ACCESS_TRANSFER_WRITE_BIT);
-    BeginSingleUseCommandBuffer(cmd);
-    std::vector<VkImageBlit> blits(Scene::kMaxTextureMipLevels);
-    for (uint32_t mip_i = 0; mip_i < Scene::kMaxTextureMipLevels; mip_i++) {
-      VkImageBlit& blit = blits[mip_i];
-      blit.srcOffsets[0] = {0, 0, 0};
-      blit.srcOffsets[1] = {static_cast<int32_t>(tex_data->width),
-                            static_cast<int32_t>(tex_data->height), 1};
-      blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      blit.srcSubresource.baseArrayLayer = 0;
-      blit.srcSubresource.layerCount = 1;
-      blit.srcSubresource.mipLevel = 0;
-      blit.dstOffsets[0] = {0, 0, 0};
-      int32_t mip_dim = Scene::kMaxTextureResolution / (1 << mip_i);
-      blit.dstOffsets[1] = {mip_dim, mip_dim, 1};
-      blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      blit.dstSubresource.baseArrayLayer = 0;
-      blit.dstSubresource.layerCount = 1;
-      blit.dstSubresource.mipLevel = mip_i;
-    }
-    vkCmdBlitImage(cmd, staging_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                   texture_images_[tex_i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                   Scene::kMaxTextureMipLevels, blits.data(), VK_FILTER_LINEAR);
-    EndSingleUseCommandBuffer(cmd);
-    TransitionImageLayout(
-        texture_images_[tex_i], VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    ReleaseUploadImage(batch.command_buffer, staging_image);
+
+    // Blit texture to the base level, the other levels are downsampled
+    // from it
+    VkImageBlit& blit = face_blits[face_i];
+    blit.srcOffsets[0] = {0, 0, 0};
+    blit.srcOffsets[1] = {static_cast<int32_t>(face.width),
+                          static_cast<int32_t>(face.height), 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcSubresource.mipLevel = 0;
+    blit.dstOffsets[0] = {0, 0, 0};
+    blit.dstOffsets[1] = {static_cast<int32_t>(Scene::kMaxTextureResolution),
+                          static_cast<int32_t>(Scene::kMaxTextureResolution),
+                          1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.baseArrayLayer = face_i;
+    blit.dstSubresource.layerCount = 1;
+    blit.dstSubresource.mipLevel = 0;
+    face_images[face_i] = staging_image;
 
-    vkFreeMemory(device_, staging_image_memory, nullptr);
-    vkDestroyImage(device_, staging_image, nullptr);
-    vkFreeMemory(device_,staging_memory,nullptr);
-    vkDestroyBuffer(device_,staging_buffer,nullptr);
+    batch.buffers.push_back(staging_buffer);
+    batch.images.push_back(staging_image);
+    batch.memory.push_back(staging_memory);
+    batch.memory.push_back(staging_image_memory);
   }
-  scene_resource_details_.texture_count = tex_count;
-}
-void Application::Renderer::LoadCubemaps() {
-  static const std::string faces[] = {"posx", "negx", "posy",
-                                      "negy", "posz", "negz"};
-  uint32_t cmap_count = static_cast<uint32_t>(scene_->cubemaps_.size());
-  if (scene_resource_details_.cubemap_count == cmap_count) return;
-  TextureImporter texture_importer;
-  for (uint32_t cmap_i = scene_resource_details_.cubemap_count;
-       cmap_i < cmap_count; cmap_i++) {
-    TransitionImageLayout(cubemap_images_[cmap_i], VK_IMAGE_ASPECT_COLOR_BIT,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                          VK_ACCESS_TRANSFER_WRITE_BIT);
+  MipmapChain chain;
+  chain.image = cubemap_images_[cmap_i];
+  chain.format = VK_FORMAT_R8G8B8A8_SRGB;
+  chain.extent = {Scene::kMaxTextureResolution,
+                  Scene::kMaxTextureResolution, 1};
+  chain.mip_levels = Scene::kMaxTextureMipLevels;
+  chain.array_layers = 6;
+  PrepareMipmapChain(chain, batch);
+  batch.graphics_commands.push_back([this, chain, face_images,
+                                     face_blits](VkCommandBuffer& cmd) {
+    CmdTransitionImageLayout(cmd, chain.image, VK_IMAGE_ASPECT_COLOR_BIT,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             VK_ACCESS_TRANSFER_WRITE_BIT);
     for (uint32_t face_i = 0; face_i < 6; face_i++) {
-      std::string face_path =
-          scene_->cubemaps_[cmap_i]->path_ + "/" + faces[face_i] + ".jpg";
-      bool read_success = texture_importer.ReadFile(face_path);
-      ASSERT(read_success, "Failed to read image: " + face_path);
-      const TextureData* tex_data = texture_importer.GetData();
-      size_t tex_size =
-          (tex_data->height) * (tex_data->width) * (tex_data->channels);
-
-      // Staging buffer
-      VkBuffer staging_buffer;
-      VkDeviceMemory staging_memory;
-      CreateBuffer(staging_buffer, staging_memory, tex_size,
-                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-      // Copy texture data to staging buffer
-      void* data;
-      vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &data);
-      memcpy(data, tex_data->data, tex_size);
-      vkUnmapMemory(device_, staging_memory);
-
-      // Staging image
-      VkImage staging_image = VK_NULL_HANDLE;
-      VkDeviceMemory staging_image_memory;
-      CreateImage(
-          staging_image, staging_image_memory, 0, VK_FORMAT_R8G8B8A8_SRGB,
-          {tex_data->width, tex_data->height, 1}, 1, 1,
-          VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
-
-      VkBufferImageCopy buffer_cp{};
-      buffer_cp.bufferOffset = 0;
-      buffer_cp.bufferRowLength = 0;
-      buffer_cp.bufferImageHeight = 0;
-      buffer_cp.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      buffer_cp.imageSubresource.mipLevel = 0;
-      buffer_cp.imageSubresource.baseArrayLayer = 0;
-      buffer_cp.imageSubresource.layerCount = 1;
-      buffer_cp.imageOffset = {0};
-      buffer_cp.imageExtent.width = tex_data->width;
-      buffer_cp.imageExtent.height = tex_data->height;
-      buffer_cp.imageExtent.depth = 1;
-
-      // Copy texture data to staging image
-      VkCommandBuffer cmd;
-      TransitionImageLayout(
-          staging_image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-          VK_ACCESS_TRANSFER_WRITE_BIT);
-      BeginSingleUseCommandBuffer(cmd);
-      vkCmdCopyBufferToImage(cmd, staging_buffer, staging_image,
-                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                             &buffer_cp);
-      EndSingleUseCommandBuffer(cmd);
-      TransitionImageLayout(
-          staging_image, VK_IMAGE_ASPECT_COLOR_BIT,
-          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
-          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-          VK_ACCESS_TRANSFER_READ_BIT);
-
-      // Blit texture to every mip map
-      BeginSingleUseCommandBuffer(cmd);
-      std::vector<VkImageBlit> blits(Scene::kMaxTextureMipLevels);
-      for (uint32_t mip_i = 0; mip_i < Scene::kMaxTextureMipLevels; mip_i++) {
-        VkImageBlit& blit = blits[mip_i];
-        blit.srcOffsets[0] = {0, 0, 0};
-        blit.srcOffsets[1] = {static_cast<int32_t>(tex_data->width),
-                              static_cast<int32_t>(tex_data->height), 1};
-        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.srcSubresource.baseArrayLayer = 0;
-        blit.srcSubresource.layerCount = 1;
-        blit.srcSubresource.mipLevel = 0;
-        blit.dstOffsets[0] = {0, 0, 0};
-        int32_t mip_dim = Scene::kMaxTextureResolution / (1 << mip_i);
-        blit.dstOffsets[1] = {mip_dim, mip_dim, 1};
-        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.dstSubresource.baseArrayLayer = face_i;
-        blit.dstSubresource.layerCount = 1;
-        blit.dstSubresource.mipLevel = mip_i;
-      }
+      AcquireUploadImage(cmd, face_images[face_i]);
       vkCmdBlitImage(
-          cmd, staging_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-          cubemap_images_[cmap_i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-          Scene::kMaxTextureMipLevels, blits.data(), VK_FILTER_LINEAR);
-      EndSingleUseCommandBuffer(cmd);
-
-      vkFreeMemory(device_, staging_image_memory, nullptr);
-      vkDestroyImage(device_, staging_image, nullptr);
-      vkFreeMemory(device_, staging_memory, nullptr);
-      vkDestroyBuffer(device_, staging_buffer, nullptr);
+          cmd, face_images[face_i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          chain.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+          &face_blits[face_i], VK_FILTER_LINEAR);
     }
-    TransitionImageLayout(
-        cubemap_images_[cmap_i], VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
-  }
-  scene_resource_details_.cubemap_count = cmap_count;
+    CmdTransitionImageLayout(cmd, chain.image, VK_IMAGE_ASPECT_COLOR_BIT,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_ACCESS_TRANSFER_WRITE_BIT,
+                             VK_ACCESS_TRANSFER_READ_BIT);
+    CmdGenerateMipmaps(cmd, chain);
+  });
 }
 void Application::Renderer::CreateVertexBuffer() {
-  CreateBuffer(
-      vertex_buffer_, vertex_memory_, sizeof(Vertex)*Scene::kMaxVertices,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  const uint32_t float_i = static_cast<uint32_t>(VertexFormat::kFloat);
+  const uint32_t packed_i = static_cast<uint32_t>(VertexFormat::kPacked);
+  CreateGeometryBuffer(vertex_geometries_[float_i], sizeof(Vertex),
+                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  CreateGeometryBuffer(vertex_geometries_[packed_i], sizeof(PackedVertex),
+                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  CreateGeometryBuffer(position_geometries_[float_i], sizeof(glm::vec3),
+                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  CreateGeometryBuffer(position_geometries_[packed_i],
+                       sizeof(PackedVertex::position),
+                       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 }
 void Application::Renderer::CreateIndexBuffer() {
-  CreateBuffer(
-      index_buffer_, index_memory_, sizeof(uint32_t) * Scene::kMaxVertices,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-}
-void Application::Renderer::CreateDirectionalLightUniformBuffer() {
-  uint32_t num_frames = frame_count_;
-  directional_light_uniform_buffers_.resize(num_frames);
-  directional_light_uniform_memory_.resize(num_frames);
-  for (uint32_t frame_i = 0;
-       frame_i < num_frames; frame_i++) {
-    CreateBuffer(directional_light_uniform_buffers_[frame_i],
-                 directional_light_uniform_memory_[frame_i],
-                 DirectionalLightUniform::GetSize(),
-                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  }
+  CreateGeometryBuffer(index_geometry_, sizeof(uint32_t),
+                       VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 }
 void Application::Renderer::UnloadScene() {
   ASSERT(scene_ != nullptr, "No scene loaded!");
   vkDeviceWaitIdle(device_);
   scene_ = nullptr;
 }
-void Application::Renderer::DrawScene(uint32_t image_i) {
+void Application::Renderer::DrawScene(uint32_t frame_i, uint32_t image_i) {
   LoadSceneResources();
-  VkCommandBuffer& cmd = command_buffers_[image_i];
-  VkDeviceSize vertex_offsets[] = {static_cast<uint64_t>(0)};
-  vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer_, vertex_offsets);
-  vkCmdBindIndexBuffer(cmd, index_buffer_, 0, VK_INDEX_TYPE_UINT32);
+  if (texture_descriptors_stale_[frame_i]) WriteTextureDescriptorSet(frame_i);
+  VkCommandBuffer& cmd = command_buffers_[frame_i];
+  RecordUploadGraphicsCommands(cmd);
 
   SceneDrawDetails details;
   details.push_constants.world_to_view_transform = glm::mat4(1.0f);
@@ -427,111 +636,377 @@ void Application::Renderer::DrawScene(uint32_t image_i) {
       scene_->settings_[0]->shadowmap_kernel_size_;
   details.renderer_uniform.ssao_enabled = scene_->settings_[0]->ssao_enabled_;
   details.renderer_uniform.ssr_enabled = scene_->settings_[0]->ssr_enabled_;
-  DrawScenePrePass(cmd, details, scene_->root_, glm::mat4(1.0f));
-
-  DrawSceneShadowmaps(cmd, image_i, details);
-  
-  vkCmdPushConstants(cmd, graphics_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
-                     offsetof(PushConstantData, world_to_view_transform),
-                     sizeof(details.push_constants.world_to_view_transform),
-                     &details.push_constants.world_to_view_transform);
-  vkCmdPushConstants(cmd, graphics_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
-                     offsetof(PushConstantData, view_to_clip_transform),
-                     sizeof(details.push_constants.view_to_clip_transform),
-                     &details.push_constants.view_to_clip_transform);
-
-  // Z-Prepass
-  DrawSceneZPrePass(cmd, image_i, details);
-
-  // SSAO Pass
-  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          ssao_pipeline_layout_, 0, 1,
-                          &ssao_descriptor_sets_[image_i], 0, nullptr);
-  BeginSsaoRenderPass(cmd, image_i);
-  vkCmdBindVertexBuffers(cmd, 0, 1, &skybox_vertex_buffer_, vertex_offsets);
-  if (details.renderer_uniform.ssao_enabled) {
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ssao_pipeline_);
-    vkCmdDraw(cmd, 6, 1, 0, 0);
-  }
-  vkCmdEndRenderPass(cmd);
-
-  // SSR Pass
   details.ssr_uniform.step_size = scene_->settings_[0]->ssr_step_size_;
   details.ssr_uniform.thickness = scene_->settings_[0]->ssr_thickness_;
-  ComputeSsrMap(cmd, image_i, details);
+  details.tonemap_uniform.log_illuminance_sum = 0.0f;
+  details.tonemap_uniform.num_pixels =
+      swapchain_extent_.width * swapchain_extent_.height;
+  details.tonemap_uniform.exposure_adjustment_ =
+      scene_->settings_[0]->exposure_adjustment_;
+  DrawScenePrePass(cmd, details, scene_->root_, glm::mat4(1.0f));
+  ReserveShadowmaps(details.directional_light_uniform.light_count_);
+  if (shadowmap_descriptors_stale_[frame_i])
+    WriteShadowmapDescriptorSet(frame_i);
 
-  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          graphics_pipeline_layout_, 0, 1,
-                          &descriptor_sets_[image_i], 0, nullptr);
-  BeginGraphicsRenderPass(cmd, image_i);
-
-  void* uniform_data;
-  vkMapMemory(device_, directional_light_uniform_memory_[image_i], 0,
-              VK_WHOLE_SIZE, 0,
-              &uniform_data);
+  // The frame's previous submission has completed, so its whole uniform ring
+  // can be rewritten. Every uniform is pushed here, before any pass records.
+  ResetUniformRing(frame_i);
+  UniformOffsets& offsets = details.uniform_offsets;
+  char* uniform_data = static_cast<char*>(AllocateUniform(
+      frame_i, DirectionalLightUniform::GetSize(), offsets.directional_light));
   size_t light_array_size =
       Scene::kMaxDirectionalLights * sizeof(DirectionalLight);
   memcpy(uniform_data, details.directional_light_uniform.lights_.data(),
          light_array_size);
-  memcpy(static_cast<char*>(uniform_data) + light_array_size,
+  memcpy(uniform_data + light_array_size,
          &details.directional_light_uniform.light_count_, sizeof(uint32_t));
-  vkUnmapMemory(device_, directional_light_uniform_memory_[image_i]);
 
-  void* material_uniform_data;
-  vkMapMemory(device_, material_uniform_memory_[image_i], 0, VK_WHOLE_SIZE, 0,
-              &material_uniform_data);
+  char* material_uniform_data = static_cast<char*>(AllocateUniform(
+      frame_i, MaterialUniformBlock::GetSize(), offsets.material));
   size_t material_array_size = Scene::kMaxMaterials * sizeof(MaterialUniform);
   memcpy(material_uniform_data, details.material_uniform_block.materials_.data(), material_array_size);
-  memcpy(reinterpret_cast<char*>(material_uniform_data) + material_array_size,
+  memcpy(material_uniform_data + material_array_size,
          &details.material_uniform_block.material_count_, sizeof(uint32_t));
-  vkUnmapMemory(device_, material_uniform_memory_[image_i]);
 
-  void* skybox_uniform_data;
-  vkMapMemory(device_, skybox_uniform_memory_[image_i], 0, VK_WHOLE_SIZE, 0,
-              &skybox_uniform_data);
-  memcpy(skybox_uniform_data, &details.skybox_uniform, sizeof(SkyboxUniform));
-  vkUnmapMemory(device_, skybox_uniform_memory_[image_i]);
+  offsets.skybox = PushUniform(frame_i, &details.skybox_uniform,
+                               sizeof(SkyboxUniform));
+  offsets.renderer_settings =
+      PushUniform(frame_i, &details.renderer_uniform,
+                  sizeof(RendererSettingsUniform));
+  offsets.tonemap = PushUniform(frame_i, &details.tonemap_uniform,
+                                sizeof(TonemappingUniform));
+  offsets.ssr =
+      PushUniform(frame_i, &details.ssr_uniform, sizeof(SsrUniform));
 
-  void* settings_data = nullptr;
-  vkMapMemory(device_, renderer_uniform_memory_[image_i], 0, VK_WHOLE_SIZE, 0,
-              &settings_data);
-  memcpy(settings_data, &details.renderer_uniform,
-         sizeof(details.renderer_uniform));
-  vkUnmapMemory(device_, renderer_uniform_memory_[image_i]);
+  // Every pass binds all of its own state, so that it can be recorded into a
+  // secondary command buffer independently of the others. Passes declare the
+  // resources they access, CompileScenePasses culls, orders and synchronizes
+  // them.
+  std::vector<ScenePass> passes;
+  const VkPipelineStageFlags depth_stages =
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+      VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  const VkAccessFlags depth_access =
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  uint32_t prev_frame_i = (frame_i + frame_count_ - 1) % frame_count_;
 
-  vkCmdBindVertexBuffers(cmd, 0, 1, &skybox_vertex_buffer_, vertex_offsets);
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, skybox_pipeline_);
+  // Shadowmaps
+  for (uint32_t shadow_i = 0;
+       shadow_i < details.directional_light_uniform.light_count_; shadow_i++) {
+    VkFramebuffer& framebuffer = shadowmaps_[shadow_i].framebuffers[frame_i];
+    ScenePass pass;
+    pass.render_pass = shadowmap_render_pass_;
+    pass.framebuffer = framebuffer;
+    pass.begin = [this, &framebuffer](VkCommandBuffer& pass_cmd,
+                                      VkSubpassContents contents) {
+      BeginShadowmapRenderPass(pass_cmd, framebuffer, contents);
+    };
+    pass.record = [this, &details, shadow_i](VkCommandBuffer& pass_cmd) {
+      DrawSceneShadowmap(pass_cmd, shadow_i, details);
+    };
+    pass.writes.push_back(ImageAccess(
+        shadowmaps_[shadow_i].images[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT,
+        depth_stages, depth_access,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
 
-  vkCmdDraw(cmd, 6, 1, 0, 0);
+  // Z-Prepass
+  {
+    ScenePass pass;
+    pass.render_pass = depthmap_render_pass_;
+    pass.framebuffer = depthmap_framebuffers_[frame_i];
+    pass.begin = [this, frame_i](VkCommandBuffer& pass_cmd,
+                                 VkSubpassContents contents) {
+      BeginDepthmapRenderPass(pass_cmd, frame_i, contents);
+    };
+    pass.record = [this, &details](VkCommandBuffer& pass_cmd) {
+      DrawSceneZPrePass(pass_cmd, details);
+    };
+    pass.writes.push_back(ImageAccess(
+        depth_msaa_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT, depth_stages,
+        depth_access, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true));
+    // Depth resolves happen in the color attachment output stage
+    pass.writes.push_back(ImageAccess(
+        depth_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT,
+        depth_stages | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        depth_access | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
 
-  vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer_, vertex_offsets);
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+  // SSAO Pass
+  {
+    ScenePass pass;
+    pass.render_pass = ssao_render_pass_;
+    pass.framebuffer = ssao_framebuffers_[frame_i];
+    pass.begin = [this, frame_i](VkCommandBuffer& pass_cmd,
+                                 VkSubpassContents contents) {
+      BeginSsaoRenderPass(pass_cmd, frame_i, contents);
+    };
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      vkCmdBindDescriptorSets(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              ssao_pipeline_layout_, 0, 1,
+                              &ssao_descriptor_sets_[frame_i], 0, nullptr);
+      PushCameraConstants(pass_cmd, ssao_pipeline_layout_, details);
+      VkDeviceSize vertex_offsets[] = {0};
+      vkCmdBindVertexBuffers(pass_cmd, 0, 1, &skybox_vertex_buffer_,
+                             vertex_offsets);
+      vkCmdBindPipeline(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        ssao_pipeline_);
+      vkCmdDraw(pass_cmd, 6, 1, 0, 0);
+    };
+    pass.reads.push_back(ImageAccess(
+        depth_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+    pass.writes.push_back(ImageAccess(
+        ssao_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
+
+  // SSR Pass
+  {
+    ScenePass pass;
+    pass.render_pass = ssr_render_pass_;
+    pass.framebuffer = ssr_framebuffers_[frame_i];
+    pass.begin = [this, frame_i](VkCommandBuffer& pass_cmd,
+                                 VkSubpassContents contents) {
+      BeginSsrRenderPass(pass_cmd, frame_i, contents);
+    };
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      ComputeSsrMap(pass_cmd, frame_i, details);
+    };
+    pass.reads.push_back(ImageAccess(
+        depth_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+    if (rendered_frames_[prev_frame_i]) {
+      pass.reads.push_back(ImageAccess(
+          hdr_images_[prev_frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    }
+    pass.writes.push_back(ImageAccess(
+        ssr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
 
-  DrawSceneMeshes(cmd, graphics_pipeline_layout_, details, scene_->root_, glm::mat4(1.0f));
+  // Main Pass
+  {
+    ScenePass pass;
+    pass.render_pass = render_pass_;
+    pass.framebuffer = framebuffers_[frame_i];
+    pass.begin = [this, frame_i](VkCommandBuffer& pass_cmd,
+                                 VkSubpassContents contents) {
+      BeginGraphicsRenderPass(pass_cmd, frame_i, contents);
+    };
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      // In binding order
+      uint32_t dynamic_offsets[] = {details.uniform_offsets.directional_light,
+                                    details.uniform_offsets.material,
+                                    details.uniform_offsets.skybox,
+                                    details.uniform_offsets.renderer_settings};
+      vkCmdBindDescriptorSets(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              graphics_pipeline_layout_, 0, 1,
+                              &descriptor_sets_[frame_i], 4, dynamic_offsets);
+      PushCameraConstants(pass_cmd, graphics_pipeline_layout_, details);
+      VkDeviceSize vertex_offsets[] = {0};
+      vkCmdBindVertexBuffers(pass_cmd, 0, 1, &skybox_vertex_buffer_,
+                             vertex_offsets);
+      vkCmdBindPipeline(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        skybox_pipeline_);
+      vkCmdDraw(pass_cmd, 6, 1, 0, 0);
 
-  vkCmdEndRenderPass(cmd);
+      DrawSceneMeshes(pass_cmd, graphics_pipelines_, vertex_geometries_,
+                      graphics_pipeline_layout_, details);
+    };
+    for (uint32_t shadow_i = 0;
+         shadow_i < details.directional_light_uniform.light_count_;
+         shadow_i++) {
+      pass.reads.push_back(ImageAccess(
+          shadowmaps_[shadow_i].images[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+    }
+    // The shader skips disabled effects, leaving their passes unused
+    if (details.renderer_uniform.ssao_enabled) {
+      pass.reads.push_back(ImageAccess(
+          ssao_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    }
+    if (details.renderer_uniform.ssr_enabled) {
+      pass.reads.push_back(ImageAccess(
+          ssr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    }
+    // Storing with VK_ATTACHMENT_STORE_OP_DONT_CARE is still a write
+    pass.writes.push_back(ImageAccess(
+        depth_msaa_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT, depth_stages,
+        depth_access, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+    pass.writes.push_back(ImageAccess(
+        hdr_msaa_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true));
+    pass.writes.push_back(ImageAccess(
+        hdr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
 
   // Calculate Exposure
-  details.tonemap_uniform.exposure_adjustment_ =
-      scene_->settings_[0]->exposure_adjustment_;
-  ComputeTonemapping(cmd, image_i, details);
-  
-  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          hdr_pipeline_layout_, 0, 1,
-                          &hdr_descriptor_sets_[image_i], 0, nullptr);
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, hdr_pipeline_);
-  vkCmdBindVertexBuffers(cmd, 0, 1, &skybox_vertex_buffer_, vertex_offsets);
-  BeginHdrRenderPass(cmd, image_i);
-  vkCmdDraw(cmd, 6, 1, 0, 0);
-  vkCmdEndRenderPass(cmd);
+  {
+    ScenePass pass;
+    pass.render_pass = VK_NULL_HANDLE;
+    pass.framebuffer = VK_NULL_HANDLE;
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      ComputeTonemapping(pass_cmd, frame_i, details);
+    };
+    pass.reads.push_back(ImageAccess(
+        hdr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+    pass.writes.push_back(BufferAccess(uniform_ring_buffers_[frame_i],
+                                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                       VK_ACCESS_TRANSFER_WRITE_BIT));
+    pass.writes.push_back(BufferAccess(illuminance_buffers_[frame_i][0],
+                                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                       VK_ACCESS_TRANSFER_WRITE_BIT));
+    // Feeds the illuminance reduction on the compute queue
+    pass.side_effects = true;
+    passes.push_back(pass);
+  }
+
+  // HDR Pass
+  {
+    ScenePass pass;
+    pass.render_pass = hdr_render_pass_;
+    pass.framebuffer = hdr_framebuffers_[frame_i][image_i];
+    pass.begin = [this, frame_i, image_i](VkCommandBuffer& pass_cmd,
+                                          VkSubpassContents contents) {
+      BeginHdrRenderPass(pass_cmd, frame_i, image_i, contents);
+    };
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      vkCmdBindDescriptorSets(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              hdr_pipeline_layout_, 0, 1,
+                              &hdr_descriptor_sets_[frame_i], 1,
+                              &details.uniform_offsets.tonemap);
+      vkCmdBindPipeline(pass_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        hdr_pipeline_);
+      VkDeviceSize vertex_offsets[] = {0};
+      vkCmdBindVertexBuffers(pass_cmd, 0, 1, &skybox_vertex_buffer_,
+                             vertex_offsets);
+      vkCmdDraw(pass_cmd, 6, 1, 0, 0);
+    };
+    pass.reads.push_back(ImageAccess(
+        hdr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    pass.reads.push_back(BufferAccess(uniform_ring_buffers_[frame_i],
+                                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                      VK_ACCESS_UNIFORM_READ_BIT));
+    // The depth attachment is only shared with the debug draw framebuffer
+    pass.writes.push_back(ImageAccess(
+        depth_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT, depth_stages,
+        depth_access, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+    pass.writes.push_back(ImageAccess(
+        swapchain_images_[image_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true));
+    passes.push_back(pass);
+  }
 
   // Debug Draw
   if (debug_enabled_) {
-    DebugDrawScene(image_i, details);
+    ScenePass pass;
+    pass.render_pass = debugdraw_render_pass_;
+    pass.framebuffer = hdr_framebuffers_[frame_i][image_i];
+    pass.begin = [this, frame_i, image_i](VkCommandBuffer& pass_cmd,
+                                          VkSubpassContents contents) {
+      BeginDebugDrawRenderPass(pass_cmd, frame_i, image_i, contents);
+    };
+    pass.record = [this, frame_i, &details](VkCommandBuffer& pass_cmd) {
+      DebugDrawScene(pass_cmd, frame_i, details);
+    };
+    pass.writes.push_back(ImageAccess(
+        depth_images_[frame_i], VK_IMAGE_ASPECT_DEPTH_BIT, depth_stages,
+        depth_access, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+    pass.writes.push_back(ImageAccess(
+        swapchain_images_[image_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+    passes.push_back(pass);
+  }
+
+  // Output Transition
+  {
+    ScenePass pass;
+    pass.render_pass = VK_NULL_HANDLE;
+    pass.framebuffer = VK_NULL_HANDLE;
+    pass.record = [](VkCommandBuffer& pass_cmd) {};
+    pass.reads.push_back(ImageAccess(
+        swapchain_images_[image_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, output_image_layout_));
+    pass.side_effects = true;
+    passes.push_back(pass);
+  }
+
+  // Presentation owns the image between frames, image acquisition
+  // synchronizes with it
+  ResetScenePassImage(swapchain_images_[image_i]);
+  CompileScenePasses(passes);
+  RecordScenePasses(cmd, frame_i, passes,
+                    scene_->settings_[0]->parallel_recording_enabled_);
+}
+void Application::Renderer::PushCameraConstants(VkCommandBuffer& cmd,
+                                                VkPipelineLayout& layout,
+                                                SceneDrawDetails& details) {
+  vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT,
+                     offsetof(PushConstantData, world_to_view_transform),
+                     sizeof(details.push_constants.world_to_view_transform),
+                     &details.push_constants.world_to_view_transform);
+  vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT,
+                     offsetof(PushConstantData, view_to_clip_transform),
+                     sizeof(details.push_constants.view_to_clip_transform),
+                     &details.push_constants.view_to_clip_transform);
+}
+void Application::Renderer::DrawSceneMeshes(
+    VkCommandBuffer& cmd,
+    const std::array<VkPipeline, kVertexFormatCount>& pipelines,
+    const std::array<GeometryBuffer, kVertexFormatCount>& vertex_geometries,
+    VkPipelineLayout& layout, SceneDrawDetails& details) {
+  vkCmdBindIndexBuffer(cmd, index_geometry_.buffer, 0, VK_INDEX_TYPE_UINT32);
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    const GeometryBuffer& vertex_geometry = vertex_geometries[format_i];
+    if (vertex_geometry.live_count == 0) continue;
+    VkDeviceSize vertex_offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_geometry.buffer,
+                           vertex_offsets);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipelines[format_i]);
+    DrawSceneMeshes(cmd, layout, details, static_cast<VertexFormat>(format_i),
+                    vertex_geometry, scene_->root_, glm::mat4(1.0f));
   }
 }
 void Application::Renderer::DrawSceneMeshes(VkCommandBuffer& cmd, VkPipelineLayout& layout,
                                             SceneDrawDetails& details,
+                                            VertexFormat format,
+                                            const GeometryBuffer& vertex_geometry,
                                             const SceneObject* focus,
                                             glm::mat4 model_transform) {
   model_transform *= focus->transform_.GetTransformationMatrix();
@@ -541,18 +1016,23 @@ void Application::Renderer::DrawSceneMeshes(VkCommandBuffer& cmd, VkPipelineLayo
           reinterpret_cast<const MeshObject*>(focus);
       const uint32_t mesh_id = mesh_object->mesh_id_;
       const Mesh* mesh = scene_->meshes_[mesh_id];
+      if (mesh->vertex_format != format) break;
+      // Packed positions are unpacked by the model transform
+      glm::mat4 mesh_transform = model_transform;
+      if (format == VertexFormat::kPacked)
+        mesh_transform *= mesh->unpack_transform;
       vkCmdPushConstants(cmd, layout,
                          VK_SHADER_STAGE_VERTEX_BIT,
                          offsetof(PushConstantData, model_to_world_transform),
                          sizeof(details.push_constants.model_to_world_transform),
-                         &model_transform);
+                         &mesh_transform);
       vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT,
                          offsetof(PushConstantData, material_id),
                          sizeof(details.push_constants.material_id),
                          &mesh->material_id);
       vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh->indices.size()), 1,
-                       scene_resource_details_.index_offsets_[mesh_id],
-                       scene_resource_details_.vertex_offsets_[mesh_id], 0);
+                       index_geometry_.ranges[mesh_id].offset,
+                       vertex_geometry.ranges[mesh_id].offset, 0);
       break;
     }
     default: {
@@ -560,28 +1040,30 @@ void Application::Renderer::DrawSceneMeshes(VkCommandBuffer& cmd, VkPipelineLayo
     }
   }
   for (const SceneObject* child : focus->children_) {
-    DrawSceneMeshes(cmd, layout, details, child, model_transform);
+    DrawSceneMeshes(cmd, layout, details, format, vertex_geometry, child,
+                    model_transform);
   }
 }
-void Application::Renderer::DebugDrawScene(uint32_t image_i, SceneDrawDetails& details) {
-  VkCommandBuffer& cmd = command_buffers_[image_i];
-  BeginDebugDrawRenderPass(cmd, image_i);
+void Application::Renderer::DebugDrawScene(VkCommandBuffer& cmd,
+                                           uint32_t frame_i,
+                                           SceneDrawDetails& details) {
   vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
                           debugdraw_pipeline_layout_, 0, 1,
-                          &debugdraw_descriptor_sets_[image_i], 0, nullptr);
+                          &debugdraw_descriptor_sets_[frame_i], 0, nullptr);
+  PushCameraConstants(cmd, debugdraw_pipeline_layout_, details);
   for (const DebugDrawObject* debugdraw_object : scene_->debugdraw_objects_) {
     switch (debugdraw_object->type_) {
       case DebugDrawType::kAABB: {
         const DebugDrawAABB* draw_aabb =
             static_cast<const DebugDrawAABB*>(debugdraw_object);
         const Aabb& aabb = draw_aabb->aabb_;
-        DebugDrawSceneAabb(image_i, aabb, details);
+        DebugDrawSceneAabb(cmd, frame_i, aabb, details);
         break;
       }
       case DebugDrawType::kBillboard: {
         const DebugDrawBillboard* draw_bb =
             static_cast<const DebugDrawBillboard*>(debugdraw_object);
-        DebugDrawSceneBillboard(image_i, draw_bb, details);
+        DebugDrawSceneBillboard(cmd, frame_i, draw_bb, details);
         break;
       }
       default:
@@ -589,11 +1071,9 @@ void Application::Renderer::DebugDrawScene(uint32_t image_i, SceneDrawDetails& d
         break;
     }
   }
-  vkCmdEndRenderPass(cmd);
 }
-void Application::Renderer::DebugDrawSceneAabb(uint32_t image_i,
+void Application::Renderer::DebugDrawSceneAabb(VkCommandBuffer& cmd, uint32_t frame_i,
                                           const Aabb& aabb, SceneDrawDetails& details) {
-  VkCommandBuffer& cmd = command_buffers_[image_i];
   static auto BitmaskToVertex = [](uint32_t bm,
                                    const Aabb& aabb) -> DebugDrawVertex {
     DebugDrawVertex a{};
@@ -623,13 +1103,11 @@ void Application::Renderer::DebugDrawSceneAabb(uint32_t image_i,
       vertices.push_back(v_b);
     }
   }
-  void* data;
-  vkMapMemory(device_, debugdraw_memory_[image_i], 0, VK_WHOLE_SIZE, 0, &data);
+  void* data = MapMemory(debugdraw_memory_[frame_i]);
   memcpy(static_cast<char*>(data) +
              details.debugdraw_offset_ * sizeof(DebugDrawVertex),
          vertices.data(),
          static_cast<size_t>(vertices.size() * sizeof(DebugDrawVertex)));
-  vkUnmapMemory(device_, debugdraw_memory_[image_i]);
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     debugdraw_lines_pipeline_);
   glm::mat4 identity(1.0f);
@@ -642,15 +1120,15 @@ void Application::Renderer::DebugDrawSceneAabb(uint32_t image_i,
       cmd, debugdraw_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
       offsetof(PushConstantData, material_id), sizeof(uint32_t), &aabb_id);
   VkDeviceSize vertex_offsets[] = {static_cast<uint64_t>(0)};
-  vkCmdBindVertexBuffers(cmd, 0, 1, &debugdraw_buffer_[image_i],
+  vkCmdBindVertexBuffers(cmd, 0, 1, &debugdraw_buffer_[frame_i],
                          vertex_offsets);
   vkCmdDraw(cmd, vertices.size(), 1, details.debugdraw_offset_, 0);
   details.debugdraw_offset_ += static_cast<uint32_t>(vertices.size());
 }
 void Application::Renderer::DebugDrawSceneBillboard(
-    uint32_t image_i, const DebugDrawBillboard* billboard, SceneDrawDetails& details) {
+    VkCommandBuffer& cmd, uint32_t frame_i, const DebugDrawBillboard* billboard,
+    SceneDrawDetails& details) {
   static float kBillboardDim = 0.05f;
-  VkCommandBuffer& cmd = command_buffers_[image_i];
   glm::vec4 world_pos = glm::vec4(billboard->position_,1.0f);
   glm::vec4 view_pos =
       details.push_constants.world_to_view_transform * world_pos;
@@ -668,10 +1146,8 @@ void Application::Renderer::DebugDrawSceneBillboard(
   DebugDrawVertex bb_vert_buffer[] = {bb_verts[0], bb_verts[1], bb_verts[3],
                              bb_verts[3], bb_verts[2], bb_verts[0]};
 
-  void* data;
-  vkMapMemory(device_, debugdraw_memory_[image_i], 0, VK_WHOLE_SIZE, 0, &data);
+  void* data = MapMemory(debugdraw_memory_[frame_i]);
   memcpy(static_cast<char*>(data)+details.debugdraw_offset_*sizeof(DebugDrawVertex), bb_vert_buffer, sizeof(bb_vert_buffer));
-  vkUnmapMemory(device_, debugdraw_memory_[image_i]);
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     debugdraw_pipeline_);
   glm::mat4 eye(1.0f);
@@ -691,43 +1167,33 @@ void Application::Renderer::DebugDrawSceneBillboard(
       cmd, debugdraw_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
       offsetof(PushConstantData, material_id), sizeof(uint32_t), &billboard_id);
   VkDeviceSize vertex_offsets[] = {0};
-  vkCmdBindVertexBuffers(cmd, 0, 1, &debugdraw_buffer_[image_i],
+  vkCmdBindVertexBuffers(cmd, 0, 1, &debugdraw_buffer_[frame_i],
                          vertex_offsets);
   vkCmdDraw(cmd, 6, 1, details.debugdraw_offset_, 0);
   details.debugdraw_offset_ += 6;
 }
-void Application::Renderer::DrawSceneShadowmaps(VkCommandBuffer& cmd,
-                                                uint32_t swapchain_image_i,
-                                                SceneDrawDetails& details) {
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowmap_pipeline_);
-  for (uint32_t shadow_i = 0;
-       shadow_i < details.directional_light_uniform.light_count_; shadow_i++) {
-    DirectionalLight light =
-        details.directional_light_uniform.lights_[shadow_i];
-    vkCmdPushConstants(cmd, shadowmap_pipeline_layout_,
-                       VK_SHADER_STAGE_VERTEX_BIT,
-                       offsetof(PushConstantData, world_to_view_transform),
-                       sizeof(light.world_to_light_transform),
-                       &light.world_to_light_transform);
-    vkCmdPushConstants(
-        cmd, shadowmap_pipeline_layout_,
-                       VK_SHADER_STAGE_VERTEX_BIT,
-                       offsetof(PushConstantData, view_to_clip_transform),
-                       sizeof(light.light_to_clip_transform),
-                       &light.light_to_clip_transform);
-    BeginShadowmapRenderPass(cmd, shadowmap_framebuffers_[swapchain_image_i][shadow_i]);
-    DrawSceneMeshes(cmd, shadowmap_pipeline_layout_, details, scene_->root_, glm::mat4(1.0f));
-    vkCmdEndRenderPass(cmd);
-  }
+void Application::Renderer::DrawSceneShadowmap(VkCommandBuffer& cmd,
+                                               uint32_t shadow_i,
+                                               SceneDrawDetails& details) {
+  DirectionalLight& light = details.directional_light_uniform.lights_[shadow_i];
+  vkCmdPushConstants(cmd, shadowmap_pipeline_layout_,
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     offsetof(PushConstantData, world_to_view_transform),
+                     sizeof(light.world_to_light_transform),
+                     &light.world_to_light_transform);
+  vkCmdPushConstants(cmd, shadowmap_pipeline_layout_,
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     offsetof(PushConstantData, view_to_clip_transform),
+                     sizeof(light.light_to_clip_transform),
+                     &light.light_to_clip_transform);
+  DrawSceneMeshes(cmd, shadowmap_pipelines_, position_geometries_,
+                  shadowmap_pipeline_layout_, details);
 }
 void Application::Renderer::DrawSceneZPrePass(VkCommandBuffer& cmd,
-                                              uint32_t swapchain_image_i,
                                               SceneDrawDetails& details) {
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, depthmap_pipeline_);
-  BeginDepthmapRenderPass(cmd, swapchain_image_i);
-  DrawSceneMeshes(cmd, depthmap_pipeline_layout_, details, scene_->root_,
-                  glm::mat4(1.0f));
-  vkCmdEndRenderPass(cmd);
+  PushCameraConstants(cmd, depthmap_pipeline_layout_, details);
+  DrawSceneMeshes(cmd, depthmap_pipelines_, position_geometries_,
+                  depthmap_pipeline_layout_, details);
 }
 void Application::Renderer::DrawScenePrePass(VkCommandBuffer& cmd,
                                              SceneDrawDetails& details,
@@ -1,6 +1,8 @@
 // Rendering pipeline resources for shadowmaps
 #include <catalyst/render/renderer.h>
 
+#include <algorithm>
+
 namespace catalyst {
 void Application::Renderer::CreateShadowmapRenderPass() {
   VkAttachmentDescription depth_attachment{};
@@ -11,9 +13,10 @@ void Application::Renderer::CreateShadowmapRenderPass() {
   depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth_attachment.initialLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_attachment.finalLayout =
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depth_ref{};
   depth_ref.attachment = 0;
@@ -31,16 +34,6 @@ void Application::Renderer::CreateShadowmapRenderPass() {
   subpass.preserveAttachmentCount = 0;
   subpass.pPreserveAttachments = nullptr;
 
-  VkSubpassDependency dependency{};
-  dependency.srcSubpass = 0;
-  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
   VkRenderPassCreateInfo render_pass_ci{};
   render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   render_pass_ci.pNext = nullptr;
@@ -49,8 +42,8 @@ void Application::Renderer::CreateShadowmapRenderPass() {
   render_pass_ci.pAttachments = &depth_attachment;
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 1;
-  render_pass_ci.pDependencies = &dependency;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
   VkResult create_result = vkCreateRenderPass(device_, &render_pass_ci, nullptr,
                                               &shadowmap_render_pass_);
   ASSERT(create_result == VK_SUCCESS, "Could not create shadowmap render pass!");
@@ -87,53 +80,6 @@ void Application::Renderer::CreateShadowmapPipeline() {
   VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_ci,
                                                      frag_shader_stage_ci};
 
-  VkVertexInputBindingDescription vertex_bd{};
-  vertex_bd.binding = 0;
-  vertex_bd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  vertex_bd.stride = sizeof(Vertex);
-
-  VkVertexInputAttributeDescription vertex_pos_ad{};
-  vertex_pos_ad.binding = 0;
-  vertex_pos_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_pos_ad.location = 0;
-  vertex_pos_ad.offset = 0;
-
-  VkVertexInputAttributeDescription vertex_norm_ad{};
-  vertex_norm_ad.binding = 0;
-  vertex_norm_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_norm_ad.location = 1;
-  vertex_norm_ad.offset = offsetof(Vertex, normal);
-
-  VkVertexInputAttributeDescription vertex_uv_ad{};
-  vertex_uv_ad.binding = 0;
-  vertex_uv_ad.format = VK_FORMAT_R32G32_SFLOAT;
-  vertex_uv_ad.location = 2;
-  vertex_uv_ad.offset = offsetof(Vertex, uv);
-
-  VkVertexInputAttributeDescription vertex_tan_ad{};
-  vertex_tan_ad.binding = 0;
-  vertex_tan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_tan_ad.location = 3;
-  vertex_tan_ad.offset = offsetof(Vertex, tangent);
-
-  VkVertexInputAttributeDescription vertex_bitan_ad{};
-  vertex_bitan_ad.binding = 0;
-  vertex_bitan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_bitan_ad.location = 4;
-  vertex_bitan_ad.offset = offsetof(Vertex, bitangent);
-
-  VkVertexInputAttributeDescription vertex_ads[] = {
-      vertex_pos_ad, vertex_norm_ad, vertex_uv_ad, vertex_tan_ad,
-      vertex_bitan_ad};
-
-  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-  vertex_input_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.vertexAttributeDescriptionCount = 5;
-  vertex_input_info.pVertexBindingDescriptions = &vertex_bd;
-  vertex_input_info.pVertexAttributeDescriptions = vertex_ads;
-
   VkPipelineInputAssemblyStateCreateInfo input_assembly_state{};
   input_assembly_state.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -224,7 +170,6 @@ void Application::Renderer::CreateShadowmapPipeline() {
   pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_ci.stageCount = 2;
   pipeline_ci.pStages = shader_stages;
-  pipeline_ci.pVertexInputState = &vertex_input_info;
   pipeline_ci.pInputAssemblyState = &input_assembly_state;
   pipeline_ci.pViewportState = &viewport_state;
   pipeline_ci.pRasterizationState = &rasterizer_state;
@@ -236,39 +181,100 @@ void Application::Renderer::CreateShadowmapPipeline() {
   pipeline_ci.subpass = 0;
   pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
 
-  create_result = vkCreateGraphicsPipelines(
-      device_, pipeline_cache_, 1, &pipeline_ci, nullptr, &shadowmap_pipeline_);
-  ASSERT(create_result == VK_SUCCESS, "Failed to create shadowmap pipeline!");
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    VertexInputState vertex_input;
+    GetVertexInputState(static_cast<VertexFormat>(format_i), true,
+                        vertex_input);
+    pipeline_ci.pVertexInputState = &vertex_input.ci;
+    create_result = vkCreateGraphicsPipelines(
+        device_, pipeline_cache_, 1, &pipeline_ci, nullptr,
+        &shadowmap_pipelines_[format_i]);
+    ASSERT(create_result == VK_SUCCESS,
+           "Failed to create shadowmap pipeline!");
+  }
 
   vkDestroyShaderModule(device_, vert_shader, nullptr);
   vkDestroyShaderModule(device_, frag_shader, nullptr);
 }
-void Application::Renderer::CreateDirectionalShadowmapFramebuffers() {
-  shadowmap_framebuffers_.resize(frame_count_);
+void Application::Renderer::CreateShadowmap(Shadowmap& shadowmap) {
+  VkExtent3D shadowmap_extent;
+  shadowmap_extent.width = Scene::kMaxShadowmapResolution;
+  shadowmap_extent.height = Scene::kMaxShadowmapResolution;
+  shadowmap_extent.depth = 1;
+  shadowmap.images.resize(frame_count_);
+  shadowmap.image_views.resize(frame_count_);
+  shadowmap.framebuffers.resize(frame_count_);
+  // Every shadowmap pass discards the previous contents, so the images need
+  // no initial layout
+  CreateAliasedImages(shadowmap.images, shadowmap.memory,
+                      MemoryCategory::kShadowmaps, 0, depth_format_,
+                      shadowmap_extent, 1, 1,
+                      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                          VK_IMAGE_USAGE_SAMPLED_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                      VK_SAMPLE_COUNT_1_BIT);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    shadowmap_framebuffers_[frame_i].resize(Scene::kMaxDirectionalLights);
-    for (uint32_t shadow_i = 0; shadow_i < Scene::kMaxDirectionalLights;
-         shadow_i++) {
-      VkFramebufferCreateInfo framebuffer_ci{};
-      framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-      framebuffer_ci.pNext = nullptr;
-      framebuffer_ci.flags = 0;
-      framebuffer_ci.renderPass = shadowmap_render_pass_;
-      framebuffer_ci.attachmentCount = 1;
-      framebuffer_ci.pAttachments = &shadowmap_image_views_[frame_i][shadow_i];
-      framebuffer_ci.width = Scene::kMaxShadowmapResolution;
-      framebuffer_ci.height = Scene::kMaxShadowmapResolution;
-      framebuffer_ci.layers = 1;
-      VkResult create_result =
-          vkCreateFramebuffer(device_, &framebuffer_ci, nullptr,
-                              &shadowmap_framebuffers_[frame_i][shadow_i]);
-      ASSERT(create_result == VK_SUCCESS,
-             "Could not create shadowmap framebuffer!");
-    }
+    CreateImageView(shadowmap.image_views[frame_i], shadowmap.images[frame_i],
+                    VK_IMAGE_VIEW_TYPE_2D, depth_format_,
+                    VK_IMAGE_ASPECT_DEPTH_BIT);
+    VkFramebufferCreateInfo framebuffer_ci{};
+    framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_ci.pNext = nullptr;
+    framebuffer_ci.flags = 0;
+    framebuffer_ci.renderPass = shadowmap_render_pass_;
+    framebuffer_ci.attachmentCount = 1;
+    framebuffer_ci.pAttachments = &shadowmap.image_views[frame_i];
+    framebuffer_ci.width = Scene::kMaxShadowmapResolution;
+    framebuffer_ci.height = Scene::kMaxShadowmapResolution;
+    framebuffer_ci.layers = 1;
+    VkResult create_result = vkCreateFramebuffer(
+        device_, &framebuffer_ci, nullptr, &shadowmap.framebuffers[frame_i]);
+    ASSERT(create_result == VK_SUCCESS,
+           "Could not create shadowmap framebuffer!");
+  }
+}
+void Application::Renderer::DestroyShadowmap(Shadowmap& shadowmap) {
+  ResetScenePassImage(shadowmap.images[0]);
+  RemoveImageAliases(shadowmap.images);
+  for (uint32_t frame_i = 0; frame_i < shadowmap.images.size(); frame_i++) {
+    vkDestroyFramebuffer(device_, shadowmap.framebuffers[frame_i], nullptr);
+    vkDestroyImageView(device_, shadowmap.image_views[frame_i], nullptr);
+    vkDestroyImage(device_, shadowmap.images[frame_i], nullptr);
   }
+  FreeMemory(shadowmap.memory);
+  shadowmap = Shadowmap();
+}
+void Application::Renderer::ReserveShadowmaps(uint32_t light_count) {
+  RetireShadowmaps();
+  if (light_count == shadowmaps_.size()) return;
+  while (shadowmaps_.size() < light_count) {
+    shadowmaps_.emplace_back();
+    CreateShadowmap(shadowmaps_.back());
+  }
+  // Frames submitted so far may still sample the shadowmaps of removed lights
+  while (shadowmaps_.size() > light_count) {
+    released_shadowmaps_.push_back(
+        {frame_timeline_value_, std::move(shadowmaps_.back())});
+    shadowmaps_.pop_back();
+  }
+  shadowmap_descriptors_stale_.assign(frame_count_, true);
+}
+void Application::Renderer::RetireShadowmaps() {
+  uint64_t completed_value = 0;
+  vkGetSemaphoreCounterValue(device_, frame_timeline_semaphore_,
+                             &completed_value);
+  auto retired_begin = std::partition(
+      released_shadowmaps_.begin(), released_shadowmaps_.end(),
+      [completed_value](const std::pair<uint64_t, Shadowmap>& released) {
+        return released.first > completed_value;
+      });
+  for (auto it = retired_begin; it != released_shadowmaps_.end(); it++)
+    DestroyShadowmap(it->second);
+  released_shadowmaps_.erase(retired_begin, released_shadowmaps_.end());
 }
 void Application::Renderer::BeginShadowmapRenderPass(
-    VkCommandBuffer& cmd, VkFramebuffer& framebuffer) {
+    VkCommandBuffer& cmd, VkFramebuffer& framebuffer,
+    VkSubpassContents contents) {
   VkClearValue depth_clear;
   depth_clear.depthStencil.depth = 1.0f;
   depth_clear.depthStencil.stencil = 0;
@@ -284,6 +290,6 @@ void Application::Renderer::BeginShadowmapRenderPass(
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 1;
   render_pass_bi.pClearValues = clear_values;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 }
\ No newline at end of file
@@ -8,7 +8,8 @@ void Application::Renderer::CreateSsaoResources() {
   ssn_format_ = VK_FORMAT_R8G8B8A8_UNORM;
 
   // Create Screen-Space Noise Resources
-  CreateImage(ssn_image_, ssn_memory_, 0, ssn_format_,
+  CreateImage(ssn_image_, ssn_memory_, MemoryCategory::kTextures, 0,
+              ssn_format_,
               {half_swapchain_extent_.width, half_swapchain_extent_.height, 1},
               1, 1, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
@@ -21,14 +22,6 @@ void Application::Renderer::CreateSsaoResources() {
   VkDeviceSize ssn_size =
       sizeof(glm::vec3) * half_swapchain_extent_.width * half_swapchain_extent_.height;
 
-  // Create Staging Buffer
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_memory;
-  CreateBuffer(staging_buffer, staging_memory, ssn_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
   // Generate Screen Space Noise Data
   std::uniform_real_distribution<float> random_float(0.0f, 1.0f);
   std::default_random_engine random_gen;
@@ -44,16 +37,13 @@ void Application::Renderer::CreateSsaoResources() {
   }
 
   // Copy Noise Data to Staging Buffer
-  void* staging_data;
-  vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data);
-  memcpy(staging_data, noise_vec.data(), ssn_size);
-  vkUnmapMemory(device_, staging_memory);
+  VkDeviceSize staging_offset = 0;
+  VkBuffer staging_buffer =
+      StageSetupData(noise_vec.data(), ssn_size, staging_offset);
 
   // Copy Staging Buffer to SSN image
-  VkCommandBuffer cmd;
-  BeginSingleUseCommandBuffer(cmd);
   VkBufferImageCopy buffer_cp{};
-  buffer_cp.bufferOffset = 0;
+  buffer_cp.bufferOffset = staging_offset;
   buffer_cp.bufferRowLength = 0;
   buffer_cp.bufferImageHeight = 0;
   buffer_cp.imageOffset = {0, 0, 0};
@@ -63,12 +53,8 @@ void Application::Renderer::CreateSsaoResources() {
   buffer_cp.imageSubresource.baseArrayLayer = 0;
   buffer_cp.imageSubresource.layerCount = 1;
   buffer_cp.imageSubresource.mipLevel = 0;
-  vkCmdCopyBufferToImage(cmd, staging_buffer, ssn_image_,
+  vkCmdCopyBufferToImage(BeginSetupCommands(), staging_buffer, ssn_image_,
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_cp);
-  EndSingleUseCommandBuffer(cmd);
-  // Destroy Staging Buffer
-  vkFreeMemory(device_,staging_memory, nullptr);
-  vkDestroyBuffer(device_,staging_buffer, nullptr);
   TransitionImageLayout(
       ssn_image_, VK_IMAGE_ASPECT_COLOR_BIT,
       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -93,48 +79,45 @@ void Application::Renderer::CreateSsaoResources() {
     samples[sample_i] = glm::vec4(sample_dir*sample_len,0.0f);
   }
 
-  // Create Staging Buffer
-  CreateBuffer(staging_buffer, staging_memory, sample_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
   // Create SSAO Sample Uniform Buffer
   CreateBuffer(
-      ssao_sample_uniform_, ssao_sample_memory_, sample_size,
+      ssao_sample_uniform_, ssao_sample_memory_, MemoryCategory::kUniforms,
+      sample_size,
       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   // Copy Sample Data to Staging Buffer
-  vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data);
-  memcpy(staging_data, samples, sample_size);
-  vkUnmapMemory(device_, staging_memory);
+  staging_buffer = StageSetupData(samples, sample_size, staging_offset);
 
   // Copy Staging Buffer to Sample Uniform
-  BeginSingleUseCommandBuffer(cmd);
   VkBufferCopy sample_cp{};
-  sample_cp.srcOffset = 0;
+  sample_cp.srcOffset = staging_offset;
   sample_cp.dstOffset = 0;
   sample_cp.size = sample_size;
-  vkCmdCopyBuffer(cmd, staging_buffer, ssao_sample_uniform_, 1, &sample_cp);
-  EndSingleUseCommandBuffer(cmd);
-
-  // Destroy Staging Buffer
-  vkFreeMemory(device_, staging_memory, nullptr);
-  vkDestroyBuffer(device_, staging_buffer, nullptr);
+  vkCmdCopyBuffer(BeginSetupCommands(), staging_buffer, ssao_sample_uniform_,
+                  1, &sample_cp);
 
   ssao_images_.resize(frame_count_);
   ssao_image_views_.resize(frame_count_);
-  ssao_memory_.resize(frame_count_);
+  ssao_memory_.assign(frame_count_, MemoryAllocation());
+  // Each frame recomputes its map before the main pass reads it, so frames in
+  // flight share memory
+  CreateAliasedImages(
+      ssao_images_, ssao_memory_[0], MemoryCategory::kRenderTargets, 0,
+      ssao_format_,
+      {half_swapchain_extent_.width, half_swapchain_extent_.height, 1}, 1, 1,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_SAMPLE_COUNT_1_BIT);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateImage(
-        ssao_images_[frame_i], ssao_memory_[frame_i], 0, ssao_format_,
-        {half_swapchain_extent_.width, half_swapchain_extent_.height, 1}, 1, 1,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
     CreateImageView(ssao_image_views_[frame_i], ssao_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, ssao_format_,
                     VK_IMAGE_ASPECT_COLOR_BIT);
+    // The SSAO pass may be culled, but its map stays bound to the main pass
+    TransitionImageLayout(
+        ssao_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_ACCESS_SHADER_READ_BIT);
   }
 }
 void Application::Renderer::CreateSsaoRenderPass() {
@@ -146,9 +129,8 @@ void Application::Renderer::CreateSsaoRenderPass() {
   ssao_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   ssao_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   ssao_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-  ssao_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  ssao_attachment.finalLayout =
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  ssao_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  ssao_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference ssao_ref{};
   ssao_ref.attachment = 0;
@@ -166,15 +148,6 @@ void Application::Renderer::CreateSsaoRenderPass() {
   subpass.preserveAttachmentCount = 0;
   subpass.pPreserveAttachments = nullptr;
 
-  VkSubpassDependency dependency{};
-  dependency.srcSubpass = 0;
-  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
   VkRenderPassCreateInfo render_pass_ci{};
   render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   render_pass_ci.pNext = nullptr;
@@ -183,8 +156,8 @@ void Application::Renderer::CreateSsaoRenderPass() {
   render_pass_ci.pAttachments = &ssao_attachment;
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 1;
-  render_pass_ci.pDependencies = &dependency;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
   VkResult create_result = vkCreateRenderPass(device_, &render_pass_ci, nullptr,
                                               &ssao_render_pass_);
   ASSERT(create_result == VK_SUCCESS, "Could not create SSAO render pass!");
@@ -376,19 +349,20 @@ void Application::Renderer::CreateSsaoFramebuffers() {
 }
 
 void Application::Renderer::BeginSsaoRenderPass(VkCommandBuffer& cmd,
-                                                uint32_t swapchain_image_i) {
+                                                uint32_t frame_i,
+                                                VkSubpassContents contents) {
   VkClearValue color_clear;
   color_clear.color = {{0.0f, 0.0f, 0.0f, 0.0f}};
   VkRenderPassBeginInfo render_pass_bi{};
   render_pass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_bi.pNext = nullptr;
   render_pass_bi.renderPass = ssao_render_pass_;
-  render_pass_bi.framebuffer = ssao_framebuffers_[swapchain_image_i];
+  render_pass_bi.framebuffer = ssao_framebuffers_[frame_i];
   render_pass_bi.renderArea.extent = half_swapchain_extent_;
   render_pass_bi.renderArea.offset.x = 0;
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 1;
   render_pass_bi.pClearValues = &color_clear;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 }
\ No newline at end of file
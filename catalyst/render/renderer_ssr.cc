@@ -5,22 +5,23 @@ void Application::Renderer::CreateSsrResources() {
   ssr_format_ = hdr_format_;
   ssr_images_.resize(frame_count_);
   ssr_image_views_.resize(frame_count_);
-  ssr_memory_.resize(frame_count_);
-  ssr_uniform_memory_.resize(frame_count_);
-  ssr_uniform_.resize(frame_count_);
+  ssr_memory_.assign(frame_count_, MemoryAllocation());
+  CreateAliasedImages(
+      ssr_images_, ssr_memory_[0], MemoryCategory::kRenderTargets, 0,
+      ssr_format_,
+      {half_swapchain_extent_.width, half_swapchain_extent_.height, 1}, 1, 1,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_SAMPLE_COUNT_1_BIT);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateImage(
-        ssr_images_[frame_i], ssr_memory_[frame_i], 0, ssr_format_,
-        {half_swapchain_extent_.width, half_swapchain_extent_.height, 1}, 1, 1,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
     CreateImageView(ssr_image_views_[frame_i], ssr_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, ssr_format_,
                     VK_IMAGE_ASPECT_COLOR_BIT);
-    CreateBuffer(ssr_uniform_[frame_i], ssr_uniform_memory_[frame_i],
-                 sizeof(SsrUniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // The SSR pass may be culled, but its map stays bound to the main pass
+    TransitionImageLayout(
+        ssr_images_[frame_i], VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_ACCESS_SHADER_READ_BIT);
   }
 }
 void Application::Renderer::CreateSsrRenderPass() {
@@ -32,8 +33,8 @@ void Application::Renderer::CreateSsrRenderPass() {
   ssr_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   ssr_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   ssr_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-  ssr_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  ssr_attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  ssr_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  ssr_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference ssr_ref{};
   ssr_ref.attachment = 0;
@@ -51,15 +52,6 @@ void Application::Renderer::CreateSsrRenderPass() {
   subpass.preserveAttachmentCount = 0;
   subpass.pPreserveAttachments = nullptr;
 
-  VkSubpassDependency dependency{};
-  dependency.srcSubpass = 0;
-  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
   VkRenderPassCreateInfo render_pass_ci{};
   render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   render_pass_ci.pNext = nullptr;
@@ -68,8 +60,8 @@ void Application::Renderer::CreateSsrRenderPass() {
   render_pass_ci.pAttachments = &ssr_attachment;
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 1;
-  render_pass_ci.pDependencies = &dependency;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
   VkResult create_result =
       vkCreateRenderPass(device_, &render_pass_ci, nullptr, &ssr_render_pass_);
   ASSERT(create_result == VK_SUCCESS, "Could not create SSR render pass!");
@@ -258,41 +250,37 @@ void Application::Renderer::CreateSsrFramebuffers() {
   }
 }
 void Application::Renderer::BeginSsrRenderPass(VkCommandBuffer& cmd,
-                                                uint32_t swapchain_image_i) {
+                                                uint32_t frame_i,
+                                                VkSubpassContents contents) {
   VkClearValue color_clear;
   color_clear.color = {{0.0f, 0.0f, 0.0f, 0.0f}};
   VkRenderPassBeginInfo render_pass_bi{};
   render_pass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_bi.pNext = nullptr;
   render_pass_bi.renderPass = ssr_render_pass_;
-  render_pass_bi.framebuffer = ssr_framebuffers_[swapchain_image_i];
+  render_pass_bi.framebuffer = ssr_framebuffers_[frame_i];
   render_pass_bi.renderArea.extent = half_swapchain_extent_;
   render_pass_bi.renderArea.offset.x = 0;
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 1;
   render_pass_bi.pClearValues = &color_clear;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 void Application::Renderer::ComputeSsrMap(VkCommandBuffer& cmd,
-                                          uint32_t image_i, SceneDrawDetails& details) {
-  uint32_t prev_image_i = (image_i + frame_count_ - 1) % frame_count_;
-  // Clear SSR map
-  BeginSsrRenderPass(cmd, image_i);
-  // If previous frame is not available (for eg, due to resizing), stop here
-  if (!rendered_frames_[prev_image_i] ||
-      !details.renderer_uniform.ssr_enabled) {
-    vkCmdEndRenderPass(cmd);
+                                          uint32_t frame_i, SceneDrawDetails& details) {
+  uint32_t prev_frame_i = (frame_i + frame_count_ - 1) % frame_count_;
+  // The SSR render pass (begun by the caller) clears the SSR map. If previous
+  // frame is not available (for eg, due to resizing), stop here
+  if (!rendered_frames_[prev_frame_i]) {
     return;
   }
-  void* uniform_data = nullptr;
-  vkMapMemory(device_, ssr_uniform_memory_[image_i], 0, VK_WHOLE_SIZE, 0, &uniform_data);
-  memcpy(uniform_data, &details.ssr_uniform, sizeof(details.ssr_uniform));
-  vkUnmapMemory(device_, ssr_uniform_memory_[image_i]);
   vkCmdBindDescriptorSets(
       cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ssr_pipeline_layout_, 0, 1,
-      &ssr_descriptor_sets_[image_i], 0, nullptr);
+      &ssr_descriptor_sets_[frame_i], 1, &details.uniform_offsets.ssr);
+  PushCameraConstants(cmd, ssr_pipeline_layout_, details);
+  VkDeviceSize vertex_offsets[] = {0};
+  vkCmdBindVertexBuffers(cmd, 0, 1, &skybox_vertex_buffer_, vertex_offsets);
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, ssr_pipeline_);
   vkCmdDraw(cmd, 6, 1, 0, 0);
-  vkCmdEndRenderPass(cmd);
 }
 }
\ No newline at end of file
@@ -2,12 +2,17 @@
 
 #include <array>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 
 #include <catalyst/time/timemanager.h>
 #include <catalyst/dev/dev.h>
+#include <catalyst/filesystem/mappedfile.h>
 
 namespace catalyst {
 Application::Renderer::SwapchainSupportDetails Application::Renderer::CheckSwapchainSupport(
@@ -80,6 +85,10 @@ VkExtent2D Application::Renderer::SelectSwapExtent(
   }
 }
 void Application::Renderer::CreateSwapchain() {
+  if (headless_) {
+    CreateOffscreenImages();
+    return;
+  }
   SwapchainSupportDetails swapchain_support =
       CheckSwapchainSupport(physical_device_);
 
@@ -135,9 +144,22 @@ void Application::Renderer::CreateSwapchain() {
   swapchain_images_.resize(image_count);
   vkGetSwapchainImagesKHR(device_, swapchain_, &image_count,
                           swapchain_images_.data());
+  // The presentation engine holds the semaphore until the image is acquired
+  // again, so there is one per image rather than per frame in flight
+  image_presented_semaphores_.resize(image_count);
+  VkSemaphoreCreateInfo sem_ci{};
+  sem_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  sem_ci.pNext = nullptr;
+  sem_ci.flags = 0;
+  for (uint32_t image_i = 0; image_i < image_count; image_i++) {
+    VkResult sem_result = vkCreateSemaphore(
+        device_, &sem_ci, nullptr, &image_presented_semaphores_[image_i]);
+    ASSERT(sem_result == VK_SUCCESS, "Failed to create semaphore!");
+  }
 
   swapchain_image_format_ = surface_format.format;
   swapchain_extent_ = extent;
+  output_image_layout_ = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
   half_swapchain_extent_ = {swapchain_extent_.width / 2,
                             swapchain_extent_.height / 2};
 
@@ -148,7 +170,38 @@ void Application::Renderer::CreateSwapchain() {
                     swapchain_image_format_, VK_IMAGE_ASPECT_COLOR_BIT);
     swapchain_image_views_.push_back(image_view);
   }
-  frame_count_ = static_cast<uint32_t>(swapchain_images_.size());
+  rendered_frames_.resize(frame_count_, false);
+  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++)
+    rendered_frames_[frame_i] = false;
+}
+void Application::Renderer::CreateOffscreenImages() {
+  // One offscreen image per frame in flight, left in a layout that can be
+  // copied out for inspection
+  std::pair<uint32_t, uint32_t> window_extent = window_->GetExtent();
+  swapchain_image_format_ = VK_FORMAT_B8G8R8A8_UNORM;
+  swapchain_extent_ = {window_extent.first, window_extent.second};
+  half_swapchain_extent_ = {swapchain_extent_.width / 2,
+                            swapchain_extent_.height / 2};
+  output_image_layout_ = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  msaa_samples_ = VK_SAMPLE_COUNT_4_BIT;
+
+  swapchain_images_.resize(frame_count_);
+  offscreen_memory_.resize(frame_count_);
+  swapchain_image_views_.clear();
+  for (uint32_t image_i = 0; image_i < frame_count_; image_i++) {
+    CreateImage(swapchain_images_[image_i], offscreen_memory_[image_i],
+                MemoryCategory::kRenderTargets, 0,
+                swapchain_image_format_,
+                {swapchain_extent_.width, swapchain_extent_.height, 1}, 1, 1,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
+    VkImageView image_view;
+    CreateImageView(image_view, swapchain_images_[image_i],
+                    VK_IMAGE_VIEW_TYPE_2D, swapchain_image_format_,
+                    VK_IMAGE_ASPECT_COLOR_BIT);
+    swapchain_image_views_.push_back(image_view);
+  }
   rendered_frames_.resize(frame_count_, false);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++)
     rendered_frames_[frame_i] = false;
@@ -185,98 +238,99 @@ void Application::Renderer::CreateDepthResources() {
   depth_format_ = SelectDepthFormat();
   depth_images_.resize(frame_count_);
   depth_image_views_.resize(frame_count_);
-  depth_memory_.resize(frame_count_);
+  depth_memory_.assign(frame_count_, MemoryAllocation());
   depth_msaa_images_.resize(frame_count_);
-  depth_msaa_memory_.resize(frame_count_);
+  depth_msaa_memory_.assign(frame_count_, MemoryAllocation());
   depth_msaa_views_.resize(frame_count_);
+  VkExtent3D depth_extent;
+  depth_extent.width = swapchain_extent_.width;
+  depth_extent.height = swapchain_extent_.height;
+  depth_extent.depth = 1;
+  // Frames in flight run one after another on the graphics queue, so their
+  // depth buffers share memory. The multisampled depth is stored between the
+  // z-prepass and the main pass, so it can not be transient.
+  CreateAliasedImages(
+      depth_images_, depth_memory_[0], MemoryCategory::kRenderTargets, 0,
+      depth_format_, depth_extent, 1, 1,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_SAMPLE_COUNT_1_BIT);
+  CreateAliasedImages(depth_msaa_images_, depth_msaa_memory_[0],
+                      MemoryCategory::kRenderTargets, 0,
+                      depth_format_, depth_extent, 1, 1,
+                      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, msaa_samples_);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    VkExtent3D depth_extent;
-    depth_extent.width = swapchain_extent_.width;
-    depth_extent.height = swapchain_extent_.height;
-    depth_extent.depth = 1;
-    CreateImage(depth_images_[frame_i], depth_memory_[frame_i], 0,
-                depth_format_, depth_extent, 1, 1,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
     CreateImageView(depth_image_views_[frame_i], depth_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, depth_format_,
                     VK_IMAGE_ASPECT_DEPTH_BIT);
-    CreateImage(depth_msaa_images_[frame_i], depth_msaa_memory_[frame_i], 0,
-                depth_format_, depth_extent, 1, 1,
-                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, msaa_samples_);
     CreateImageView(depth_msaa_views_[frame_i], depth_msaa_images_[frame_i],
                     VK_IMAGE_VIEW_TYPE_2D, depth_format_,
                     VK_IMAGE_ASPECT_DEPTH_BIT);
   }
 }
 void Application::Renderer::CreateDirectionalShadowmapResources() {
-  shadowmap_images_.resize(frame_count_);
-  shadowmap_image_views_.resize(frame_count_);
-  shadowmap_memory_.resize(frame_count_);
-  VkExtent3D shadowmap_extent;
-  shadowmap_extent.width = Scene::kMaxShadowmapResolution;
-  shadowmap_extent.height = Scene::kMaxShadowmapResolution;
-  shadowmap_extent.depth = 1;
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    shadowmap_images_[frame_i].resize(Scene::kMaxDirectionalLights);
-    shadowmap_image_views_[frame_i].resize(Scene::kMaxDirectionalLights);
-    shadowmap_memory_[frame_i].resize(Scene::kMaxDirectionalLights);
-    for (uint32_t shadowmap_i = 0; shadowmap_i < Scene::kMaxDirectionalLights;
-         shadowmap_i++) {
-      CreateImage(shadowmap_images_[frame_i][shadowmap_i],
-                  shadowmap_memory_[frame_i][shadowmap_i], 0, depth_format_,
-                  shadowmap_extent, 1, 1,
-                  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-                      VK_IMAGE_USAGE_SAMPLED_BIT,
-                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
-      CreateImageView(shadowmap_image_views_[frame_i][shadowmap_i],
-                      shadowmap_images_[frame_i][shadowmap_i],
-                      VK_IMAGE_VIEW_TYPE_2D, depth_format_,
-                      VK_IMAGE_ASPECT_DEPTH_BIT);
-      TransitionImageLayout(
-          shadowmap_images_[frame_i][shadowmap_i], VK_IMAGE_ASPECT_DEPTH_BIT,
-          VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
-          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_ACCESS_SHADER_READ_BIT);
-    }
-  }
-}
-void Application::Renderer::CreateMaterialUniformBuffer() {
-  material_uniform_buffers_.resize(frame_count_);
-  material_uniform_memory_.resize(frame_count_);
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateBuffer(
-        material_uniform_buffers_[frame_i], material_uniform_memory_[frame_i],
-        MaterialUniformBlock::GetSize(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  }
+  // Shadowmaps are created as lights are added, until then their slots
+  // sample a single texel
+  shadowmaps_.clear();
+  released_shadowmaps_.clear();
+  shadowmap_descriptors_stale_.assign(frame_count_, false);
+  CreateImage(default_shadowmap_image_, default_shadowmap_memory_,
+              MemoryCategory::kShadowmaps, 0, depth_format_, {1, 1, 1}, 1, 1,
+              VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+              VK_SAMPLE_COUNT_1_BIT);
+  CreateImageView(default_shadowmap_image_view_, default_shadowmap_image_,
+                  VK_IMAGE_VIEW_TYPE_2D, depth_format_,
+                  VK_IMAGE_ASPECT_DEPTH_BIT);
+  TransitionImageLayout(
+      default_shadowmap_image_, VK_IMAGE_ASPECT_DEPTH_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+      0, VK_ACCESS_SHADER_READ_BIT);
 }
 void Application::Renderer::CreateTextureResources() {
-  texture_images_.resize(Scene::kMaxTextures);
-  texture_image_views_.resize(Scene::kMaxTextures);
-  texture_memory_.resize(Scene::kMaxTextures);
-  VkExtent3D tex_extent;
-  tex_extent.width = Scene::kMaxTextureResolution;
-  tex_extent.height = Scene::kMaxTextureResolution;
-  tex_extent.depth = 1;
-  for (uint32_t tex_i = 0; tex_i < Scene::kMaxTextures; tex_i++) {
-    CreateImage(texture_images_[tex_i], texture_memory_[tex_i], 0,
-                VK_FORMAT_R8G8B8A8_SRGB, tex_extent,
-                Scene::kMaxTextureMipLevels, 1,
-                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
-    CreateImageView(texture_image_views_[tex_i], texture_images_[tex_i],
-                    VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB,
-                    VK_IMAGE_ASPECT_COLOR_BIT);
-    TransitionImageLayout(
-        texture_images_[tex_i], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_ACCESS_SHADER_READ_BIT);
-  }
+  // Textures are created at their own size once loaded, until then their
+  // slots sample a single white texel
+  texture_images_.assign(Scene::kMaxTextures, VK_NULL_HANDLE);
+  texture_image_views_.assign(Scene::kMaxTextures, VK_NULL_HANDLE);
+  texture_memory_.assign(Scene::kMaxTextures, MemoryAllocation());
+  texture_descriptors_stale_.assign(frame_count_, false);
+  CreateImage(default_texture_image_, default_texture_memory_,
+              MemoryCategory::kTextures, 0, VK_FORMAT_R8G8B8A8_SRGB,
+              {1, 1, 1}, 1, 1,
+              VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
+  CreateImageView(default_texture_image_view_, default_texture_image_,
+                  VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB,
+                  VK_IMAGE_ASPECT_COLOR_BIT);
+  TransitionImageLayout(
+      default_texture_image_, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      VK_ACCESS_TRANSFER_WRITE_BIT);
+  uint32_t texel = 0xffffffff;
+  VkDeviceSize staging_offset = 0;
+  VkBuffer staging_buffer =
+      StageSetupData(&texel, sizeof(texel), staging_offset);
+  VkBufferImageCopy buffer_cp{};
+  buffer_cp.bufferOffset = staging_offset;
+  buffer_cp.bufferRowLength = 0;
+  buffer_cp.bufferImageHeight = 0;
+  buffer_cp.imageOffset = {0, 0, 0};
+  buffer_cp.imageExtent = {1, 1, 1};
+  buffer_cp.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  buffer_cp.imageSubresource.baseArrayLayer = 0;
+  buffer_cp.imageSubresource.layerCount = 1;
+  buffer_cp.imageSubresource.mipLevel = 0;
+  vkCmdCopyBufferToImage(BeginSetupCommands(), staging_buffer,
+                         default_texture_image_,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_cp);
+  TransitionImageLayout(
+      default_texture_image_, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT);
 }
 void Application::Renderer::CreateCubemapResources() {
   cubemap_images_.resize(Scene::kMaxCubemaps);
@@ -286,15 +340,19 @@ void Application::Renderer::CreateCubemapResources() {
   cubemap_extent.height = Scene::kMaxTextureResolution;
   cubemap_extent.width = Scene::kMaxTextureResolution;
   cubemap_extent.depth = 1;
+  VkImageCreateFlags image_flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+  VkImageUsageFlags image_usage =
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  GetMipmapImageFlags(VK_FORMAT_R8G8B8A8_SRGB, image_flags, image_usage);
   for (uint32_t cmap_i = 0; cmap_i < Scene::kMaxCubemaps; cmap_i++) {
     CreateImage(cubemap_images_[cmap_i], cubemap_memory_[cmap_i],
-                VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT, VK_FORMAT_R8G8B8A8_SRGB,
-                cubemap_extent, Scene::kMaxTextureMipLevels, 6,
-                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                MemoryCategory::kCubemaps, image_flags,
+                VK_FORMAT_R8G8B8A8_SRGB, cubemap_extent,
+                Scene::kMaxTextureMipLevels, 6, image_usage,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SAMPLE_COUNT_1_BIT);
     CreateImageView(cubemap_image_views_[cmap_i], cubemap_images_[cmap_i],
                     VK_IMAGE_VIEW_TYPE_CUBE, VK_FORMAT_R8G8B8A8_SRGB,
-                    VK_IMAGE_ASPECT_COLOR_BIT);
+                    VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_SAMPLED_BIT);
     TransitionImageLayout(
         cubemap_images_[cmap_i], VK_IMAGE_ASPECT_COLOR_BIT,
         VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
@@ -303,64 +361,36 @@ void Application::Renderer::CreateCubemapResources() {
   }
 }
 void Application::Renderer::CreateSkyboxResources() {
-  skybox_uniform_buffers_.resize(frame_count_);
-  skybox_uniform_memory_.resize(frame_count_);
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateBuffer(skybox_uniform_buffers_[frame_i],
-                 skybox_uniform_memory_[frame_i], sizeof(SkyboxUniform),
-                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  }
   float skybox_vertices[] = {-1.0f, -1.0f, 1.0f, -1.0f, 1.0f,  1.0f,
                              1.0f,  1.0f,  1.0f, 1.0f,  1.0f,  1.0f,
                              1.0f,  -1.0f, 1.0f, -1.0f, -1.0f, 1.0f};
   size_t skybox_vertex_size = sizeof(skybox_vertices);
   CreateBuffer(
-      skybox_vertex_buffer_, skybox_vertex_memory_, skybox_vertex_size,
+      skybox_vertex_buffer_, skybox_vertex_memory_, MemoryCategory::kGeometry,
+      skybox_vertex_size,
       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_memory;
-  CreateBuffer(staging_buffer, staging_memory, skybox_vertex_size,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  void* staging_data = nullptr;
-  vkMapMemory(device_, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data);
-  memcpy(staging_data, skybox_vertices, skybox_vertex_size);
-  vkUnmapMemory(device_, staging_memory);
-  VkCommandBuffer cmd;
-  BeginSingleUseCommandBuffer(cmd);
+  VkDeviceSize staging_offset = 0;
+  VkBuffer staging_buffer =
+      StageSetupData(skybox_vertices, skybox_vertex_size, staging_offset);
   VkBufferCopy buffer_cp{};
   buffer_cp.size = skybox_vertex_size;
-  buffer_cp.srcOffset = 0;
+  buffer_cp.srcOffset = staging_offset;
   buffer_cp.dstOffset = 0;
-  vkCmdCopyBuffer(cmd, staging_buffer, skybox_vertex_buffer_, 1, &buffer_cp);
-  EndSingleUseCommandBuffer(cmd);
-  vkDestroyBuffer(device_, staging_buffer, nullptr);
-  vkFreeMemory(device_, staging_memory, nullptr);
-}
-void Application::Renderer::CreateRendererSettingsResources() {
-  renderer_uniforms_.resize(frame_count_);
-  renderer_uniform_memory_.resize(frame_count_);
-  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
-    CreateBuffer(renderer_uniforms_[frame_i], renderer_uniform_memory_[frame_i],
-                 sizeof(RendererSettingsUniform),
-                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  }
+  vkCmdCopyBuffer(BeginSetupCommands(), staging_buffer, skybox_vertex_buffer_,
+                  1, &buffer_cp);
 }
 void Application::Renderer::DestroySwapchain() {
   vkDeviceWaitIdle(device_);
+  ResetScenePassStates();
 
   // Destroy framebuffers
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     vkDestroyFramebuffer(device_, framebuffers_[frame_i], nullptr);
     vkDestroyFramebuffer(device_, depthmap_framebuffers_[frame_i], nullptr);
     vkDestroyFramebuffer(device_, ssao_framebuffers_[frame_i], nullptr);
-    vkDestroyFramebuffer(device_, hdr_framebuffers_[frame_i], nullptr);
+    for (VkFramebuffer framebuffer : hdr_framebuffers_[frame_i])
+      vkDestroyFramebuffer(device_, framebuffer, nullptr);
     vkDestroyFramebuffer(device_, ssr_framebuffers_[frame_i], nullptr);
   }
   framebuffers_.clear();
@@ -371,13 +401,15 @@ void Application::Renderer::DestroySwapchain() {
 
   // Destroy pipelines and render passes
   vkDestroyPipelineLayout(device_, graphics_pipeline_layout_, nullptr);
-  vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
+  for (VkPipeline pipeline : graphics_pipelines_)
+    vkDestroyPipeline(device_, pipeline, nullptr);
   vkDestroyPipelineLayout(device_, debugdraw_pipeline_layout_, nullptr);
   vkDestroyPipeline(device_, debugdraw_pipeline_, nullptr);
   vkDestroyPipeline(device_, debugdraw_lines_pipeline_, nullptr);
   vkDestroyPipeline(device_, skybox_pipeline_, nullptr);
   vkDestroyPipelineLayout(device_, depthmap_pipeline_layout_, nullptr);
-  vkDestroyPipeline(device_, depthmap_pipeline_, nullptr);
+  for (VkPipeline pipeline : depthmap_pipelines_)
+    vkDestroyPipeline(device_, pipeline, nullptr);
   vkDestroyPipelineLayout(device_, ssao_pipeline_layout_, nullptr);
   vkDestroyPipeline(device_, ssao_pipeline_, nullptr);
   vkDestroyPipelineLayout(device_, hdr_pipeline_layout_, nullptr);
@@ -391,40 +423,43 @@ void Application::Renderer::DestroySwapchain() {
   vkDestroyRenderPass(device_, hdr_render_pass_, nullptr);
   vkDestroyRenderPass(device_, ssr_render_pass_, nullptr);
 
-  // Destroy resources
+  // Destroy resources, aliased images only own memory in their first slot
+  RemoveImageAliases(depth_images_);
+  RemoveImageAliases(depth_msaa_images_);
+  RemoveImageAliases(hdr_msaa_images_);
+  RemoveImageAliases(ssao_images_);
+  RemoveImageAliases(ssr_images_);
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     vkDestroyImageView(device_, depth_image_views_[frame_i], nullptr);
-    vkFreeMemory(device_, depth_memory_[frame_i], nullptr);
+    FreeMemory(depth_memory_[frame_i]);
     vkDestroyImage(device_, depth_images_[frame_i], nullptr);
     vkDestroyImageView(device_, ssao_image_views_[frame_i], nullptr);
-    vkFreeMemory(device_, ssao_memory_[frame_i], nullptr);
+    FreeMemory(ssao_memory_[frame_i]);
     vkDestroyImage(device_, ssao_images_[frame_i], nullptr);
-    vkDestroyImageView(device_, swapchain_image_views_[frame_i], nullptr);
     vkDestroyImageView(device_, hdr_image_views_[frame_i], nullptr);
-    vkFreeMemory(device_, hdr_memory_[frame_i], nullptr);
+    FreeMemory(hdr_memory_[frame_i]);
     vkDestroyImage(device_, hdr_images_[frame_i], nullptr);
-    vkFreeMemory(device_, hdr_tonemapping_memory_[frame_i], nullptr);
-    vkDestroyBuffer(device_, hdr_tonemapping_buffers_[frame_i], nullptr);
     for (uint32_t buff_i = 0; buff_i < 2; buff_i++) {
-      vkFreeMemory(device_, illuminance_memory_[frame_i][buff_i], nullptr);
+      FreeMemory(illuminance_memory_[frame_i][buff_i]);
       vkDestroyBuffer(device_, illuminance_buffers_[frame_i][buff_i], nullptr);
     }
     vkDestroyImageView(device_, ssr_image_views_[frame_i], nullptr);
-    vkFreeMemory(device_, ssr_memory_[frame_i], nullptr);
+    FreeMemory(ssr_memory_[frame_i]);
     vkDestroyImage(device_, ssr_images_[frame_i], nullptr);
-    vkFreeMemory(device_, ssr_uniform_memory_[frame_i], nullptr);
-    vkDestroyBuffer(device_, ssr_uniform_[frame_i], nullptr);
     vkDestroyImageView(device_, depth_msaa_views_[frame_i], nullptr);
-    vkFreeMemory(device_, depth_msaa_memory_[frame_i], nullptr);
+    FreeMemory(depth_msaa_memory_[frame_i]);
     vkDestroyImage(device_, depth_msaa_images_[frame_i], nullptr);
     vkDestroyImageView(device_, hdr_msaa_views_[frame_i], nullptr);
-    vkFreeMemory(device_, hdr_msaa_memory_[frame_i], nullptr);
+    FreeMemory(hdr_msaa_memory_[frame_i]);
     vkDestroyImage(device_, hdr_msaa_images_[frame_i], nullptr);
   }
+  for (VkImageView image_view : swapchain_image_views_)
+    vkDestroyImageView(device_, image_view, nullptr);
+  swapchain_image_views_.clear();
   vkDestroyImageView(device_, ssn_image_view_, nullptr);
-  vkFreeMemory(device_, ssn_memory_, nullptr);
+  FreeMemory(ssn_memory_);
   vkDestroyImage(device_, ssn_image_, nullptr);
-  vkFreeMemory(device_, ssao_sample_memory_, nullptr);
+  FreeMemory(ssao_sample_memory_);
   vkDestroyBuffer(device_, ssao_sample_uniform_, nullptr);
   depth_image_views_.clear();
   depth_memory_.clear();
@@ -435,8 +470,6 @@ void Application::Renderer::DestroySwapchain() {
   hdr_image_views_.clear();
   hdr_memory_.clear();
   hdr_images_.clear();
-  hdr_tonemapping_buffers_.clear();
-  hdr_tonemapping_memory_.clear();
   ssr_image_views_.clear();
   ssr_images_.clear();
   ssr_memory_.clear();
@@ -448,7 +481,19 @@ void Application::Renderer::DestroySwapchain() {
   depth_msaa_images_.clear();
 
   rendered_frames_.clear();
-  vkDestroySwapchainKHR(device_, swapchain_, nullptr);
+  if (headless_) {
+    for (uint32_t image_i = 0; image_i < swapchain_images_.size(); image_i++) {
+      FreeMemory(offscreen_memory_[image_i]);
+      vkDestroyImage(device_, swapchain_images_[image_i], nullptr);
+    }
+    offscreen_memory_.clear();
+    swapchain_images_.clear();
+  } else {
+    vkDestroySwapchainKHR(device_, swapchain_, nullptr);
+    for (VkSemaphore sem : image_presented_semaphores_)
+      vkDestroySemaphore(device_, sem, nullptr);
+    image_presented_semaphores_.clear();
+  }
   swapchain_ = VK_NULL_HANDLE;
 }
 void Application::Renderer::RecreateSwapchain() {
@@ -461,33 +506,190 @@ void Application::Renderer::RecreateSwapchain() {
   CreateIlluminanceResources();
   CreateRenderPasses(false);
   CreatePipelines(false);
-  CreateFramebuffers(false);
+  CreateFramebuffers();
   WriteResizeableDescriptorSets();
+  SubmitSetupCommands();
+}
+// Header written in front of the driver's cache data. The driver data is
+// only handed back to the same device and driver that produced it.
+struct PipelineCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t uuid[VK_UUID_SIZE];
+  uint64_t data_size;
+  uint64_t data_hash;
+};
+static const uint32_t kPipelineCacheMagic = 0x43504c43;  // "CLPC"
+static const uint32_t kPipelineCacheVersion = 1;
+static const char* kPipelineCachePath = "../cache/pipelines.bin";
+// FNV-1a
+static uint64_t HashPipelineCacheData(const uint8_t* data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t byte_i = 0; byte_i < size; byte_i++) {
+    hash ^= data[byte_i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+static PipelineCacheHeader GetPipelineCacheHeader(
+    VkPhysicalDevice physical_device) {
+  VkPhysicalDeviceProperties props{};
+  vkGetPhysicalDeviceProperties(physical_device, &props);
+  PipelineCacheHeader header{};
+  header.magic = kPipelineCacheMagic;
+  header.version = kPipelineCacheVersion;
+  header.vendor_id = props.vendorID;
+  header.device_id = props.deviceID;
+  header.driver_version = props.driverVersion;
+  memcpy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+  return header;
 }
 void Application::Renderer::CreatePipelineCache() {
+  // A missing, stale or corrupt file leaves the cache empty
+  PipelineCacheHeader expected = GetPipelineCacheHeader(physical_device_);
+  MappedFile file;
+  const uint8_t* initial_data = nullptr;
+  size_t initial_size = 0;
+  if (file.Open(kPipelineCachePath) &&
+      file.GetSize() >= sizeof(PipelineCacheHeader)) {
+    PipelineCacheHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+    const uint8_t* data = file.GetData() + sizeof(header);
+    bool valid =
+        header.magic == expected.magic && header.version == expected.version &&
+        header.vendor_id == expected.vendor_id &&
+        header.device_id == expected.device_id &&
+        header.driver_version == expected.driver_version &&
+        memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) == 0 &&
+        header.data_size == file.GetSize() - sizeof(header) &&
+        header.data_hash == HashPipelineCacheData(data, header.data_size);
+    if (valid) {
+      initial_data = data;
+      initial_size = header.data_size;
+    }
+  }
   VkPipelineCacheCreateInfo pipeline_cache_ci{};
   pipeline_cache_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
   pipeline_cache_ci.pNext = nullptr;
   pipeline_cache_ci.flags = 0;
-  pipeline_cache_ci.initialDataSize = 0;
-  pipeline_cache_ci.pInitialData = nullptr;
+  pipeline_cache_ci.initialDataSize = initial_size;
+  pipeline_cache_ci.pInitialData = initial_data;
   VkResult create_result = vkCreatePipelineCache(device_, &pipeline_cache_ci,
                                                   nullptr, &pipeline_cache_);
   ASSERT(create_result == VK_SUCCESS, "Failed to create pipeline cache!");
 }
+void Application::Renderer::DestroyPipelineCache() {
+  size_t data_size = 0;
+  vkGetPipelineCacheData(device_, pipeline_cache_, &data_size, nullptr);
+  std::vector<uint8_t> data(data_size);
+  VkResult data_result = vkGetPipelineCacheData(device_, pipeline_cache_,
+                                                &data_size, data.data());
+  vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+  if (data_result != VK_SUCCESS || data_size == 0) return;
+
+  PipelineCacheHeader header = GetPipelineCacheHeader(physical_device_);
+  header.data_size = data_size;
+  header.data_hash = HashPipelineCacheData(data.data(), data_size);
+  // Written aside and renamed, a crash mid-write never leaves a torn file
+  std::filesystem::path cache_path = kPipelineCachePath;
+  std::filesystem::path temp_path = cache_path;
+  temp_path += ".tmp";
+  std::error_code error;
+  std::filesystem::create_directories(cache_path.parent_path(), error);
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), data_size);
+    if (!file) return;
+  }
+  std::filesystem::rename(temp_path, cache_path, error);
+}
 void Application::Renderer::CreatePipelines(bool include_fixed_size) {
-  CreateGraphicsPipeline();
-  CreateDebugDrawPipeline();
-  CreateDebugDrawLinesPipeline();
-  CreateSkyboxPipeline();
-  CreateDepthmapPipeline();
-  CreateSsaoPipeline();
-  CreateHdrPipeline();
-  CreateSsrPipeline();
+  // Pipelines are compiled in parallel on the recording workers, which are
+  // idle outside of frame recording. The pipeline cache is internally
+  // synchronized. Skybox and debug draw lines reuse the layouts made by the
+  // pipelines before them, so they share their task.
+  std::vector<std::function<void()>> tasks = {
+      [this]() {
+        CreateGraphicsPipeline();
+        CreateSkyboxPipeline();
+      },
+      [this]() {
+        CreateDebugDrawPipeline();
+        CreateDebugDrawLinesPipeline();
+      },
+      [this]() { CreateDepthmapPipeline(); },
+      [this]() { CreateSsaoPipeline(); },
+      [this]() { CreateHdrPipeline(); },
+      [this]() { CreateSsrPipeline(); }};
   if (include_fixed_size) {
-    CreateShadowmapPipeline();
-    CreateIlluminancePipelines();
+    tasks.push_back([this]() { CreateShadowmapPipeline(); });
+    tasks.push_back([this]() { CreateIlluminancePipelines(); });
   }
+  for (const std::function<void()>& task : tasks) {
+    recording_thread_pool_->Submit([&task](uint32_t thread_i) { task(); });
+  }
+  recording_thread_pool_->Wait();
+}
+void Application::Renderer::GetVertexInputState(VertexFormat format,
+                                                bool position_only,
+                                                VertexInputState& state) {
+  state.binding = {};
+  state.binding.binding = 0;
+  state.binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  uint32_t attribute_count = 5;
+  // Locations are position, normal, uv, tangent and bitangent
+  if (position_only) {
+    attribute_count = 1;
+    if (format == VertexFormat::kPacked) {
+      state.binding.stride = sizeof(PackedVertex::position);
+      state.attributes[0] = {0, 0, VK_FORMAT_R16G16B16A16_SNORM, 0};
+    } else {
+      state.binding.stride = sizeof(glm::vec3);
+      state.attributes[0] = {0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0};
+    }
+  } else if (format == VertexFormat::kPacked) {
+    state.binding.stride = sizeof(PackedVertex);
+    // Only the bitangent sign is stored, in the position w. The bitangent
+    // location reads the position so that every input has a source.
+    state.attributes = {{
+        {0, 0, VK_FORMAT_R16G16B16A16_SNORM,
+         offsetof(PackedVertex, position)},
+        {1, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)},
+        {2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)},
+        {3, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, tangent)},
+        {4, 0, VK_FORMAT_R16G16B16A16_SNORM,
+         offsetof(PackedVertex, position)},
+    }};
+  } else {
+    state.binding.stride = sizeof(Vertex);
+    state.attributes = {{
+        {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)},
+        {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)},
+        {2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)},
+        {3, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, tangent)},
+        {4, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, bitangent)},
+    }};
+  }
+  state.ci = {};
+  state.ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  state.ci.vertexBindingDescriptionCount = 1;
+  state.ci.pVertexBindingDescriptions = &state.binding;
+  state.ci.vertexAttributeDescriptionCount = attribute_count;
+  state.ci.pVertexAttributeDescriptions = state.attributes.data();
+
+  state.packed = format == VertexFormat::kPacked ? VK_TRUE : VK_FALSE;
+  state.specialization_entry.constantID = 0;
+  state.specialization_entry.offset = 0;
+  state.specialization_entry.size = sizeof(VkBool32);
+  state.specialization.mapEntryCount = 1;
+  state.specialization.pMapEntries = &state.specialization_entry;
+  state.specialization.dataSize = sizeof(VkBool32);
+  state.specialization.pData = &state.packed;
 }
 void Application::Renderer::CreateRenderPasses(bool include_fixed_size) {
   CreateGraphicsRenderPass();
@@ -498,13 +700,12 @@ void Application::Renderer::CreateRenderPasses(bool include_fixed_size) {
   CreateSsrRenderPass();
   if(include_fixed_size) CreateShadowmapRenderPass();
 }
-void Application::Renderer::CreateFramebuffers(bool include_fixed_size) {
+void Application::Renderer::CreateFramebuffers() {
   CreateGraphicsFramebuffers();
   CreateDepthmapFramebuffers();
   CreateSsaoFramebuffers();
   CreateHdrFramebuffers();
   CreateSsrFramebuffers();
-  if (include_fixed_size) CreateDirectionalShadowmapFramebuffers();
 }
 VkShaderModule Application::Renderer::CreateShaderModule(
   const std::vector<char>& buffer) {
@@ -593,23 +794,87 @@ void Application::Renderer::CreateCommandBuffers() {
 }
 void Application::Renderer::CreateSyncObjects() {
   image_acquired_semaphores_.resize(frame_count_);
-  image_presented_semaphores_.resize(frame_count_);
-  in_flight_fences_.resize(frame_count_);
 
   VkSemaphoreCreateInfo sem_ci{};
   sem_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
   sem_ci.pNext = nullptr;
   sem_ci.flags = 0;
-  VkFenceCreateInfo fence_ci{};
-  fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_ci.pNext = nullptr;
-  fence_ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
   for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
     vkCreateSemaphore(device_, &sem_ci, nullptr,
                       &image_acquired_semaphores_[frame_i]);
-    vkCreateSemaphore(device_, &sem_ci, nullptr, &image_presented_semaphores_[frame_i]);
-    vkCreateFence(device_, &fence_ci, nullptr, &in_flight_fences_[frame_i]);
   }
+
+  // Frame pacing uses a single timeline semaphore, each frame slot waits for
+  // the value signaled by the last submission that used it
+  VkSemaphoreTypeCreateInfo sem_type_ci{};
+  sem_type_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  sem_type_ci.pNext = nullptr;
+  sem_type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  sem_type_ci.initialValue = 0;
+  sem_ci.pNext = &sem_type_ci;
+  VkResult create_result = vkCreateSemaphore(device_, &sem_ci, nullptr,
+                                             &frame_timeline_semaphore_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Failed to create frame timeline semaphore!");
+  // The exposure reduction of a frame signals the same value on the compute
+  // timeline once it has finished
+  create_result = vkCreateSemaphore(device_, &sem_ci, nullptr,
+                                    &compute_timeline_semaphore_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Failed to create compute timeline semaphore!");
+  frame_timeline_value_ = 0;
+  frame_timeline_values_.assign(frame_count_, 0);
+}
+void Application::Renderer::CreateTimestampQueryPool() {
+  VkPhysicalDeviceProperties props{};
+  vkGetPhysicalDeviceProperties(physical_device_, &props);
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device_,
+                                           &queue_family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      physical_device_, &queue_family_count, queue_families.data());
+  uint32_t graphics_family = queue_family_indices_.graphics_queue_index_.value();
+  timestamps_supported_ =
+      props.limits.timestampPeriod > 0.0f &&
+      queue_families[graphics_family].timestampValidBits > 0;
+  timestamp_period_ = props.limits.timestampPeriod;
+  timestamp_query_pool_ = VK_NULL_HANDLE;
+  last_gpu_frame_end_ = 0;
+  frame_timings_.cpu_wait_ms = 0.0f;
+  frame_timings_.gpu_idle_ms = 0.0f;
+  if (!timestamps_supported_) return;
+
+  // Two timestamps per frame slot, at the start and end of its command buffer
+  VkQueryPoolCreateInfo query_pool_ci{};
+  query_pool_ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  query_pool_ci.pNext = nullptr;
+  query_pool_ci.flags = 0;
+  query_pool_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  query_pool_ci.queryCount = 2 * frame_count_;
+  VkResult create_result = vkCreateQueryPool(device_, &query_pool_ci, nullptr,
+                                             &timestamp_query_pool_);
+  ASSERT(create_result == VK_SUCCESS, "Failed to create timestamp query pool!");
+}
+void Application::Renderer::UpdateGpuFrameTimings(uint32_t frame_i) {
+  // Nothing has been submitted from this slot yet
+  if (!timestamps_supported_ || frame_timeline_values_[frame_i] == 0) return;
+  uint64_t timestamps[2] = {0, 0};
+  VkResult query_result = vkGetQueryPoolResults(
+      device_, timestamp_query_pool_, 2 * frame_i, 2, sizeof(timestamps),
+      timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (query_result != VK_SUCCESS) return;
+  // Slots are retired in submission order, so the gap between the previous
+  // frame's end and this frame's start is time the GPU spent waiting on the
+  // CPU (or on image acquisition)
+  if (last_gpu_frame_end_ != 0 && timestamps[0] > last_gpu_frame_end_) {
+    frame_timings_.gpu_idle_ms =
+        static_cast<float>(timestamps[0] - last_gpu_frame_end_) *
+        timestamp_period_ * 1e-6f;
+  } else {
+    frame_timings_.gpu_idle_ms = 0.0f;
+  }
+  last_gpu_frame_end_ = timestamps[1];
 }
 void Application::Renderer::CreateGraphicsRenderPass() {
   VkAttachmentDescription2 color_attachment{};
@@ -618,10 +883,12 @@ void Application::Renderer::CreateGraphicsRenderPass() {
   color_attachment.format = hdr_format_;
   color_attachment.samples = msaa_samples_;
   color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  // Only the resolved samples outlive the pass, the multisampled target is
+  // transient
+  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
   color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentDescription2 depth_attachment{};
@@ -647,8 +914,10 @@ void Application::Renderer::CreateGraphicsRenderPass() {
   color_resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   color_resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color_resolve_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  color_resolve_attachment.initialLayout =
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color_resolve_attachment.finalLayout =
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference2 color_attachment_ref{};
   color_attachment_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
@@ -679,32 +948,6 @@ void Application::Renderer::CreateGraphicsRenderPass() {
   subpass.pDepthStencilAttachment = &depth_attachment_ref;
   subpass.pResolveAttachments = &color_resolve_attachment_ref;
 
-  VkSubpassDependency2 dependency0{};
-  dependency0.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
-  dependency0.pNext = nullptr;
-  dependency0.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency0.dstSubpass = 0;
-  dependency0.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependency0.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                             VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency0.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependency0.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
-                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency0.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-  VkSubpassDependency2 dependency1{};
-  dependency1.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
-  dependency1.pNext = nullptr;
-  dependency1.srcSubpass = 0;
-  dependency1.dstSubpass = VK_SUBPASS_EXTERNAL;
-  dependency1.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  dependency1.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  dependency1.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency1.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-
-  VkSubpassDependency2 dependencies[] = {dependency0, dependency1};
-
   std::array<VkAttachmentDescription2, 3> attachments = {color_attachment,depth_attachment,color_resolve_attachment};
   VkRenderPassCreateInfo2 render_pass_ci{};
   render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
@@ -713,8 +956,8 @@ void Application::Renderer::CreateGraphicsRenderPass() {
   render_pass_ci.pAttachments = attachments.data();
   render_pass_ci.subpassCount = 1;
   render_pass_ci.pSubpasses = &subpass;
-  render_pass_ci.dependencyCount = 2;
-  render_pass_ci.pDependencies = dependencies;
+  render_pass_ci.dependencyCount = 0;
+  render_pass_ci.pDependencies = nullptr;
 
   VkResult create_result =
       vkCreateRenderPass2(device_, &render_pass_ci, nullptr, &render_pass_);
@@ -755,53 +998,6 @@ void Application::Renderer::CreateGraphicsPipeline() {
   VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_ci,
                                                      frag_shader_stage_ci};
 
-  VkVertexInputBindingDescription vertex_bd{};
-  vertex_bd.binding = 0;
-  vertex_bd.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  vertex_bd.stride = sizeof(Vertex);
-
-  VkVertexInputAttributeDescription vertex_pos_ad{};
-  vertex_pos_ad.binding = 0;
-  vertex_pos_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_pos_ad.location = 0;
-  vertex_pos_ad.offset = 0;
-
-  VkVertexInputAttributeDescription vertex_norm_ad{};
-  vertex_norm_ad.binding = 0;
-  vertex_norm_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_norm_ad.location = 1;
-  vertex_norm_ad.offset = offsetof(Vertex, normal);
-
-  VkVertexInputAttributeDescription vertex_uv_ad{};
-  vertex_uv_ad.binding = 0;
-  vertex_uv_ad.format = VK_FORMAT_R32G32_SFLOAT;
-  vertex_uv_ad.location = 2;
-  vertex_uv_ad.offset = offsetof(Vertex, uv);
-
-  VkVertexInputAttributeDescription vertex_tan_ad{};
-  vertex_tan_ad.binding = 0;
-  vertex_tan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_tan_ad.location = 3;
-  vertex_tan_ad.offset = offsetof(Vertex, tangent);
-
-  VkVertexInputAttributeDescription vertex_bitan_ad{};
-  vertex_bitan_ad.binding = 0;
-  vertex_bitan_ad.format = VK_FORMAT_R32G32B32_SFLOAT;
-  vertex_bitan_ad.location = 4;
-  vertex_bitan_ad.offset = offsetof(Vertex, bitangent);
-
-  VkVertexInputAttributeDescription vertex_ads[] = {
-      vertex_pos_ad, vertex_norm_ad, vertex_uv_ad, vertex_tan_ad,
-      vertex_bitan_ad};
-
-  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-  vertex_input_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.vertexAttributeDescriptionCount = 5;
-  vertex_input_info.pVertexBindingDescriptions = &vertex_bd;
-  vertex_input_info.pVertexAttributeDescriptions = vertex_ads;
-
   VkPipelineInputAssemblyStateCreateInfo input_assembly_state{};
   input_assembly_state.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -893,7 +1089,6 @@ void Application::Renderer::CreateGraphicsPipeline() {
   pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_ci.stageCount = 2;
   pipeline_ci.pStages = shader_stages;
-  pipeline_ci.pVertexInputState = &vertex_input_info;
   pipeline_ci.pInputAssemblyState = &input_assembly_state;
   pipeline_ci.pViewportState = &viewport_state;
   pipeline_ci.pRasterizationState = &rasterizer_state;
@@ -905,10 +1100,18 @@ void Application::Renderer::CreateGraphicsPipeline() {
   pipeline_ci.subpass = 0;
   pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
 
-  create_result = vkCreateGraphicsPipelines(
-      device_, pipeline_cache_, 1, &pipeline_ci,
-      nullptr, &graphics_pipeline_);
-  ASSERT(create_result == VK_SUCCESS, "Failed to create graphics pipeline!");
+  for (uint32_t format_i = 0; format_i < kVertexFormatCount; format_i++) {
+    VertexInputState vertex_input;
+    GetVertexInputState(static_cast<VertexFormat>(format_i), false,
+                        vertex_input);
+    shader_stages[0].pSpecializationInfo = &vertex_input.specialization;
+    pipeline_ci.pVertexInputState = &vertex_input.ci;
+    create_result = vkCreateGraphicsPipelines(
+        device_, pipeline_cache_, 1, &pipeline_ci, nullptr,
+        &graphics_pipelines_[format_i]);
+    ASSERT(create_result == VK_SUCCESS,
+           "Failed to create graphics pipeline!");
+  }
 
   vkDestroyShaderModule(device_, vert_shader, nullptr);
   vkDestroyShaderModule(device_, frag_shader, nullptr);
@@ -933,7 +1136,8 @@ void Application::Renderer::CreateGraphicsFramebuffers() {
     ASSERT(create_result == VK_SUCCESS, "Failed to create framebuffer!");
   }
 }
-void Application::Renderer::BeginGraphicsRenderPass(VkCommandBuffer& cmd, uint32_t swapchain_image_i) {
+void Application::Renderer::BeginGraphicsRenderPass(VkCommandBuffer& cmd, uint32_t frame_i,
+                                                    VkSubpassContents contents) {
   VkClearValue color_clear;
   color_clear.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
   VkClearValue depth_clear;
@@ -944,35 +1148,58 @@ void Application::Renderer::BeginGraphicsRenderPass(VkCommandBuffer& cmd, uint32
   render_pass_bi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_bi.pNext = nullptr;
   render_pass_bi.renderPass = render_pass_;
-  render_pass_bi.framebuffer = framebuffers_[swapchain_image_i];
+  render_pass_bi.framebuffer = framebuffers_[frame_i];
   render_pass_bi.renderArea.extent = swapchain_extent_;
   render_pass_bi.renderArea.offset.x = 0;
   render_pass_bi.renderArea.offset.y = 0;
   render_pass_bi.clearValueCount = 3;
   render_pass_bi.pClearValues = clear_values;
-  vkCmdBeginRenderPass(cmd, &render_pass_bi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd, &render_pass_bi, contents);
 }
 void Application::Renderer::DrawFrame() {
-  static uint32_t frame_i = 0;
-  uint32_t frame_count = static_cast<uint32_t>(framebuffers_.size());
-  vkWaitForFences(device_, 1,
-                  &in_flight_fences_[frame_i], VK_TRUE,
-                  UINT64_MAX);
-  vkResetFences(device_, 1,
-                &in_flight_fences_[frame_i]);
-  uint32_t image_i = 0;
-  VkResult acquire_result = vkAcquireNextImageKHR(
-      device_, swapchain_, UINT64_MAX,
-      image_acquired_semaphores_[frame_i], VK_NULL_HANDLE,
-      &image_i);
-  if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
-    RecreateSwapchain();
-    return;
+  // Per-frame resources are indexed by the frame in flight, only the
+  // swapchain image itself and its framebuffers are indexed by image_i
+  uint32_t frame_i = current_frame_;
+  // The compute command buffer of this frame slot must also be retired
+  VkSemaphore frame_wait_semaphores[] = {frame_timeline_semaphore_,
+                                         compute_timeline_semaphore_};
+  uint64_t frame_wait_values[] = {frame_timeline_values_[frame_i],
+                                  frame_timeline_values_[frame_i]};
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.pNext = nullptr;
+  wait_info.flags = 0;
+  wait_info.semaphoreCount = 2;
+  wait_info.pSemaphores = frame_wait_semaphores;
+  wait_info.pValues = frame_wait_values;
+  auto wait_start = std::chrono::high_resolution_clock::now();
+  VkResult wait_result = vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+  ASSERT(wait_result == VK_SUCCESS, "Failed to wait for frame slot!");
+  auto wait_end = std::chrono::high_resolution_clock::now();
+  frame_timings_.cpu_wait_ms =
+      std::chrono::duration<float, std::chrono::milliseconds::period>(
+          wait_end - wait_start)
+          .count();
+  UpdateGpuFrameTimings(frame_i);
+  RetireUploadBatches();
+  UpdateMemoryUsagePeak();
+  // Offscreen images are owned by their frame slot, so there is nothing to
+  // acquire
+  uint32_t image_i = frame_i;
+  if (!headless_) {
+    VkResult acquire_result = vkAcquireNextImageKHR(
+        device_, swapchain_, UINT64_MAX,
+        image_acquired_semaphores_[frame_i], VK_NULL_HANDLE,
+        &image_i);
+    if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+      RecreateSwapchain();
+      return;
+    }
+    ASSERT(acquire_result == VK_SUCCESS || acquire_result == VK_SUBOPTIMAL_KHR,
+           "Failed to acquire swapchain image!");
   }
-  ASSERT(acquire_result == VK_SUCCESS || acquire_result == VK_SUBOPTIMAL_KHR,
-         "Failed to acquire swapchain image!");
 
-  VkCommandBuffer& cmd = command_buffers_[image_i];
+  VkCommandBuffer& cmd = command_buffers_[frame_i];
   vkResetCommandBuffer(cmd, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 
   VkCommandBufferBeginInfo cmd_bi{};
@@ -983,35 +1210,88 @@ void Application::Renderer::DrawFrame() {
   VkResult begin_result = vkBeginCommandBuffer(cmd, &cmd_bi);
   ASSERT(begin_result == VK_SUCCESS,
          "Failed to begin recording command buffer!");
+  if (timestamps_supported_) {
+    vkCmdResetQueryPool(cmd, timestamp_query_pool_, 2 * frame_i, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestamp_query_pool_, 2 * frame_i);
+  }
 
-  DrawScene(image_i);
+  DrawScene(frame_i, image_i);
+  if (timestamps_supported_) {
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestamp_query_pool_, 2 * frame_i + 1);
+  }
   VkResult end_result = vkEndCommandBuffer(cmd);
   ASSERT(end_result == VK_SUCCESS,
          "Failed to finish recording command buffer!");
 
-  VkPipelineStageFlags semaphore_wait_stages =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  frame_timeline_value_++;
+  frame_timeline_values_[frame_i] = frame_timeline_value_;
+  // Values for binary semaphores are ignored
+  std::vector<VkSemaphore> wait_semaphores;
+  std::vector<VkPipelineStageFlags> semaphore_wait_stages;
+  std::vector<uint64_t> wait_values;
+  if (!headless_) {
+    wait_semaphores.push_back(image_acquired_semaphores_[frame_i]);
+    semaphore_wait_stages.push_back(
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    wait_values.push_back(0);
+  }
+  // The copy of the last exposure waits on the compute queue, other work in
+  // the frame can overlap with the reduction
+  if (exposure_timeline_value_ > 0) {
+    wait_semaphores.push_back(compute_timeline_semaphore_);
+    semaphore_wait_stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+    wait_values.push_back(exposure_timeline_value_);
+  }
+  // Uploads consumed by this frame are read by transfers and vertex input
+  if (upload_wait_value_ > 0) {
+    wait_semaphores.push_back(upload_timeline_semaphore_);
+    semaphore_wait_stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    wait_values.push_back(upload_wait_value_);
+    upload_wait_value_ = 0;
+  }
+  std::vector<VkSemaphore> signal_semaphores = {frame_timeline_semaphore_};
+  std::vector<uint64_t> signal_values = {frame_timeline_value_};
+  if (!headless_) {
+    signal_semaphores.push_back(image_presented_semaphores_[image_i]);
+    signal_values.push_back(0);
+  }
+  VkTimelineSemaphoreSubmitInfo timeline_si{};
+  timeline_si.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_si.pNext = nullptr;
+  timeline_si.waitSemaphoreValueCount =
+      static_cast<uint32_t>(wait_values.size());
+  timeline_si.pWaitSemaphoreValues = wait_values.data();
+  timeline_si.signalSemaphoreValueCount =
+      static_cast<uint32_t>(signal_values.size());
+  timeline_si.pSignalSemaphoreValues = signal_values.data();
+
   VkSubmitInfo cmd_si{};
   cmd_si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  cmd_si.pNext = nullptr;
-  cmd_si.waitSemaphoreCount = 1;
-  cmd_si.pWaitSemaphores = &image_acquired_semaphores_[frame_i];
-  cmd_si.pWaitDstStageMask = &semaphore_wait_stages;
+  cmd_si.pNext = &timeline_si;
+  cmd_si.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+  cmd_si.pWaitSemaphores = wait_semaphores.data();
+  cmd_si.pWaitDstStageMask = semaphore_wait_stages.data();
   cmd_si.commandBufferCount = 1;
   cmd_si.pCommandBuffers = &cmd;
-  cmd_si.signalSemaphoreCount = 1;
-  cmd_si.pSignalSemaphores =
-      &image_presented_semaphores_[frame_i];
-  vkQueueSubmit(graphics_queue_, 1, &cmd_si,
-                in_flight_fences_[frame_i]);
-
+  cmd_si.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+  cmd_si.pSignalSemaphores = signal_semaphores.data();
+  vkQueueSubmit(graphics_queue_, 1, &cmd_si, VK_NULL_HANDLE);
+  SubmitIlluminanceReduction(frame_i);
+
+  if (headless_) {
+    rendered_frames_[frame_i] = true;
+    current_frame_ = (current_frame_ + 1) % frame_count_;
+    return;
+  }
   VkResult present_result = VK_ERROR_UNKNOWN;
   VkPresentInfoKHR frame_pi{};
   frame_pi.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   frame_pi.pNext = nullptr;
   frame_pi.waitSemaphoreCount = 1;
-  frame_pi.pWaitSemaphores =
-      &image_presented_semaphores_[frame_i];
+  frame_pi.pWaitSemaphores = &image_presented_semaphores_[image_i];
   frame_pi.swapchainCount = 1;
   frame_pi.pSwapchains = &swapchain_;
   frame_pi.pImageIndices = &image_i;
@@ -1022,9 +1302,9 @@ void Application::Renderer::DrawFrame() {
     RecreateSwapchain();
   } else {
     ASSERT(present_result == VK_SUCCESS, "Could not present frame!");
-    rendered_frames_[image_i] = true;
+    rendered_frames_[frame_i] = true;
   }
 
-  frame_i = (frame_i + 1) % frame_count;
+  current_frame_ = (current_frame_ + 1) % frame_count_;
 }
 }  // namespace catalyst
\ No newline at end of file
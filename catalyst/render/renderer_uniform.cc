@@ -0,0 +1,60 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateUniformRings() {
+  VkPhysicalDeviceProperties props{};
+  vkGetPhysicalDeviceProperties(physical_device_, &props);
+  uniform_alignment_ =
+      std::max<VkDeviceSize>(props.limits.minUniformBufferOffsetAlignment, 1);
+  uniform_ring_buffers_.resize(frame_count_);
+  uniform_ring_memory_.resize(frame_count_);
+  uniform_ring_heads_.assign(frame_count_, 0);
+  for (uint32_t frame_i = 0; frame_i < frame_count_; frame_i++) {
+    // Also a transfer destination, the tonemapping pass copies the exposure
+    // into its uniform on the GPU
+    CreateBuffer(uniform_ring_buffers_[frame_i], uniform_ring_memory_[frame_i],
+                 MemoryCategory::kUniforms, kUniformRingSize,
+                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+}
+void Application::Renderer::DestroyUniformRings() {
+  for (uint32_t frame_i = 0; frame_i < uniform_ring_buffers_.size();
+       frame_i++) {
+    vkDestroyBuffer(device_, uniform_ring_buffers_[frame_i], nullptr);
+    FreeMemory(uniform_ring_memory_[frame_i]);
+  }
+  uniform_ring_buffers_.clear();
+  uniform_ring_memory_.clear();
+  uniform_ring_heads_.clear();
+}
+void Application::Renderer::ResetUniformRing(uint32_t frame_i) {
+  uniform_ring_heads_[frame_i] = 0;
+}
+void* Application::Renderer::AllocateUniform(uint32_t frame_i,
+                                             VkDeviceSize size,
+                                             uint32_t& offset) {
+  VkDeviceSize& head = uniform_ring_heads_[frame_i];
+  VkDeviceSize aligned_head =
+      (head + uniform_alignment_ - 1) / uniform_alignment_ * uniform_alignment_;
+  ASSERT(aligned_head + size <= kUniformRingSize,
+         "Uniform ring buffer is full!");
+  head = aligned_head + size;
+  offset = static_cast<uint32_t>(aligned_head);
+  return static_cast<char*>(MapMemory(uniform_ring_memory_[frame_i])) +
+         aligned_head;
+}
+uint32_t Application::Renderer::PushUniform(uint32_t frame_i, const void* data,
+                                            VkDeviceSize size) {
+  uint32_t offset = 0;
+  memcpy(AllocateUniform(frame_i, size, offset), data, size);
+  return offset;
+}
+}  // namespace catalyst
@@ -0,0 +1,325 @@
+#include <catalyst/render/renderer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+void Application::Renderer::CreateUploadResources() {
+  VkCommandPoolCreateInfo command_pool_ci{};
+  command_pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  command_pool_ci.pNext = nullptr;
+  command_pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  command_pool_ci.queueFamilyIndex =
+      queue_family_indices_.transfer_queue_index_.value();
+  VkResult create_result = vkCreateCommandPool(device_, &command_pool_ci,
+                                               nullptr, &upload_command_pool_);
+  ASSERT(create_result == VK_SUCCESS, "Failed to create upload command pool!");
+
+  VkSemaphoreTypeCreateInfo sem_type_ci{};
+  sem_type_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  sem_type_ci.pNext = nullptr;
+  sem_type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  sem_type_ci.initialValue = 0;
+  VkSemaphoreCreateInfo sem_ci{};
+  sem_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  sem_ci.pNext = &sem_type_ci;
+  sem_ci.flags = 0;
+  create_result = vkCreateSemaphore(device_, &sem_ci, nullptr,
+                                    &upload_timeline_semaphore_);
+  ASSERT(create_result == VK_SUCCESS,
+         "Failed to create upload timeline semaphore!");
+  upload_timeline_value_ = 0;
+  upload_wait_value_ = 0;
+
+  // Setup commands run on the graphics queue, since they include layout
+  // transitions of images the frames use
+  VkCommandBufferAllocateInfo cmd_ai{};
+  cmd_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_ai.pNext = nullptr;
+  cmd_ai.commandPool = command_pool_;
+  cmd_ai.commandBufferCount = 1;
+  cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  VkResult alloc_result = vkAllocateCommandBuffers(
+      device_, &cmd_ai, &setup_context_.command_buffer);
+  ASSERT(alloc_result == VK_SUCCESS,
+         "Failed to allocate setup command buffer!");
+  VkFenceCreateInfo fence_ci{};
+  fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_ci.pNext = nullptr;
+  fence_ci.flags = 0;
+  create_result =
+      vkCreateFence(device_, &fence_ci, nullptr, &setup_context_.fence);
+  ASSERT(create_result == VK_SUCCESS, "Failed to create setup fence!");
+  CreateBuffer(setup_context_.staging_buffer, setup_context_.staging_memory,
+               MemoryCategory::kStaging, kSetupStagingSize,
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  setup_context_.recording = false;
+  setup_context_.pending = false;
+  setup_context_.staging_head = 0;
+}
+void Application::Renderer::DestroyUploadResources() {
+  WaitSetupCommands();
+  vkFreeCommandBuffers(device_, command_pool_, 1,
+                       &setup_context_.command_buffer);
+  vkDestroyFence(device_, setup_context_.fence, nullptr);
+  vkDestroyBuffer(device_, setup_context_.staging_buffer, nullptr);
+  FreeMemory(setup_context_.staging_memory);
+  // The device is idle by now, so every batch can be freed
+  for (UploadBatch& batch : upload_batches_) FreeUploadBatch(batch);
+  upload_batches_.clear();
+  vkDestroySemaphore(device_, upload_timeline_semaphore_, nullptr);
+  vkDestroyCommandPool(device_, upload_command_pool_, nullptr);
+}
+void Application::Renderer::BeginUploadBatch(UploadBatch& batch) {
+  VkCommandBufferAllocateInfo cmd_ai{};
+  cmd_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_ai.pNext = nullptr;
+  cmd_ai.commandPool = upload_command_pool_;
+  cmd_ai.commandBufferCount = 1;
+  cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  VkResult alloc_result =
+      vkAllocateCommandBuffers(device_, &cmd_ai, &batch.command_buffer);
+  ASSERT(alloc_result == VK_SUCCESS,
+         "Failed to allocate upload command buffer!");
+
+  VkCommandBufferBeginInfo cmd_bi{};
+  cmd_bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmd_bi.pNext = nullptr;
+  cmd_bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  cmd_bi.pInheritanceInfo = nullptr;
+  VkResult begin_result = vkBeginCommandBuffer(batch.command_buffer, &cmd_bi);
+  ASSERT(begin_result == VK_SUCCESS,
+         "Failed to begin recording upload command buffer!");
+  batch.upload_value = 0;
+  batch.frame_value = 0;
+}
+void Application::Renderer::SubmitUploadBatch(UploadBatch& batch) {
+  VkResult end_result = vkEndCommandBuffer(batch.command_buffer);
+  ASSERT(end_result == VK_SUCCESS,
+         "Failed to finish recording upload command buffer!");
+
+  upload_timeline_value_++;
+  batch.upload_value = upload_timeline_value_;
+  VkTimelineSemaphoreSubmitInfo timeline_si{};
+  timeline_si.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_si.pNext = nullptr;
+  timeline_si.waitSemaphoreValueCount = 0;
+  timeline_si.pWaitSemaphoreValues = nullptr;
+  timeline_si.signalSemaphoreValueCount = 1;
+  timeline_si.pSignalSemaphoreValues = &batch.upload_value;
+
+  VkSubmitInfo cmd_si{};
+  cmd_si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  cmd_si.pNext = &timeline_si;
+  cmd_si.waitSemaphoreCount = 0;
+  cmd_si.pWaitSemaphores = nullptr;
+  cmd_si.pWaitDstStageMask = nullptr;
+  cmd_si.commandBufferCount = 1;
+  cmd_si.pCommandBuffers = &batch.command_buffer;
+  cmd_si.signalSemaphoreCount = 1;
+  cmd_si.pSignalSemaphores = &upload_timeline_semaphore_;
+  VkResult submit_result =
+      vkQueueSubmit(transfer_queue_, 1, &cmd_si, VK_NULL_HANDLE);
+  ASSERT(submit_result == VK_SUCCESS, "Failed to submit upload batch!");
+
+  upload_batches_.push_back(std::move(batch));
+}
+bool Application::Renderer::IsUploadOwnershipTransferred() const {
+  return queue_family_indices_.transfer_queue_index_.value() !=
+         queue_family_indices_.graphics_queue_index_.value();
+}
+void Application::Renderer::ReleaseUploadImage(VkCommandBuffer& cmd,
+                                               VkImage image) {
+  // Hand a freshly written staging image over to the graphics queue, the
+  // matching acquire is recorded by AcquireUploadImage
+  VkImageMemoryBarrier image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  image_barrier.pNext = nullptr;
+  image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  image_barrier.dstAccessMask = 0;
+  image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  image_barrier.srcQueueFamilyIndex =
+      queue_family_indices_.transfer_queue_index_.value();
+  image_barrier.dstQueueFamilyIndex =
+      queue_family_indices_.graphics_queue_index_.value();
+  image_barrier.image = image;
+  image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.baseMipLevel = 0;
+  image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  // Within one family there is no ownership to hand over, this is then the
+  // only barrier and it makes the writes visible to the mipmap reads
+  if (!IsUploadOwnershipTransferred()) {
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  }
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0,
+                       nullptr, 0, nullptr, 1, &image_barrier);
+}
+void Application::Renderer::AcquireUploadImage(VkCommandBuffer& cmd,
+                                               VkImage image) {
+  if (!IsUploadOwnershipTransferred()) return;
+  VkImageMemoryBarrier image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  image_barrier.pNext = nullptr;
+  image_barrier.srcAccessMask = 0;
+  image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  image_barrier.srcQueueFamilyIndex =
+      queue_family_indices_.transfer_queue_index_.value();
+  image_barrier.dstQueueFamilyIndex =
+      queue_family_indices_.graphics_queue_index_.value();
+  image_barrier.image = image;
+  image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.baseMipLevel = 0;
+  image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &image_barrier);
+}
+void Application::Renderer::RecordUploadGraphicsCommands(VkCommandBuffer& cmd) {
+  // The frame being recorded signals the next value of the frame timeline
+  for (UploadBatch& batch : upload_batches_) {
+    if (batch.frame_value != 0) continue;
+    for (std::function<void(VkCommandBuffer&)>& command :
+         batch.graphics_commands)
+      command(cmd);
+    batch.frame_value = frame_timeline_value_ + 1;
+    upload_wait_value_ = std::max(upload_wait_value_, batch.upload_value);
+  }
+}
+void Application::Renderer::RetireUploadBatches() {
+  uint64_t completed_value = 0;
+  vkGetSemaphoreCounterValue(device_, frame_timeline_semaphore_,
+                             &completed_value);
+  // Pending batches stay in submission order
+  auto retired_begin = std::stable_partition(
+      upload_batches_.begin(), upload_batches_.end(),
+      [completed_value](const UploadBatch& batch) {
+        return batch.frame_value == 0 || batch.frame_value > completed_value;
+      });
+  for (auto it = retired_begin; it != upload_batches_.end(); it++)
+    FreeUploadBatch(*it);
+  upload_batches_.erase(retired_begin, upload_batches_.end());
+}
+void Application::Renderer::FreeUploadBatch(UploadBatch& batch) {
+  vkFreeCommandBuffers(device_, upload_command_pool_, 1,
+                       &batch.command_buffer);
+  for (VkBuffer buffer : batch.buffers)
+    vkDestroyBuffer(device_, buffer, nullptr);
+  for (VkImageView image_view : batch.image_views)
+    vkDestroyImageView(device_, image_view, nullptr);
+  for (VkImage image : batch.images) vkDestroyImage(device_, image, nullptr);
+  for (MemoryAllocation& memory : batch.memory)
+    FreeMemory(memory);
+  if (!batch.descriptor_sets.empty()) {
+    vkFreeDescriptorSets(device_, mipmap_descriptor_pool_,
+                         static_cast<uint32_t>(batch.descriptor_sets.size()),
+                         batch.descriptor_sets.data());
+  }
+}
+VkCommandBuffer& Application::Renderer::BeginSetupCommands() {
+  SetupContext& setup = setup_context_;
+  if (setup.recording) return setup.command_buffer;
+  // The command buffer and staging arena are reused, so the last submission
+  // needs to finish first
+  WaitSetupCommands();
+  VkCommandBufferBeginInfo cmd_bi{};
+  cmd_bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmd_bi.pNext = nullptr;
+  cmd_bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  cmd_bi.pInheritanceInfo = nullptr;
+  VkResult begin_result = vkBeginCommandBuffer(setup.command_buffer, &cmd_bi);
+  ASSERT(begin_result == VK_SUCCESS,
+         "Failed to begin recording setup command buffer!");
+  setup.recording = true;
+  return setup.command_buffer;
+}
+VkBuffer Application::Renderer::StageSetupData(const void* data,
+                                               VkDeviceSize size,
+                                               VkDeviceSize& offset) {
+  SetupContext& setup = setup_context_;
+  BeginSetupCommands();
+  if (size > kSetupStagingSize) {
+    VkBuffer staging_buffer;
+    MemoryAllocation staging_memory;
+    CreateBuffer(staging_buffer, staging_memory, MemoryCategory::kStaging,
+                 size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    memcpy(MapMemory(staging_memory), data, size);
+    setup.buffers.push_back(staging_buffer);
+    setup.memory.push_back(staging_memory);
+    offset = 0;
+    return staging_buffer;
+  }
+  // Keeps buffer to image copies aligned to their texel size
+  VkDeviceSize aligned_head = (setup.staging_head + 15) / 16 * 16;
+  if (aligned_head + size > kSetupStagingSize) {
+    SubmitSetupCommands();
+    BeginSetupCommands();
+    aligned_head = 0;
+  }
+  memcpy(static_cast<char*>(MapMemory(setup.staging_memory)) + aligned_head,
+         data, size);
+  setup.staging_head = aligned_head + size;
+  offset = aligned_head;
+  return setup.staging_buffer;
+}
+void Application::Renderer::SubmitSetupCommands() {
+  SetupContext& setup = setup_context_;
+  if (!setup.recording) return;
+  // Buffers filled by setup copies are used without any further barrier
+  VkMemoryBarrier memory_barrier{};
+  memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memory_barrier.pNext = nullptr;
+  memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(setup.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+                       &memory_barrier, 0, nullptr, 0, nullptr);
+  VkResult end_result = vkEndCommandBuffer(setup.command_buffer);
+  ASSERT(end_result == VK_SUCCESS,
+         "Failed to finish recording setup command buffer!");
+  VkSubmitInfo cmd_si{};
+  cmd_si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  cmd_si.pNext = nullptr;
+  cmd_si.waitSemaphoreCount = 0;
+  cmd_si.pWaitSemaphores = nullptr;
+  cmd_si.pWaitDstStageMask = nullptr;
+  cmd_si.commandBufferCount = 1;
+  cmd_si.pCommandBuffers = &setup.command_buffer;
+  cmd_si.signalSemaphoreCount = 0;
+  cmd_si.pSignalSemaphores = nullptr;
+  VkResult submit_result =
+      vkQueueSubmit(graphics_queue_, 1, &cmd_si, setup.fence);
+  ASSERT(submit_result == VK_SUCCESS, "Failed to submit setup commands!");
+  setup.recording = false;
+  setup.pending = true;
+}
+void Application::Renderer::WaitSetupCommands() {
+  SetupContext& setup = setup_context_;
+  if (!setup.pending) return;
+  vkWaitForFences(device_, 1, &setup.fence, VK_TRUE, UINT64_MAX);
+  vkResetFences(device_, 1, &setup.fence);
+  for (VkBuffer buffer : setup.buffers)
+    vkDestroyBuffer(device_, buffer, nullptr);
+  for (MemoryAllocation& memory : setup.memory) FreeMemory(memory);
+  setup.buffers.clear();
+  setup.memory.clear();
+  setup.staging_head = 0;
+  setup.pending = false;
+}
+}  // namespace catalyst
@@ -1,5 +1,6 @@
 #include <catalyst/render/renderer.h>
 
+#include <algorithm>
 #include <fstream>
 
 namespace catalyst {
@@ -16,11 +17,10 @@ std::vector<char> Application::Renderer::ReadFile(const std::string& path) {
 
   return buffer;
 }
-uint32_t Application::Renderer::SelectMemoryType(
+bool Application::Renderer::FindMemoryType(
     const VkMemoryRequirements& mem_reqs,
-    const VkMemoryPropertyFlags& req_props) {
+    const VkMemoryPropertyFlags& req_props, uint32_t& mem_index) {
   bool mem_found = false;
-  uint32_t mem_index = -1;
   for (uint32_t mem_i = 0; mem_i < mem_props_.memoryTypeCount; mem_i++) {
     if ((mem_reqs.memoryTypeBits >> mem_i) & 1 &&
         (mem_props_.memoryTypes[mem_i].propertyFlags & req_props) ==
@@ -29,12 +29,23 @@ uint32_t Application::Renderer::SelectMemoryType(
       mem_index = mem_i;
     }
   }
+  return mem_found;
+}
+uint32_t Application::Renderer::SelectMemoryType(
+    const VkMemoryRequirements& mem_reqs,
+    const VkMemoryPropertyFlags& req_props) {
+  uint32_t mem_index = -1;
+  bool mem_found = FindMemoryType(mem_reqs, req_props, mem_index);
   ASSERT(mem_found, "Could not find suitable memory type!");
   return mem_index;
 }
 void Application::Renderer::CreateBuffer(
-    VkBuffer& buffer, VkDeviceMemory& memory, const VkDeviceSize& size,
-    const VkBufferUsageFlags& usage, const VkMemoryPropertyFlags& req_props) {
+    VkBuffer& buffer, MemoryAllocation& memory, MemoryCategory category,
+    const VkDeviceSize& size, const VkBufferUsageFlags& usage,
+    const VkMemoryPropertyFlags& req_props, bool transfer_shared) {
+  uint32_t queue_families[] = {
+      queue_family_indices_.graphics_queue_index_.value(),
+      queue_family_indices_.transfer_queue_index_.value()};
   VkBufferCreateInfo buffer_ci{};
   buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   buffer_ci.pNext = nullptr;
@@ -43,8 +54,14 @@ void Application::Renderer::CreateBuffer(
   buffer_ci.usage = usage;
   buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   buffer_ci.queueFamilyIndexCount = 1;
-  buffer_ci.pQueueFamilyIndices =
-      &queue_family_indices_.transfer_queue_index_.value();
+  buffer_ci.pQueueFamilyIndices = &queue_families[1];
+  // Buffers the transfer queue writes while the graphics queue reads other
+  // ranges of them skip queue family ownership transfers
+  if (transfer_shared && queue_families[0] != queue_families[1]) {
+    buffer_ci.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    buffer_ci.queueFamilyIndexCount = 2;
+    buffer_ci.pQueueFamilyIndices = queue_families;
+  }
   VkResult create_result =
       vkCreateBuffer(device_, &buffer_ci, nullptr, &buffer);
   ASSERT(create_result == VK_SUCCESS, "Failed to create buffer!");
@@ -52,24 +69,32 @@ void Application::Renderer::CreateBuffer(
   VkMemoryRequirements mem_reqs{};
   vkGetBufferMemoryRequirements(device_, buffer, &mem_reqs);
 
-  VkMemoryAllocateInfo memory_ai{};
-  memory_ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  memory_ai.pNext = nullptr;
-  memory_ai.allocationSize = mem_reqs.size;
-  memory_ai.memoryTypeIndex = SelectMemoryType(mem_reqs, req_props);
-  VkResult alloc_result =
-      vkAllocateMemory(device_, &memory_ai, nullptr, &memory);
-  ASSERT(alloc_result == VK_SUCCESS, "Failed to allocate memory!");
-
-  VkResult bind_result = vkBindBufferMemory(device_, buffer, memory, 0);
+  AllocateMemory(memory, category, mem_reqs, req_props, 0, false);
+  VkResult bind_result =
+      vkBindBufferMemory(device_, buffer, memory.memory, memory.offset);
   ASSERT(bind_result == VK_SUCCESS, "Failed to bind memory to buffer!");
 }
 
 void Application::Renderer::CreateImage(
-    VkImage& image, VkDeviceMemory& memory, VkImageCreateFlags flags,
-    const VkFormat format, const VkExtent3D extent, const uint32_t mip_levels,
+    VkImage& image, MemoryAllocation& memory, MemoryCategory category,
+    VkImageCreateFlags flags, const VkFormat format, const VkExtent3D extent,
+    const uint32_t mip_levels, const uint32_t array_layers,
+    const VkImageUsageFlags usage, const VkMemoryPropertyFlags req_props,
+    const VkSampleCountFlagBits samples) {
+  std::vector<VkImage> images(1);
+  CreateAliasedImages(images, memory, category, flags, format, extent,
+                      mip_levels, array_layers, usage, req_props, req_props,
+                      samples);
+  image = images[0];
+}
+void Application::Renderer::CreateAliasedImages(
+    std::vector<VkImage>& images, MemoryAllocation& memory,
+    MemoryCategory category, VkImageCreateFlags flags, const VkFormat format,
+    const VkExtent3D extent, const uint32_t mip_levels,
     const uint32_t array_layers, const VkImageUsageFlags usage,
-    const VkMemoryPropertyFlags req_props, const VkSampleCountFlagBits samples) {
+    const VkMemoryPropertyFlags req_props,
+    const VkMemoryPropertyFlags preferred_props,
+    const VkSampleCountFlagBits samples) {
   VkImageCreateInfo image_ci{};
   image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   image_ci.pNext = nullptr;
@@ -86,30 +111,49 @@ void Application::Renderer::CreateImage(
   image_ci.queueFamilyIndexCount = 1;
   image_ci.pQueueFamilyIndices = nullptr;
   image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  VkResult create_result = vkCreateImage(device_, &image_ci, nullptr, &image);
-  ASSERT(create_result == VK_SUCCESS, "Failed to create image!");
-
   VkMemoryRequirements mem_reqs{};
-  vkGetImageMemoryRequirements(device_, image, &mem_reqs);
+  mem_reqs.memoryTypeBits = ~0u;
+  for (VkImage& image : images) {
+    VkResult create_result =
+        vkCreateImage(device_, &image_ci, nullptr, &image);
+    ASSERT(create_result == VK_SUCCESS, "Failed to create image!");
+
+    VkMemoryRequirements image_reqs{};
+    vkGetImageMemoryRequirements(device_, image, &image_reqs);
+    mem_reqs.size = std::max(mem_reqs.size, image_reqs.size);
+    mem_reqs.alignment = std::max(mem_reqs.alignment, image_reqs.alignment);
+    mem_reqs.memoryTypeBits &= image_reqs.memoryTypeBits;
+  }
 
-  VkMemoryAllocateInfo image_ai{};
-  image_ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  image_ai.pNext = nullptr;
-  image_ai.memoryTypeIndex = SelectMemoryType(mem_reqs, req_props);
-  image_ai.allocationSize = mem_reqs.size;
-  VkResult alloc_result =
-      vkAllocateMemory(device_, &image_ai, nullptr, &memory);
-  ASSERT(alloc_result == VK_SUCCESS, "Failed to allocate image memory!");
-  VkResult bind_result = vkBindImageMemory(device_, image, memory, 0);
-  ASSERT(bind_result == VK_SUCCESS, "Failed to bind image memory!");
+  // Preferred properties (eg. lazily allocated memory for transient
+  // attachments) are dropped if no memory type supports them
+  AllocateMemory(memory, category, mem_reqs, req_props, preferred_props,
+                 true);
+  // Every image covers the whole allocation, so only one of them may hold
+  // valid contents at a time
+  for (VkImage image : images) {
+    VkResult bind_result =
+        vkBindImageMemory(device_, image, memory.memory, memory.offset);
+    ASSERT(bind_result == VK_SUCCESS, "Failed to bind image memory!");
+    if (image != images[0]) image_aliases_[image] = images[0];
+  }
+}
+void Application::Renderer::RemoveImageAliases(
+    const std::vector<VkImage>& images) {
+  for (VkImage image : images) image_aliases_.erase(image);
 }
 
 void Application::Renderer::CreateImageView(
     VkImageView& image_view, VkImage& image, VkImageViewType type,
-    const VkFormat format, const VkImageAspectFlags aspect_flags) {
+    const VkFormat format, const VkImageAspectFlags aspect_flags,
+    const VkImageUsageFlags usage) {
+  VkImageViewUsageCreateInfo view_usage_ci{};
+  view_usage_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+  view_usage_ci.pNext = nullptr;
+  view_usage_ci.usage = usage;
   VkImageViewCreateInfo view_ci{};
   view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  view_ci.pNext = nullptr;
+  view_ci.pNext = usage != 0 ? &view_usage_ci : nullptr;
   view_ci.flags = 0;
   view_ci.image = image;
   view_ci.viewType = type;
@@ -134,8 +178,16 @@ void Application::Renderer::TransitionImageLayout(
     const VkPipelineStageFlagBits src_scope,
     const VkPipelineStageFlagBits dst_scope,
     const VkAccessFlags src_access_mask, const VkAccessFlags dst_access_mask) {
-  VkCommandBuffer cmd;
-  BeginSingleUseCommandBuffer(cmd);
+  CmdTransitionImageLayout(BeginSetupCommands(), image, image_aspect,
+                           initial_layout, final_layout, src_scope, dst_scope,
+                           src_access_mask, dst_access_mask);
+}
+void Application::Renderer::CmdTransitionImageLayout(
+    VkCommandBuffer& cmd, VkImage image,
+    const VkImageAspectFlagBits image_aspect,
+    const VkImageLayout initial_layout, const VkImageLayout final_layout,
+    const VkPipelineStageFlags src_scope, const VkPipelineStageFlags dst_scope,
+    const VkAccessFlags src_access_mask, const VkAccessFlags dst_access_mask) {
   VkImageMemoryBarrier image_barrier{};
   image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   image_barrier.pNext = nullptr;
@@ -143,10 +195,8 @@ void Application::Renderer::TransitionImageLayout(
   image_barrier.dstAccessMask = dst_access_mask;
   image_barrier.oldLayout = initial_layout;
   image_barrier.newLayout = final_layout;
-  image_barrier.srcQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
-  image_barrier.dstQueueFamilyIndex =
-      queue_family_indices_.graphics_queue_index_.value();
+  image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   image_barrier.image = image;
   image_barrier.subresourceRange.aspectMask = image_aspect;
   image_barrier.subresourceRange.baseArrayLayer = 0;
@@ -155,46 +205,5 @@ void Application::Renderer::TransitionImageLayout(
   image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
   vkCmdPipelineBarrier(cmd, src_scope, dst_scope, 0, 0, nullptr, 0, nullptr, 1,
                        &image_barrier);
-  EndSingleUseCommandBuffer(cmd);
-}
-
-void Application::Renderer::BeginSingleUseCommandBuffer(VkCommandBuffer& cmd) {
-  VkCommandBufferAllocateInfo cmd_ai{};
-  cmd_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmd_ai.pNext = nullptr;
-  cmd_ai.commandPool = command_pool_;
-  cmd_ai.commandBufferCount = 1;
-  cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  VkResult alloc_result = vkAllocateCommandBuffers(device_, &cmd_ai, &cmd);
-  ASSERT(alloc_result == VK_SUCCESS,
-         "Failed to allocate single use command buffer!");
-
-  VkCommandBufferBeginInfo cmd_bi{};
-  cmd_bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  cmd_bi.pNext = nullptr;
-  cmd_bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  cmd_bi.pInheritanceInfo = nullptr;
-  VkResult begin_result = vkBeginCommandBuffer(cmd, &cmd_bi);
-  ASSERT(begin_result == VK_SUCCESS,
-         "Failed to begin recording single use command buffer!");
-}
-void Application::Renderer::EndSingleUseCommandBuffer(VkCommandBuffer& cmd) {
-  vkEndCommandBuffer(cmd);
-
-  VkSubmitInfo cmd_si{};
-  cmd_si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  cmd_si.pNext = nullptr;
-  cmd_si.commandBufferCount = 1;
-  cmd_si.pCommandBuffers = &cmd;
-  cmd_si.waitSemaphoreCount = 0;
-  cmd_si.pWaitSemaphores = nullptr;
-  cmd_si.pWaitDstStageMask = 0;
-  cmd_si.signalSemaphoreCount = 0;
-  cmd_si.pSignalSemaphores = nullptr;
-  VkResult submit_result =
-      vkQueueSubmit(graphics_queue_, 1, &cmd_si, VK_NULL_HANDLE);
-  vkDeviceWaitIdle(device_);
-
-  vkFreeCommandBuffers(device_, command_pool_, 1, &cmd);
 }
 }
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include <catalyst/scene/resource.h>
 
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <catalyst/scene/scene.h>
 
 namespace catalyst {
@@ -76,7 +81,12 @@ Resource::Resource(Scene* scene, const std::string& name,
                    const ResourceType type)
     : name_(name), type_(type), property_manager_(), scene_(scene) {}
 Mesh::Mesh(Scene* scene, const std::string& name)
-    : Resource(scene, name, ResourceType::kMesh), material_id(0) {
+    : Resource(scene, name, ResourceType::kMesh),
+      material_id(0),
+      bounds_min(0.0f),
+      bounds_max(0.0f),
+      vertex_format(VertexFormat::kFloat),
+      unpack_transform(1.0f) {
   std::function<int()> mat_getter_ = [this]() -> int {
     return static_cast<int>(this->material_id);
   };
@@ -94,6 +104,63 @@ Mesh::Mesh(Scene* scene, const std::string& name)
       "Material", mat_getter_, mat_setter_, name_getter_,
       NamedIndexPropertyStyle::kDisallowNone);
 }
+void Mesh::UpdateBounds() {
+  bounds_min = glm::vec3(0.0f);
+  bounds_max = glm::vec3(0.0f);
+  if (vertices.empty()) return;
+  bounds_min = vertices[0].position;
+  bounds_max = vertices[0].position;
+  for (const Vertex& vertex : vertices) {
+    bounds_min = glm::min(bounds_min, vertex.position);
+    bounds_max = glm::max(bounds_max, vertex.position);
+  }
+}
+static int16_t PackSnorm16(float value) {
+  return static_cast<int16_t>(
+      std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+// Projects onto the octahedron and folds the lower half over the upper one.
+// Zero vectors decode to +Z.
+static void PackOctahedral(const glm::vec3& vector, int16_t* packed) {
+  float length = std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z);
+  glm::vec2 encoded(0.0f);
+  if (length > 0.0f) {
+    encoded = glm::vec2(vector.x, vector.y) / length;
+    if (vector.z < 0.0f) {
+      glm::vec2 signs(encoded.x >= 0.0f ? 1.0f : -1.0f,
+                      encoded.y >= 0.0f ? 1.0f : -1.0f);
+      encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * signs;
+    }
+  }
+  packed[0] = PackSnorm16(encoded.x);
+  packed[1] = PackSnorm16(encoded.y);
+}
+void Mesh::PackVertices() {
+  UpdateBounds();
+  glm::vec3 center = 0.5f * (bounds_min + bounds_max);
+  glm::vec3 extent = 0.5f * (bounds_max - bounds_min);
+  // One scale for all axes, so normals transform the same as unpacked ones
+  float scale = std::max(std::max(extent.x, extent.y), extent.z);
+  if (scale <= 0.0f) scale = 1.0f;
+  unpack_transform = glm::scale(glm::translate(glm::mat4(1.0f), center),
+                                glm::vec3(scale));
+  packed_vertices.resize(vertices.size());
+  for (size_t vertex_i = 0; vertex_i < vertices.size(); vertex_i++) {
+    const Vertex& vertex = vertices[vertex_i];
+    PackedVertex& packed = packed_vertices[vertex_i];
+    glm::vec3 position = (vertex.position - center) / scale;
+    for (uint32_t c = 0; c < 3; c++)
+      packed.position[c] = PackSnorm16(position[c]);
+    // Bitangents are rebuilt as cross(normal, tangent) times this sign
+    bool mirrored = glm::dot(glm::cross(vertex.normal, vertex.tangent),
+                             vertex.bitangent) < 0.0f;
+    packed.position[3] = mirrored ? -32767 : 32767;
+    PackOctahedral(vertex.normal, packed.normal);
+    PackOctahedral(vertex.tangent, packed.tangent);
+    packed.uv = glm::packHalf2x16(vertex.uv);
+  }
+  vertex_format = VertexFormat::kPacked;
+}
 Texture::Texture(Scene* scene, const std::string& name)
     : Resource(scene, name, ResourceType::kTexture) {}
 Cubemap::Cubemap(Scene* scene, const std::string& name)
@@ -133,7 +200,8 @@ Settings::Settings(Scene* scene, const std::string& name)
       shadowmap_bias_(0.01f),
       shadowmap_kernel_size_(4),
       ssao_enabled_(true),
-      ssr_enabled_(false) {
+      ssr_enabled_(false),
+      parallel_recording_enabled_(false) {
   property_manager_.AddFloatProperty(
       "Exposure Adjustment", Property::CreateFloatGetter(&exposure_adjustment_),
       Property::CreateFloatSetter(&exposure_adjustment_), 0.1f, 10.0f);
@@ -156,5 +224,9 @@ Settings::Settings(Scene* scene, const std::string& name)
   property_manager_.AddBooleanProperty(
       "SSR Enabled", Property::CreateBooleanGetter(&ssr_enabled_),
       Property::CreateBooleanSetter(&ssr_enabled_));
+  property_manager_.AddBooleanProperty(
+      "Parallel Command Recording",
+      Property::CreateBooleanGetter(&parallel_recording_enabled_),
+      Property::CreateBooleanSetter(&parallel_recording_enabled_));
 }
 }  // namespace catalyst
\ No newline at end of file
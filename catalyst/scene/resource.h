@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <cstdint>
+#include <vector>
 
 #include <glm/glm.hpp>
 
@@ -37,6 +38,21 @@ struct Vertex {
   glm::vec3 tangent;
   glm::vec3 bitangent;
 };
+// 20 byte vertex, positions are relative to the mesh bounds
+struct PackedVertex {
+  // Normalized to [-1, 1], w holds the sign of the bitangent
+  int16_t position[4];
+  // Octahedral encoded unit vectors
+  int16_t normal[2];
+  int16_t tangent[2];
+  // Half floats
+  uint32_t uv;
+};
+enum class VertexFormat : uint32_t {
+  kFloat = 0,   // Vertex
+  kPacked = 1,  // PackedVertex
+};
+const uint32_t kVertexFormatCount = 2;
 struct DebugDrawVertex {
   glm::vec3 position;
   glm::vec2 uv;
@@ -46,7 +62,18 @@ class Mesh : public Resource {
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
   uint32_t material_id;
+  // Object space bounds of the vertices
+  glm::vec3 bounds_min;
+  glm::vec3 bounds_max;
+  // Format the renderer uploads, packed meshes keep the float vertices for
+  // CPU side use
+  VertexFormat vertex_format;
+  std::vector<PackedVertex> packed_vertices;
+  // Maps packed positions back to object space
+  glm::mat4 unpack_transform;
   Mesh(Scene* scene, const std::string& name);
+  void UpdateBounds();
+  void PackVertices();
 };
 class Material : public Resource {
  public:
@@ -93,6 +120,7 @@ class Settings : public Resource {
   int shadowmap_kernel_size_;
   bool ssao_enabled_;
   bool ssr_enabled_;
+  bool parallel_recording_enabled_;
   Settings(Scene* scene, const std::string& name);
 };
 }  // namespace catalyst
\ No newline at end of file
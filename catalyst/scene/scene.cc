@@ -10,6 +10,8 @@
 #include <assimp/scene.h>
 
 #include <catalyst/dev/dev.h>
+#include <catalyst/filesystem/importer.h>
+#include <catalyst/filesystem/meshoptimizer.h>
 
 namespace catalyst {
 Scene::Scene() {
@@ -91,10 +93,12 @@ SceneObject* Scene::AddResourceToScene(Resource* resource) {
   return nullptr;
 }
 Mesh* Scene::AddMesh(const std::string& name) {
-  std::string mesh_name = GetAvailableResourceName(name);
-  Mesh* mesh = new Mesh(this, mesh_name);
+  return AddMesh(new Mesh(this, name));
+}
+Mesh* Scene::AddMesh(Mesh* mesh) {
+  mesh->name_ = GetAvailableResourceName(mesh->name_);
   meshes_.push_back(mesh);
-  resource_name_map_[mesh_name] = mesh;
+  resource_name_map_[mesh->name_] = mesh;
   return mesh;
 }
 Material* Scene::AddMaterial(const std::string& name) {
@@ -142,6 +146,11 @@ void Scene::DuplicateResource(const Resource* resource) {
       new_mesh->vertices = old_mesh->vertices;
       new_mesh->indices = old_mesh->indices;
       new_mesh->material_id = old_mesh->material_id;
+      new_mesh->bounds_min = old_mesh->bounds_min;
+      new_mesh->bounds_max = old_mesh->bounds_max;
+      new_mesh->vertex_format = old_mesh->vertex_format;
+      new_mesh->packed_vertices = old_mesh->packed_vertices;
+      new_mesh->unpack_transform = old_mesh->unpack_transform;
       break;
     }
     case ResourceType::kMaterial: {
@@ -265,58 +274,82 @@ void Scene::CreatePrimitiveMeshes() {
   cube->indices.resize(cube->vertices.size());
   std::iota(cube->indices.begin(), cube->indices.end(), 0);
   cube->material_id = 0;
+  OptimizeMesh(*cube);
+  cube->UpdateBounds();
+  // Models are imported once, later launches read them from the mesh cache
+  const uint32_t import_flags = aiProcess_Triangulate |
+                                aiProcess_GenSmoothNormals |
+                                aiProcess_GenUVCoords;
+  MeshCache mesh_cache("../cache/meshes");
+  Assimp::Importer* importer = nullptr;
   // Teapot
   Mesh* teapot =
       AddMesh(kPrimitiveMeshNames[static_cast<uint32_t>(PrimitiveMeshType::kTeapot)]);
-  Assimp::Importer *importer = new Assimp::Importer();
-  const aiScene* teapot_scene = importer->ReadFile(
-      "../assets/models/teapot.obj",
-      aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_GenUVCoords);
-  const aiMesh* teapot_mesh = teapot_scene->mMeshes[0];
-  uint32_t num_vertices = teapot_mesh->mNumVertices;
-  glm::mat4 teapot_transform3 =
-      glm::rotate(glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
-  teapot_transform3 = glm::scale(teapot_transform3, glm::vec3(0.5f));
-  glm::mat3 teapot_transform = glm::mat3(teapot_transform3);
-  for (uint32_t vertex_i = 0; vertex_i < num_vertices; vertex_i++) {
-    const aiVector3D ai_vertex = teapot_mesh->mVertices[vertex_i];
-    const aiVector3D ai_normal = teapot_mesh->mNormals[vertex_i].Normalize();
-    glm::vec3 vertex = {ai_vertex.x, ai_vertex.y, ai_vertex.z};
-    glm::vec3 normal = {ai_normal.x, ai_normal.y, ai_normal.z};
-    vertex = teapot_transform * vertex;
-    vertex.z -= 0.5;
-    normal = glm::normalize(teapot_transform * normal);
-    teapot->vertices.push_back({vertex, normal, {0.0f, 0.0f}});
-  }
-  teapot->indices.resize(teapot->vertices.size());
-  std::iota(teapot->indices.begin(), teapot->indices.end(), 0);
   teapot->material_id = 0;
+  if (mesh_cache.Open("../assets/models/teapot.obj", import_flags)) {
+    mesh_cache.ReadMesh(0, *teapot);
+  } else {
+    importer = new Assimp::Importer();
+    const aiScene* teapot_scene =
+        importer->ReadFile("../assets/models/teapot.obj", import_flags);
+    const aiMesh* teapot_mesh = teapot_scene->mMeshes[0];
+    uint32_t num_vertices = teapot_mesh->mNumVertices;
+    glm::mat4 teapot_transform3 =
+        glm::rotate(glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
+    teapot_transform3 = glm::scale(teapot_transform3, glm::vec3(0.5f));
+    glm::mat3 teapot_transform = glm::mat3(teapot_transform3);
+    for (uint32_t vertex_i = 0; vertex_i < num_vertices; vertex_i++) {
+      const aiVector3D ai_vertex = teapot_mesh->mVertices[vertex_i];
+      const aiVector3D ai_normal = teapot_mesh->mNormals[vertex_i].Normalize();
+      glm::vec3 vertex = {ai_vertex.x, ai_vertex.y, ai_vertex.z};
+      glm::vec3 normal = {ai_normal.x, ai_normal.y, ai_normal.z};
+      vertex = teapot_transform * vertex;
+      vertex.z -= 0.5;
+      normal = glm::normalize(teapot_transform * normal);
+      teapot->vertices.push_back({vertex, normal, {0.0f, 0.0f}});
+    }
+    teapot->indices.resize(teapot->vertices.size());
+    std::iota(teapot->indices.begin(), teapot->indices.end(), 0);
+    OptimizeMesh(*teapot);
+    teapot->UpdateBounds();
+    mesh_cache.Write("../assets/models/teapot.obj", import_flags, {teapot});
+  }
+  teapot->PackVertices();
   // Bunny 
   Mesh* bunny =
       AddMesh(kPrimitiveMeshNames[static_cast<uint32_t>(PrimitiveMeshType::kBunny)]);
-  importer->FreeScene();
-  const aiScene* bunny_scene =
-      importer->ReadFile("../assets/models/bun_zipper.obj",
-                         aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                             aiProcess_GenUVCoords);
-  const aiMesh* bunny_mesh = bunny_scene->mMeshes[0];
-  num_vertices = bunny_mesh->mNumVertices;
-  glm::mat4 bunny_transform3 =
-      glm::rotate(glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
-  bunny_transform3 = glm::scale(bunny_transform3, glm::vec3(2.0f));
-  glm::mat3 bunny_transform = glm::mat3(bunny_transform3);
-  for (uint32_t vertex_i = 0; vertex_i < num_vertices; vertex_i++) {
-    const aiVector3D ai_vertex = bunny_mesh->mVertices[vertex_i];
-    const aiVector3D ai_normal = bunny_mesh->mNormals[vertex_i].Normalize();
-    glm::vec3 vertex = {ai_vertex.x, ai_vertex.y, ai_vertex.z};
-    glm::vec3 normal = {ai_normal.x, ai_normal.y, ai_normal.z};
-    vertex = bunny_transform * vertex;
-    normal = glm::normalize(bunny_transform * normal);
-    bunny->vertices.push_back({vertex, normal, {0.0f, 0.0f}});
-  }
-  bunny->indices.resize(bunny->vertices.size());
-  std::iota(bunny->indices.begin(), bunny->indices.end(), 0);
   bunny->material_id = 0;
+  if (mesh_cache.Open("../assets/models/bun_zipper.obj", import_flags)) {
+    mesh_cache.ReadMesh(0, *bunny);
+  } else {
+    if (importer == nullptr) importer = new Assimp::Importer();
+    importer->FreeScene();
+    const aiScene* bunny_scene =
+        importer->ReadFile("../assets/models/bun_zipper.obj", import_flags);
+    const aiMesh* bunny_mesh = bunny_scene->mMeshes[0];
+    uint32_t num_vertices = bunny_mesh->mNumVertices;
+    glm::mat4 bunny_transform3 =
+        glm::rotate(glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f));
+    bunny_transform3 = glm::scale(bunny_transform3, glm::vec3(2.0f));
+    glm::mat3 bunny_transform = glm::mat3(bunny_transform3);
+    for (uint32_t vertex_i = 0; vertex_i < num_vertices; vertex_i++) {
+      const aiVector3D ai_vertex = bunny_mesh->mVertices[vertex_i];
+      const aiVector3D ai_normal = bunny_mesh->mNormals[vertex_i].Normalize();
+      glm::vec3 vertex = {ai_vertex.x, ai_vertex.y, ai_vertex.z};
+      glm::vec3 normal = {ai_normal.x, ai_normal.y, ai_normal.z};
+      vertex = bunny_transform * vertex;
+      normal = glm::normalize(bunny_transform * normal);
+      bunny->vertices.push_back({vertex, normal, {0.0f, 0.0f}});
+    }
+    bunny->indices.resize(bunny->vertices.size());
+    std::iota(bunny->indices.begin(), bunny->indices.end(), 0);
+    OptimizeMesh(*bunny);
+    bunny->UpdateBounds();
+    mesh_cache.Write("../assets/models/bun_zipper.obj", import_flags,
+                     {bunny});
+  }
+  bunny->PackVertices();
+  delete importer;
 }
 void Scene::CreatePrimitiveMaterials() {
   Material* standard = AddMaterial("Standard");
@@ -376,9 +409,14 @@ void Scene::AabbDfs(const SceneObject* focus, Aabb& aabb,
   if (focus->type_ == SceneObjectType::kMesh) {
     const MeshObject* mesh_object = static_cast<const MeshObject*>(focus);
     const Mesh* mesh = meshes_[mesh_object->mesh_id_];
-    for (const Vertex& vert : mesh->vertices) {
-      glm::vec3 vpos = glm::vec3(transform * glm::vec4(vert.position, 1.0f));
-      aabb.Extend(vpos);
+    // Corners of the mesh bounds, instead of visiting every vertex
+    for (uint32_t corner_i = 0; corner_i < 8 && !mesh->vertices.empty();
+         corner_i++) {
+      glm::vec3 corner = {
+          corner_i & 1 ? mesh->bounds_max.x : mesh->bounds_min.x,
+          corner_i & 2 ? mesh->bounds_max.y : mesh->bounds_min.y,
+          corner_i & 4 ? mesh->bounds_max.z : mesh->bounds_min.z};
+      aabb.Extend(glm::vec3(transform * glm::vec4(corner, 1.0f)));
     }
   }
   for (const SceneObject* child : focus->children_) {
@@ -64,7 +64,6 @@ const std::string kPrimitiveSkyboxNames[] = {
 };
 const class Scene {
  public:
-  static const uint32_t kMaxVertices = 1000000;
   static const uint32_t kMaxDebugDrawVertices = 1024;
   static const uint32_t kMaxDirectionalLights = 16;
   static const uint32_t kMaxShadowmapResolution = 1024;
@@ -99,6 +98,9 @@ const class Scene {
 
   // Add Resources
   Mesh* AddMesh(const std::string& name);
+  // Takes a mesh built outside the scene, eg. by an import thread, renaming
+  // it when its name is taken
+  Mesh* AddMesh(Mesh* mesh);
   Material* AddMaterial(const std::string& name);
   Texture* AddTexture(const std::string& name);
   Cubemap* AddCubemap(const std::string& name);
@@ -0,0 +1,55 @@
+#include <catalyst/thread/threadpool.h>
+
+#include <catalyst/dev/dev.h>
+
+namespace catalyst {
+ThreadPool::ThreadPool(uint32_t thread_count)
+    : active_tasks_(0), stopping_(false) {
+  ASSERT(thread_count > 0, "Thread pool requires at least one thread!");
+  for (uint32_t thread_i = 0; thread_i < thread_count; thread_i++)
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, thread_i);
+}
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_available_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+uint32_t ThreadPool::GetThreadCount() const {
+  return static_cast<uint32_t>(workers_.size());
+}
+void ThreadPool::Submit(Task task) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  task_available_.notify_one();
+}
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_finished_.wait(lock,
+                       [this] { return tasks_.empty() && active_tasks_ == 0; });
+}
+void ThreadPool::WorkerLoop(uint32_t thread_i) {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_available_.wait(lock,
+                           [this] { return stopping_ || !tasks_.empty(); });
+      if (stopping_ && tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+      active_tasks_++;
+    }
+    task(thread_i);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      active_tasks_--;
+      if (tasks_.empty() && active_tasks_ == 0) tasks_finished_.notify_all();
+    }
+  }
+}
+}  // namespace catalyst
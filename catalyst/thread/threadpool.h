@@ -0,0 +1,38 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace catalyst {
+// Fixed-size pool of worker threads. Tasks receive the index of the worker
+// running them so callers can keep per-thread state (eg. command pools).
+class ThreadPool {
+ public:
+  typedef std::function<void(uint32_t thread_i)> Task;
+
+  ThreadPool(uint32_t thread_count);
+  ~ThreadPool();
+  uint32_t GetThreadCount() const;
+  void Submit(Task task);
+  // Blocks until every submitted task has finished
+  void Wait();
+
+  // Uncopyable
+  ThreadPool(const ThreadPool&) = delete;
+  const ThreadPool& operator=(const ThreadPool&) = delete;
+
+ private:
+  std::vector<std::thread> workers_;
+  std::deque<Task> tasks_;
+  std::mutex mutex_;
+  std::condition_variable task_available_;
+  std::condition_variable tasks_finished_;
+  uint32_t active_tasks_;
+  bool stopping_;
+  void WorkerLoop(uint32_t thread_i);
+};
+}  // namespace catalyst
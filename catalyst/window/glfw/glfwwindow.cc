@@ -38,6 +38,7 @@ VkSurfaceKHR GlfwWindow::GetVkSurface() {
   return surface_;
 }
 bool GlfwWindow::IsOpen() { return !glfwWindowShouldClose(window_); }
+bool GlfwWindow::IsHeadless() { return false; }
 void GlfwWindow::Update() {
   input_manager_->BeginUpdate();
   glfwPollEvents();
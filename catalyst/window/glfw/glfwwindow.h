@@ -15,6 +15,7 @@ class GlfwWindow : public Window {
   void SetVkInstance(VkInstance& instance) override;
   std::pair<uint32_t, uint32_t> GetExtent() override;
   bool IsOpen() override;
+  bool IsHeadless() override;
   void Update() override;
   void CaptureCursor() override;
   void ReleaseCursor() override;
@@ -0,0 +1,41 @@
+#include <catalyst/window/headless/headlesswindow.h>
+
+namespace catalyst {
+HeadlessWindow::HeadlessWindow(uint32_t width, uint32_t height,
+                               uint32_t frame_limit)
+    : width_(width),
+      height_(height),
+      frame_limit_(frame_limit),
+      update_count_(0) {
+  instance_ = nullptr;
+  input_manager_ = nullptr;
+}
+void HeadlessWindow::StartUp(int& argc, char** argv) {
+  input_manager_ = new InputManager();
+  update_count_ = 0;
+}
+void HeadlessWindow::ShutDown() {
+  delete input_manager_;
+  input_manager_ = nullptr;
+}
+VkSurfaceKHR HeadlessWindow::GetVkSurface() { return VK_NULL_HANDLE; }
+void HeadlessWindow::SetVkInstance(VkInstance& instance) {
+  instance_ = &instance;
+}
+std::pair<uint32_t, uint32_t> HeadlessWindow::GetExtent() {
+  return std::make_pair(width_, height_);
+}
+bool HeadlessWindow::IsOpen() {
+  return frame_limit_ == 0 || update_count_ < frame_limit_;
+}
+bool HeadlessWindow::IsHeadless() { return true; }
+void HeadlessWindow::Update() {
+  input_manager_->BeginUpdate();
+  input_manager_->EndUpdate();
+  update_count_++;
+}
+void HeadlessWindow::CaptureCursor() {}
+void HeadlessWindow::ReleaseCursor() {}
+void HeadlessWindow::LoadScene(Scene* scene) {}
+uint32_t HeadlessWindow::GetUpdateCount() { return update_count_; }
+}  // namespace catalyst
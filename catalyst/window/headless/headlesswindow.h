@@ -0,0 +1,30 @@
+#pragma once
+#include <catalyst/window/window.h>
+
+namespace catalyst {
+// Window without a surface, the renderer draws into offscreen images instead
+// of a swapchain so it can run without a display (eg. on lavapipe)
+class HeadlessWindow : public Window {
+ public:
+  // Stays open for frame_limit updates, or indefinitely if frame_limit is 0
+  HeadlessWindow(uint32_t width, uint32_t height, uint32_t frame_limit = 0);
+  void StartUp(int& argc, char** argv) override;
+  void ShutDown() override;
+  VkSurfaceKHR GetVkSurface() override;
+  void SetVkInstance(VkInstance& instance) override;
+  std::pair<uint32_t, uint32_t> GetExtent() override;
+  bool IsOpen() override;
+  bool IsHeadless() override;
+  void Update() override;
+  void CaptureCursor() override;
+  void ReleaseCursor() override;
+  void LoadScene(Scene* scene) override;
+  uint32_t GetUpdateCount();
+
+ private:
+  uint32_t width_;
+  uint32_t height_;
+  uint32_t frame_limit_;
+  uint32_t update_count_;
+};
+}  // namespace catalyst
@@ -18,6 +18,7 @@ class Window {
   virtual VkSurfaceKHR GetVkSurface() = 0;
   virtual std::pair<uint32_t, uint32_t> GetExtent() = 0;
   virtual bool IsOpen() = 0;
+  virtual bool IsHeadless() = 0;
   virtual void Update() = 0;
   virtual void CaptureCursor() = 0;
   virtual void ReleaseCursor() = 0;
@@ -42,6 +42,7 @@ std::pair<uint32_t, uint32_t> EditorWindow::GetExtent() {
                         static_cast<uint32_t>(height * pixel_ratio));
 }
 bool EditorWindow::IsOpen() { return !(window_->window_should_close); }
+bool EditorWindow::IsHeadless() { return false; }
 void EditorWindow::Update() {
   input_manager_->BeginUpdate();
   qapp_->processEvents();
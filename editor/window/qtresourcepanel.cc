@@ -32,7 +32,7 @@ EditorWindow::QtWindow::QtResourcePanel::QtResourcePanel(QtWindow* window) : QWi
   addAction(open_action_);
 
   open_dialog_ = new QFileDialog(this);
-  open_dialog_->setFileMode(QFileDialog::FileMode::ExistingFile);
+  open_dialog_->setFileMode(QFileDialog::FileMode::ExistingFiles);
   open_dialog_->setViewMode(QFileDialog::ViewMode::Detail);
 }
 void EditorWindow::QtWindow::QtResourcePanel::LoadScene() {
@@ -181,9 +181,9 @@ void EditorWindow::QtWindow::QtResourcePanel::AddResource() {
 void EditorWindow::QtWindow::QtResourcePanel::ImportResource() {
   QStringList filenames;
   if (open_dialog_->exec()) filenames = open_dialog_->selectedFiles();
-  for (const QString& file : filenames) {
-    catalyst::Importer::AddResources(*scene_,file.toStdString());
-  }
+  std::vector<std::filesystem::path> paths;
+  for (const QString& file : filenames) paths.push_back(file.toStdString());
+  catalyst::Importer::AddResources(*scene_, paths);
   Populate();
 }
 }  // namespace editor
\ No newline at end of file